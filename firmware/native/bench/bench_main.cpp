@@ -0,0 +1,1095 @@
+// Switching-latency benchmark for the native build.
+//
+// Runs the real Protocol, SwitchDriver, Max328Router, SwitchValidator and
+// TestMode objects against the simulated board (native/hal/sim.h) and reports, per command,
+// the I2C transactions, bytes on the bus, modeled time to the first response
+// byte (ack) and to completion (SETTLED for CFG/SET). Each command
+// is also checked against the simulated MAX328s so a faster path that routes
+// wrongly fails the run.
+//
+// A second table times parse_line() alone on the host CPU (wall clock, and
+// TSC cycles on x86) so parser changes can be checked for per-command cost.
+//
+// Usage: program [--verbose]
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+#include "app.h"
+#include "binary_frame.h"
+#include "boot_log.h"
+#include "command_parser.h"
+#include "preset_store.h"
+#include "sim.h"
+#include "status_led.h"
+#include "vdp_sequences.h"
+
+namespace {
+
+bool verbose = false;
+uint64_t command_start_ns = 0;
+constexpr uint64_t kCommandTimeoutNs = 1000000000ull;
+
+struct Result {
+  uint32_t runs;
+  uint64_t transactions;
+  uint64_t bytes;
+  uint64_t ack_ns;
+  uint64_t ns;
+  bool ok;
+};
+
+// setup() and setup1(), core 1's run before the wait for it; the tasks
+// are added once, in main()
+void boot_steps() {
+  boot_log.reset();
+  begin_core0();
+  core0.reset();
+  driver.begin();
+  announce_when_ready();
+}
+
+void loop_once();
+
+// Run until the work left for after READY is done, so the rows after a boot
+// start from a settled CFG 1; returns the output up to then
+std::string finish_boot() {
+  uint64_t start = sim::now_ns();
+  while (boot_log.self_test() == BootLog::SelfTest::PENDING &&
+         sim::now_ns() - start < kCommandTimeoutNs) {
+    loop_once();
+  }
+  return Serial.take_output();
+}
+
+// `boards`: bit n set for each MCP23017 (0x20 + n) on the bus
+std::string boot(uint8_t boards = 0x01) {
+  sim::reset();
+  sim::set_boards_present(boards);
+  boot_steps();
+  return finish_boot();
+}
+
+bool contains(const std::string &haystack, const char *needle) {
+  return haystack.find(needle) != std::string::npos;
+}
+
+// Number after `key` in `out`, or -1
+long value_of(const std::string &out, const char *key) {
+  size_t pos = out.find(key);
+  if (pos == std::string::npos) {
+    return -1;
+  }
+  return strtol(out.c_str() + pos + strlen(key), nullptr, 10);
+}
+
+// A SWTEST scan that found every chip on every wired pad
+bool full_matrix(const std::string &out) {
+  std::string count = "CONNECTIONS: " + std::to_string(4 * kPadCount) + "\r";
+  return contains(out, count.c_str());
+}
+
+// The host has one thread, so the two cores of main.cpp take turns: one
+// scheduler pass of loop1() (switching) and then one of loop() (serial and
+// LED). An idle core gives up at most sim::kWfeSliceNs per turn.
+void loop_once() {
+  driver.update();
+  core0.run();
+}
+
+// Send one command and run the main loop until `done` appears in the output
+// (SETTLED for routing commands, the final OK/ERR line otherwise).
+std::string send(const char *line, const char *done, Result &result) {
+  Serial.inject(line);
+  Serial.inject("\n");
+  sim::reset_bus_stats();
+  uint64_t start = sim::now_ns();
+  command_start_ns = start;
+  std::string out;
+  while (!contains(out, done) && sim::now_ns() - start < kCommandTimeoutNs) {
+    loop_once();
+    if (out.empty()) {
+      result.ack_ns += Serial.first_output_ns() - start;
+    }
+    out += Serial.take_output();
+  }
+  result.ns += sim::now_ns() - start;
+  result.transactions += sim::bus_stats().transactions;
+  result.bytes += sim::bus_stats().bytes;
+  result.runs++;
+  if (verbose) {
+    printf("> %s\n%s", line, out.c_str());
+  }
+  return out;
+}
+
+// The simulated muxes must match what the router claims to have applied, and
+// a command that moved a switch must not return before the shortest settle.
+bool routed(const RouterState &state, uint8_t board = 0) {
+  if (sim::last_switch_ns() >= command_start_ns &&
+      sim::now_ns() - sim::last_switch_ns() < Max328Router::kVoltageSettleMs * 1000000ull) {
+    return false;
+  }
+  const Pad pads[4] = {state.ip, state.im, state.vp, state.vm};
+  for (uint8_t i = 0; i < 4; i++) {
+    sim::ChipState chip = sim::chip(board, i);
+    bool enabled = (router.enable_mask(board) >> i) & 0x01;
+    if (chip.enabled != enabled || chip.address != static_cast<uint8_t>(pads[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Expected state for a "SET ip im vp vm" line
+RouterState set_state(const char *line) {
+  RouterState state;
+  parse_pad_char(line[4], state.ip);
+  parse_pad_char(line[6], state.im);
+  parse_pad_char(line[8], state.vp);
+  parse_pad_char(line[10], state.vm);
+  return state;
+}
+
+Result bench_cfg() {
+  Result r = {};
+  r.ok = true;
+  for (int pass = 0; pass < 2; pass++) {
+    for (uint8_t cfg_id = 1; cfg_id <= 4; cfg_id++) {
+      char line[8];
+      snprintf(line, sizeof(line), "CFG %u", cfg_id);
+      std::string out = send(line, "SETTLED", r);
+      RouterState expected;
+      get_vdp_config(cfg_id, expected);
+      r.ok = r.ok && contains(out, "OK CFG") && routed(expected);
+    }
+  }
+  return r;
+}
+
+Result bench_set() {
+  Result r = {};
+  r.ok = true;
+  const char *lines[] = {"SET A D C B", "SET B C D A", "SET C B A D", "SET D A B C"};
+  for (const char *line : lines) {
+    std::string out = send(line, "SETTLED", r);
+    r.ok = r.ok && contains(out, "OK SET") && routed(set_state(line));
+  }
+  return r;
+}
+
+Result bench_swtest() {
+  Result r = {};
+  std::string out = send("SWTEST", "OK SWTEST", r);
+  r.ok = full_matrix(out) && contains(out, "OK SWTEST");
+  return r;
+}
+
+Result bench_cfgtest() {
+  Result r = {};
+  r.ok = true;
+  for (uint8_t cfg_id = 1; cfg_id <= vdp_config_count(); cfg_id++) {
+    char line[8];
+    snprintf(line, sizeof(line), "CFG %u", cfg_id);
+    Result ignored = {};
+    send(line, "SETTLED", ignored);
+    std::string out = send("CFGTEST", "OK CFGTEST", r);
+    r.ok = r.ok && contains(out, "OK CFGTEST PASS");
+  }
+  return r;
+}
+
+// Repeating the active preset must not touch the bus or wait to settle.
+Result bench_cfg_same() {
+  Result r = {};
+  Result ignored = {};
+  send("CFG 4", "SETTLED", ignored);
+  r.ok = routed(find_vdp_config(4)->state);
+  for (int i = 0; i < 4; i++) {
+    std::string out = send("CFG 4", "SETTLED", r);
+    r.ok = r.ok && contains(out, "OK CFG 4") && routed(find_vdp_config(4)->state);
+  }
+  return r;
+}
+
+// Moving only the V- leg breaks one MAX328 and waits the voltage settle.
+Result bench_set_one_leg() {
+  Result r = {};
+  r.ok = true;
+  Result ignored = {};
+  send("SET A D C B", "SETTLED", ignored);
+  const char *lines[] = {"SET A D C A", "SET A D C B"};
+  for (int pass = 0; pass < 2; pass++) {
+    for (const char *line : lines) {
+      std::string out = send(line, "SETTLED", r);
+      r.ok = r.ok && contains(out, "OK SET") && routed(set_state(line));
+    }
+  }
+  return r;
+}
+
+// Answered on core 0 from the snapshot core 1 publishes; never touches the bus.
+Result bench_state() {
+  Result r = {};
+  Result ignored = {};
+  send("CFG 2", "SETTLED", ignored);
+  r.ok = true;
+  for (int i = 0; i < 4; i++) {
+    std::string out = send("STATE?", "STATE", r);
+    r.ok = r.ok && contains(out, "STATE CFG=2 IP=B IM=C VP=D VM=A");
+  }
+  return r;
+}
+
+// TEST STEP runs on core 1; its reply must follow the step it reports.
+Result bench_test_step() {
+  Result r = {};
+  std::string out = send("TEST STEP", "TEST ACTIVE", r);
+  size_t step = out.find("TEST STEP PAD=A EN=IP");
+  size_t ok = out.find("OK TEST STEP");
+  size_t status = out.find("TEST ACTIVE=1 AUTO=0 INTERVAL_MS=500 PAD=A EN=IP");
+  r.ok = step != std::string::npos && ok != std::string::npos && status != std::string::npos &&
+         step < ok && ok < status;
+  Result ignored = {};
+  send("TEST OFF", "OK TEST OFF", ignored);
+  return r;
+}
+
+// STATE? while test mode re-routes every 20 ms. Queries land at different
+// points of the break/settle cycle; each reply must still come within one
+// scheduler pass instead of waiting for the step.
+Result bench_state_busy() {
+  constexpr uint64_t kMaxReplyNs = 20000;
+  Result r = {};
+  Result ignored = {};
+  send("TEST ON 20", "OK TEST ON", ignored);
+  r.ok = true;
+  for (int i = 0; i < 8; i++) {
+    uint64_t until = sim::now_ns() + 7300000;
+    while (sim::now_ns() < until) {
+      loop_once();
+    }
+    Serial.take_output();
+    sim::reset_bus_stats();
+    Serial.inject("STATE?\n");
+    uint64_t start = sim::now_ns();
+    std::string out;
+    while (!contains(out, "STATE CFG=") && sim::now_ns() - start < kCommandTimeoutNs) {
+      loop_once();
+      out += Serial.take_output();
+    }
+    uint64_t reply_ns = sim::now_ns() - start;
+    r.ack_ns += reply_ns;
+    r.ns += reply_ns;
+    r.runs++;
+    r.ok = r.ok && reply_ns < kMaxReplyNs;
+    if (verbose) {
+      printf("> STATE? (test mode running)\n%s", out.c_str());
+    }
+  }
+  send("TEST OFF", "OK TEST OFF", ignored);
+  return r;
+}
+
+// CFG with the status LED pulsing (BUSY, a frame every 20 ms): no frame may
+// go out while the router is inside a break/make/settle window, and the
+// pulse must carry on once the switches have settled.
+Result bench_led_quiet() {
+  Result r = {};
+  status_led.set_state(LedState::BUSY);
+  uint32_t start_pushes = sim::pixel_pushes();
+  r.ok = true;
+  const char *lines[] = {"CFG 3", "CFG 4", "CFG 1", "CFG 2"};
+  for (const char *line : lines) {
+    Serial.inject(line);
+    Serial.inject("\n");
+    sim::reset_bus_stats();
+    uint64_t start = sim::now_ns();
+    std::string out;
+    while (!contains(out, "SETTLED") && sim::now_ns() - start < kCommandTimeoutNs) {
+      bool quiet = router.quiet();
+      uint32_t pushes = sim::pixel_pushes();
+      loop_once();
+      if (quiet && router.quiet() && sim::pixel_pushes() != pushes) {
+        r.ok = false;
+      }
+      out += Serial.take_output();
+    }
+    r.ns += sim::now_ns() - start;
+    r.transactions += sim::bus_stats().transactions;
+    r.bytes += sim::bus_stats().bytes;
+    r.runs++;
+    r.ok = r.ok && contains(out, "SETTLED") && !router.quiet();
+    // 30 ms between commands: at least one pulse frame
+    uint64_t until = sim::now_ns() + 30000000;
+    while (sim::now_ns() < until) {
+      loop_once();
+    }
+    Serial.take_output();
+    if (verbose) {
+      printf("> %s (LED pulsing)\n%s", line, out.c_str());
+    }
+  }
+  r.ok = r.ok && sim::pixel_pushes() - start_pushes >= 4;
+  status_led.set_state(LedState::READY);
+  loop_once();
+  return r;
+}
+
+size_t count_of(const std::string &haystack, const char *needle) {
+  size_t n = 0;
+  for (size_t pos = haystack.find(needle); pos != std::string::npos;
+       pos = haystack.find(needle, pos + 1)) {
+    n++;
+  }
+  return n;
+}
+
+// SET that would short I+ to I-: refused before anything touches the bus.
+Result bench_set_short() {
+  Result r = {};
+  RouterState before = router.state();
+  std::string out = send("SET A A C D", "ERR", r);
+  r.ok = contains(out, "ERR") && r.transactions == 0 && routed(before);
+  return r;
+}
+
+// One pass over the presets with a 1 ms dwell each, timed on the board.
+Result bench_seq() {
+  Result r = {};
+  Result ignored = {};
+  send("SEQ LOAD VDP:1000", "OK SEQ", ignored);
+  uint32_t edges = sim::rising_edges(SequenceEngine::kTriggerOutPin);
+  std::string out = send("SEQ RUN", "SEQ DONE", r);
+  size_t steps = vdp_config_count();
+  r.ok = count_of(out, "SEQ STEP") == steps &&
+         sim::rising_edges(SequenceEngine::kTriggerOutPin) - edges == steps &&
+         routed(vdp_configs()[steps - 1].state);
+  return r;
+}
+
+// Same pass, advanced by a DMM trigger edge 100 us after each settled pulse.
+Result bench_seq_ext() {
+  Result r = {};
+  Result ignored = {};
+  send("SEQ RUN EXT", "OK SEQ", ignored);
+  sim::reset_bus_stats();
+  uint64_t start = sim::now_ns();
+  uint32_t edges = sim::rising_edges(SequenceEngine::kTriggerOutPin);
+  std::string out;
+  while (!contains(out, "SEQ DONE") && sim::now_ns() - start < kCommandTimeoutNs) {
+    loop_once();
+    std::string chunk = Serial.take_output();
+    out += chunk;
+    if (contains(chunk, "SEQ STEP")) {
+      sim::advance_ns(100000);
+      sim::drive_input(SequenceEngine::kTriggerInPin, true);
+      sim::drive_input(SequenceEngine::kTriggerInPin, false);
+    }
+  }
+  r.runs = 1;
+  r.ns = sim::now_ns() - start;
+  r.transactions = sim::bus_stats().transactions;
+  r.bytes = sim::bus_stats().bytes;
+  if (verbose) {
+    printf("%s", out.c_str());
+  }
+  size_t steps = vdp_config_count();
+  r.ok = count_of(out, "SEQ STEP") == steps &&
+         sim::rising_edges(SequenceEngine::kTriggerOutPin) - edges == steps &&
+         routed(vdp_configs()[steps - 1].state);
+  return r;
+}
+
+// EXT run driven edge by edge: one edge while step 1 is still settling
+// (early, ignored), two back to back on step 2 (the second is missed), one
+// on each later step. Every edge that ends a dwell must reach the first I2C
+// write of the next step within 10 us.
+Result bench_trigger() {
+  constexpr uint64_t kMaxLatencyNs = 10000;
+  Result r = {};
+  Result ignored = {};
+  send("SEQ LOAD VDP", "OK SEQ", ignored);
+  send("SEQ RUN 1 EXT", "OK SEQ", ignored);
+  // The reply comes as the run is posted; let core 1 start step 1
+  uint64_t until = sim::now_ns() + 1000000;
+  while (sim::now_ns() < until) {
+    loop_once();
+  }
+  sim::drive_input(SequenceEngine::kTriggerInPin, true);
+  sim::drive_input(SequenceEngine::kTriggerInPin, false);
+
+  uint64_t start = sim::now_ns();
+  uint64_t edge_ns = 0;
+  uint32_t step = 0;
+  std::string out = Serial.take_output();
+  r.ok = true;
+  while (!contains(out, "SEQ DONE") && sim::now_ns() - start < kCommandTimeoutNs) {
+    loop_once();
+    if (edge_ns != 0 && sim::bus_stats().transactions > 0) {
+      uint64_t latency = sim::bus_stats().first_start_ns - edge_ns;
+      r.ack_ns += latency;
+      r.ns += latency;
+      r.runs++;
+      r.transactions += sim::bus_stats().transactions;
+      r.bytes += sim::bus_stats().bytes;
+      r.ok = r.ok && latency < kMaxLatencyNs;
+      edge_ns = 0;
+    }
+    std::string chunk = Serial.take_output();
+    out += chunk;
+    if (contains(chunk, "SEQ STEP")) {
+      step++;
+      sim::advance_ns(100000);
+      sim::reset_bus_stats();
+      edge_ns = sim::now_ns();
+      sim::drive_input(SequenceEngine::kTriggerInPin, true);
+      sim::drive_input(SequenceEngine::kTriggerInPin, false);
+      if (step == 2) {
+        sim::drive_input(SequenceEngine::kTriggerInPin, true);
+        sim::drive_input(SequenceEngine::kTriggerInPin, false);
+      }
+    }
+  }
+  std::string status = send("SEQ?", "SEQ STEPS", ignored);
+  if (verbose) {
+    printf("%s%s", out.c_str(), status.c_str());
+  }
+  size_t steps = vdp_config_count();
+  // One edge per step, plus the early and the missed one
+  std::string counters = "TRIG_IN=" + std::to_string(steps + 2) + " TRIG_EARLY=1 TRIG_MISSED=1";
+  r.ok = r.ok && r.runs == steps - 1 && count_of(out, "SEQ STEP") == steps &&
+         contains(status, counters.c_str());
+  return r;
+}
+
+// The same edge-to-write bound with the probe ADC sampling at its full rate
+// (1000 records/s). Edges land at offsets spread over the 2 ms DMA buffer
+// period, so some arrive while core 1 is reducing a buffer; the sequence
+// step then waits for one ProbeAdc::kReduceRounds chunk at most. STATS TRIG
+// must report the same worst case as the bus, to the microsecond.
+Result bench_trigger_adc() {
+  constexpr uint64_t kMaxLatencyNs = 10000;
+  constexpr uint32_t kEdges = 48;
+  Result r = {};
+  Result ignored = {};
+  send("STATS RESET", "OK STATS RESET", ignored);
+  send("ADC START 500000 125", "OK ADC", ignored);
+  send("SEQ LOAD VDP", "OK SEQ", ignored);
+  send("SEQ RUN 0 EXT", "OK SEQ", ignored);
+  uint64_t start = sim::now_ns();
+  uint64_t edge_ns = 0;
+  uint64_t worst_ns = 0;
+  uint64_t best_ns = UINT64_MAX;
+  std::string out;
+  while (r.runs < kEdges && sim::now_ns() - start < 10 * kCommandTimeoutNs) {
+    loop_once();
+    if (edge_ns != 0 && sim::now_ns() > edge_ns && sim::bus_stats().transactions > 0) {
+      uint64_t latency = sim::bus_stats().first_start_ns - edge_ns;
+      r.ack_ns += latency;
+      r.ns += latency;
+      r.runs++;
+      r.transactions += sim::bus_stats().transactions;
+      r.bytes += sim::bus_stats().bytes;
+      worst_ns = latency > worst_ns ? latency : worst_ns;
+      best_ns = latency < best_ns ? latency : best_ns;
+      edge_ns = 0;
+    }
+    std::string chunk = Serial.take_output();
+    out += chunk;
+    if (contains(chunk, "SEQ STEP")) {
+      sim::reset_bus_stats();
+      edge_ns = sim::now_ns() + 100000 + (r.runs * 37000ull) % 2048000;
+      sim::pulse_input_at(SequenceEngine::kTriggerInPin, edge_ns);
+    }
+  }
+  send("SEQ ABORT", "OK SEQ ABORT", ignored);
+  send("ADC STOP", "OK ADC STOP", ignored);
+  std::string status = send("ADC?", "ADC ACTIVE=", ignored);
+  std::string stats = send("STATS?", "STATS END", ignored);
+  size_t trig = stats.find("STATS TRIG");
+  stats = trig == std::string::npos ? "" : stats.substr(trig);
+  if (verbose) {
+    printf("edge to first write: %.1f-%.1f us over %u edges\n%s%s", best_ns / 1000.0,
+           worst_ns / 1000.0, r.runs, status.c_str(), stats.c_str());
+  }
+  long reported_us = value_of(stats, "MAX_US=");
+  long worst_us = static_cast<long>(worst_ns / 1000);
+  r.ok = r.runs == kEdges && worst_ns < kMaxLatencyNs && count_of(out, "ADC seq=") > 0 &&
+         contains(status, "OVERRUNS=0") && value_of(stats, "STATS TRIG N=") >= kEdges &&
+         reported_us >= worst_us - 1 && reported_us <= worst_us + 1;
+  return r;
+}
+
+// seq= of the first "EVT seq=" line at or after `from`, or -1
+long event_seq(const std::string &out, const char *type, size_t from = 0) {
+  size_t pos = out.find(type, from);
+  size_t line = out.rfind("EVT seq=", pos);
+  if (pos == std::string::npos || line == std::string::npos || line < from) {
+    return -1;
+  }
+  return strtol(out.c_str() + line + 8, nullptr, 10);
+}
+
+// EVT ON streams the route write and its settle as two consecutive records
+Result bench_events() {
+  Result r = {};
+  Result ignored = {};
+  send("CFG 4", "SETTLED", ignored);
+  send("EVT ON", "OK EVT", ignored);
+  std::string out = send("CFG 3", "type=settled", r);
+  send("EVT OFF", "OK EVT", ignored);
+  std::string status = send("EVT?", "EVT STREAM", ignored);
+
+  RouterState state;
+  get_preset(3, state);
+  std::string route = std::string("type=route board=0 cfg=3 pads=") + pad_to_char(state.ip) +
+                      pad_to_char(state.im) + pad_to_char(state.vp) + pad_to_char(state.vm) +
+                      " en=15";
+  long route_seq = event_seq(out, route.c_str());
+  long settled_seq = event_seq(out, "type=settled cfg=3 settle_us=");
+  r.ok = route_seq >= 0 && settled_seq == route_seq + 1 &&
+         contains(status, "EVT STREAM=0") && contains(status, " DROPPED=0");
+  if (verbose) {
+    printf("%s", status.c_str());
+  }
+  return r;
+}
+
+// SEQ SWEEP: VdP then Hall with the field up, then down. The host side
+// answers each SEQ FIELD hold with SEQ CONTINUE at once.
+Result bench_sweep() {
+  Result r = {};
+  Serial.inject("SEQ SWEEP 1000\n");
+  sim::reset_bus_stats();
+  uint64_t start = sim::now_ns();
+  std::string out;
+  while (!contains(out, "SEQ DONE") && sim::now_ns() - start < kCommandTimeoutNs) {
+    loop_once();
+    std::string chunk = Serial.take_output();
+    out += chunk;
+    if (contains(chunk, "SEQ FIELD")) {
+      Serial.inject("SEQ CONTINUE\n");
+    }
+  }
+  r.runs = 1;
+  r.ns = sim::now_ns() - start;
+  r.transactions = sim::bus_stats().transactions;
+  r.bytes = sim::bus_stats().bytes;
+  if (verbose) {
+    printf("%s", out.c_str());
+  }
+  RouterState last;
+  get_preset(sweep_order()[sweep_length() - 1], last);
+  r.ok = contains(out, "OK SEQ SWEEP") && count_of(out, "SEQ STEP") == sweep_length() &&
+         count_of(out, "SEQ FIELD") == 2 && count_of(out, "OK SEQ CONTINUE") == 2 &&
+         routed(last);
+  return r;
+}
+
+// STATS? after the runs above: both cores report and the reply is closed.
+Result bench_stats() {
+  Result r = {};
+  std::string out = send("STATS?", "STATS END", r);
+  r.ok = contains(out, "STATS CMD CFG N=") && contains(out, "STATS LOOP0 N=") &&
+         contains(out, "STATS LOOP1 N=") && contains(out, "STATS I2C BOARD=0 N=") &&
+         r.transactions == 0;
+  return r;
+}
+
+// A saved preset and sequence survive a reboot: CFG 40 routes the saved pads
+// and the restored sequence runs without a SEQ LOAD. Reboots, so it runs
+// after STATS?.
+Result bench_presets() {
+  Result r = {};
+  Result ignored = {};
+  LittleFS.format();
+  std::string saved = send("PRESET SAVE 40 D C B A", "PRESET", ignored);
+  std::string builtin = send("PRESET SAVE 3 A B C D", "ERR", ignored);
+  send("SEQ LOAD 40:1000 2:1000", "OK SEQ", ignored);
+  std::string seq_saved = send("SEQ SAVE", "SEQ SAVE", ignored);
+
+  boot();
+  std::string out = send("CFG 40", "SETTLED", r);
+  bool cfg_ok = contains(out, "OK CFG 40") &&
+                routed(RouterState{Pad::D, Pad::C, Pad::B, Pad::A});
+  std::string list = send("PRESET LIST", "OK PRESET LIST", ignored);
+  std::string run = send("SEQ RUN", "SEQ DONE", ignored);
+  RouterState last;
+  get_vdp_config(2, last);
+  bool run_ok = count_of(run, "SEQ STEP") == 2 && routed(last);
+  send("PRESET DEL 40", "PRESET", ignored);
+  std::string gone = send("CFG 40", "ERR", ignored);
+  send("SEQ LOAD", "OK SEQ", ignored);
+  send("SEQ SAVE", "SEQ SAVE", ignored);
+  if (verbose) {
+    printf("%s", list.c_str());
+  }
+  r.ok = contains(saved, "OK PRESET SAVE 40") && contains(builtin, "ERR PRESET_ID") &&
+         contains(seq_saved, "OK SEQ SAVE 2") && cfg_ok &&
+         contains(list, "PRESET CFG=40 USER=1 FIELD=0 IP=D IM=C VP=B VM=A") &&
+         contains(list, "PRESET CFG=1 USER=0") && run_ok && contains(gone, "ERR") &&
+         !LittleFS.exists("/sequence.bin");
+  return r;
+}
+
+// During TEST ON every leg is routed to the pad under test, so saving the
+// current routing must be refused, and the store refuses an unsafe routing
+// however it gets there.
+Result bench_preset_unsafe() {
+  Result r = {};
+  Result ignored = {};
+  LittleFS.format();
+  send("TEST ON 500", "OK TEST", ignored);
+  std::string refused = send("PRESET SAVE 20", "ERR", r);
+  send("TEST OFF", "OK TEST OFF", ignored);
+  std::string missing = send("CFG 20", "ERR", ignored);
+  PresetStore store;
+  store.begin();
+  bool unsafe = store.save(20, RouterState{Pad::A, Pad::A, Pad::B, Pad::C}, 0) ==
+                PresetStore::Result::UNSAFE;
+  if (verbose) {
+    printf("%s%s", refused.c_str(), missing.c_str());
+  }
+  r.ok = contains(refused, "ERR TEST_ACTIVE") && contains(missing, "ERR") && unsafe &&
+         !LittleFS.exists("/presets.bin");
+  return r;
+}
+
+// READY goes out before CFG 1 has settled. After a watchdog reset the
+// cached self-test spares the probe of absent expanders and the readback.
+// Without an expander READY says MCP=0 and routing is refused. Reboots, so
+// it runs after STATS?.
+Result bench_boot() {
+  Result r = {};
+  Result ignored = {};
+  std::string ready = boot();
+  std::string power = send("BOOT?", "BOOT RESET", r);
+
+  sim::watchdog_reset();
+  boot_steps();
+  finish_boot();
+  std::string warm = send("BOOT?", "BOOT RESET", r);
+
+  std::string none = boot(0x00);
+  std::string refused = send("CFG 2", "ERR", ignored);
+  std::string failed = send("BOOT?", "BOOT RESET", ignored);
+  boot();
+  if (verbose) {
+    printf("%s%s%s%s%s", ready.c_str(), power.c_str(), warm.c_str(), none.c_str(),
+           failed.c_str());
+  }
+
+  std::string caps = std::string("READY FW=") + FIRMWARE_VERSION +
+                     " PADS=" + std::to_string(kPadCount) + " BOARDS=1 MCP=1";
+  long ready_us = value_of(power, "READY_US=");
+  r.ok = contains(ready, caps.c_str()) && contains(power, "RESET=POWER") &&
+         contains(power, "SELFTEST=PASS CACHED=0") && ready_us > 0 &&
+         ready_us < value_of(power, "SETTLED_US=") && contains(warm, "RESET=WATCHDOG") &&
+         contains(warm, "SELFTEST=PASS CACHED=1") &&
+         value_of(warm, "MCP_US=") < value_of(power, "MCP_US=") &&
+         contains(none, " MCP=0") && contains(refused, "ERR NO_BOARD") &&
+         contains(failed, "SELFTEST=FAIL");
+  return r;
+}
+
+// Probe `channel` mean in mV from the last "ADC seq=" record in `out`
+long adc_mv(const std::string &out, uint8_t channel) {
+  size_t at = out.rfind(" mv=");
+  if (at == std::string::npos) {
+    return -1;
+  }
+  const char *p = out.c_str() + at + 4;
+  for (uint8_t ch = 0; ch < channel; ch++) {
+    p = strchr(p, ',') + 1;
+  }
+  return strtol(p, nullptr, 10);
+}
+
+// Five records of the CFG 1 legs driven high, then again with the I+ switch
+// (U1) raised to 20 kOhm: that probe must read the lower divider while the
+// others do not move. SWTEST and TEST are refused while the ADC samples.
+Result bench_adc() {
+  Result r = {};
+  Result ignored = {};
+  boot();
+  std::string good = send("ADC START 500000 1250 5 DRIVE", "ADC seq=4 ", r);
+  std::string status = send("ADC?", "ADC ACTIVE=", ignored);
+
+  sim::set_switch_resistance(0, 20000);
+  std::string worn = send("ADC START 500000 1250 5 DRIVE", "ADC seq=9 ", r);
+  sim::set_switch_resistance(0, sim::kSwitchOnOhms);
+
+  send("ADC START 10000 100", "OK ADC", ignored);
+  std::string busy = send("SWTEST", "ERR", ignored);
+  busy += send("TEST STEP", "ERR", ignored);
+  std::string stopped = send("ADC STOP", "OK ADC STOP", ignored);
+  std::string swtest = send("SWTEST", "OK SWTEST", ignored);
+  if (verbose) {
+    printf("%s%s%s%s%s", good.c_str(), status.c_str(), worn.c_str(), busy.c_str(),
+           stopped.c_str());
+  }
+
+  // 3300 mV x 50k / (50k + Ron), within the +-2 LSB noise and rounding
+  auto near = [](long mv, long expected) { return mv > expected - 10 && mv < expected + 10; };
+  bool legs = true;
+  for (uint8_t ch = 0; ch < ProbeAdc::kChannels; ch++) {
+    legs = legs && near(adc_mv(good, ch), 3143) && (ch == 0 || near(adc_mv(worn, ch), 3143));
+  }
+  r.ok = contains(good, "OK ADC START 500000 1250") && count_of(good, "ADC seq=") == 5 &&
+         legs && near(adc_mv(worn, 0), 2357) && contains(status, "ACTIVE=0") &&
+         contains(status, "RECORDS=5") && contains(status, "OVERRUNS=0") &&
+         count_of(busy, "ERR ADC_ACTIVE") == 2 && contains(swtest, "OK SWTEST");
+  return r;
+}
+
+// A flash write parks core 1, and with it the DMA interrupt, so writes are
+// refused while the ADC samples. Should core 1 stall anyway, the DMA write
+// rings keep every transfer inside the buffers and only overruns are lost.
+Result bench_adc_flash() {
+  Result r = {};
+  Result ignored = {};
+  boot();
+  LittleFS.format();
+  send("ADC START 500000 1250", "OK ADC", ignored);
+  std::string refused = send("PRESET SAVE 20 D C B A", "ERR", r);
+  refused += send("PRESET DEL 20", "ERR", ignored);
+  refused += send("SEQ SAVE", "ERR", ignored);
+  std::string list = send("PRESET LIST", "OK PRESET LIST", ignored);
+
+  // About as long as a sector erase, 10 buffers at this rate
+  sim::hold_dma_irq1(true);
+  sim::advance_ns(20000000);
+  bool inside = true;
+  for (uint8_t i = 0; i < sim::kNumDmaChannels; i++) {
+    const sim::DmaChannel &ch = sim::dma_channel(i);
+    const char *at = reinterpret_cast<const char *>(ch.write);
+    inside = inside && (!ch.adc_dreq || (at >= reinterpret_cast<const char *>(&probe_adc) &&
+                                         at < reinterpret_cast<const char *>(&probe_adc + 1)));
+  }
+  sim::hold_dma_irq1(false);
+  std::string resumed = send("ADC?", "ADC ACTIVE=", ignored);
+  resumed += send("PING", "ADC seq=", ignored);
+  send("ADC STOP", "OK ADC STOP", ignored);
+  std::string saved = send("PRESET SAVE 20 D C B A", "PRESET", ignored);
+  if (verbose) {
+    printf("%s%s%s", refused.c_str(), resumed.c_str(), saved.c_str());
+  }
+  r.ok = count_of(refused, "ERR ADC_ACTIVE") == 3 && contains(list, "OK PRESET LIST") &&
+         inside && value_of(resumed, "OVERRUNS=") > 0 && contains(resumed, "ADC seq=") &&
+         sim::adc_lost_samples() == 0 && contains(saved, "OK PRESET SAVE 20") &&
+         !LittleFS.exists("/sequence.bin");
+  return r;
+}
+
+// One binary-mode request frame, COBS-encoded and delimited
+std::string bin_request(uint8_t id, BinOp op, std::vector<uint8_t> payload) {
+  std::vector<uint8_t> packet = {id, static_cast<uint8_t>(op)};
+  packet.insert(packet.end(), payload.begin(), payload.end());
+  uint16_t crc = crc16_ccitt(packet.data(), packet.size());
+  packet.push_back(static_cast<uint8_t>(crc & 0xFF));
+  packet.push_back(static_cast<uint8_t>(crc >> 8));
+  std::vector<uint8_t> encoded(packet.size() + packet.size() / 254 + 2);
+  size_t n = cobs_encode(packet.data(), packet.size(), encoded.data());
+  return std::string(reinterpret_cast<const char *>(encoded.data()), n) + '\0';
+}
+
+// Decode every complete frame in `stream`; frames with a bad CRC are dropped.
+std::vector<std::vector<uint8_t>> bin_frames(const std::string &stream) {
+  std::vector<std::vector<uint8_t>> frames;
+  size_t start = 0;
+  for (size_t end = stream.find('\0'); end != std::string::npos;
+       start = end + 1, end = stream.find('\0', start)) {
+    uint8_t packet[kBinMaxPacket];
+    size_t len = cobs_decode(reinterpret_cast<const uint8_t *>(stream.data()) + start,
+                             end - start, packet, sizeof(packet));
+    if (len >= 5 &&
+        crc16_ccitt(packet, len - 2) == (packet[len - 2] | (packet[len - 1] << 8))) {
+      frames.emplace_back(packet, packet + len - 2);
+    }
+  }
+  return frames;
+}
+
+// Binary mode: CFG 1-4 and STATE written back to back without waiting. Every
+// request gets its tagged reply, STATE already sees CFG 4, and only the last
+// CFG settles (the earlier ones are superseded mid-break).
+Result bench_binary() {
+  Result r = {};
+  Result ignored = {};
+  send("MODE BIN", "OK MODE BIN", ignored);
+  std::string requests;
+  for (uint8_t cfg_id = 1; cfg_id <= 4; cfg_id++) {
+    requests += bin_request(cfg_id, BinOp::CFG, {cfg_id});
+  }
+  requests += bin_request(5, BinOp::STATE, {});
+  Serial.inject(requests.data(), requests.size());
+
+  sim::reset_bus_stats();
+  uint64_t start = sim::now_ns();
+  command_start_ns = start;
+  std::string out;
+  bool settled = false;
+  while (!settled && sim::now_ns() - start < kCommandTimeoutNs) {
+    loop_once();
+    if (out.empty()) {
+      r.ack_ns = Serial.first_output_ns() - start;
+    }
+    out += Serial.take_output();
+    for (const std::vector<uint8_t> &f : bin_frames(out)) {
+      settled = settled || f[1] == static_cast<uint8_t>(BinOp::EVT_SETTLED);
+    }
+  }
+  r.runs = 1;
+  r.ns = sim::now_ns() - start;
+  r.transactions = sim::bus_stats().transactions;
+  r.bytes = sim::bus_stats().bytes;
+
+  std::vector<std::vector<uint8_t>> frames = bin_frames(out);
+  r.ok = frames.size() == 6 && routed(find_vdp_config(4)->state);
+  for (uint8_t id = 1; r.ok && id <= 5; id++) {
+    r.ok = frames[id - 1][0] == id && frames[id - 1][2] == static_cast<uint8_t>(BinStatus::OK);
+  }
+  if (r.ok) {
+    const std::vector<uint8_t> &state = frames[4];
+    const std::vector<uint8_t> &event = frames[5];
+    r.ok = state.size() == 3 + sizeof(BinState) && state[3] == 4 && state[4] == A &&
+           state[5] == D && state[6] == C && state[7] == B && event[0] == 4 && event[3] == 4;
+  }
+  if (verbose) {
+    for (const std::vector<uint8_t> &f : frames) {
+      printf("< id=%u op=0x%02X status=%u len=%zu\n", f[0], f[1], f[2], f.size() - 3);
+    }
+  }
+
+  std::string mode_ascii = bin_request(6, BinOp::MODE_ASCII, {});
+  Serial.inject(mode_ascii.data(), mode_ascii.size());
+  loop_once();
+  Serial.take_output();
+  return r;
+}
+
+// Reconfigure and verify in one line. The ENMASK/SET/ENMASK run is merged
+// into a single break/make/settle (one SETTLED), CFGTEST checks it once it
+// has settled, and STATE? sees the result. CFGTEST drives the muxes itself,
+// so routed() does not apply afterwards.
+Result bench_batch() {
+  Result r = {};
+  Result ignored = {};
+  send("CFG 1", "SETTLED", ignored);
+  std::string out =
+      send("ENMASK 3; SET A D C B; ENMASK 15; CFGTEST; STATE?", "OK BATCH", r);
+  r.ok = count_of(out, "SETTLED") == 1 && contains(out, "OK CFGTEST PASS") &&
+         contains(out, "STATE CFG=0 IP=A IM=D VP=C VM=B") && contains(out, "OK BATCH 5") &&
+         out.find("OK CFGTEST PASS") < out.find("OK BATCH") &&
+         router.enable_mask() == Max328Router::kEnableAll;
+  return r;
+}
+
+// Four switch matrices (0x20-0x23) moved to the same preset share one break
+// and one settle window, so this should cost about what CFG n does.
+Result bench_board_all() {
+  boot(0x0F);
+  Result r = {};
+  r.ok = true;
+  for (int pass = 0; pass < 2; pass++) {
+    for (uint8_t cfg_id = 1; cfg_id <= 4; cfg_id++) {
+      char line[20];
+      snprintf(line, sizeof(line), "BOARD ALL CFG %u", cfg_id);
+      std::string out = send(line, "SETTLED", r);
+      RouterState expected;
+      get_vdp_config(cfg_id, expected);
+      r.ok = r.ok && contains(out, "OK BOARD ALL CFG") && count_of(out, "SETTLED") == 1;
+      for (uint8_t b = 0; b < 4; b++) {
+        r.ok = r.ok && routed(expected, b);
+      }
+    }
+  }
+  return r;
+}
+
+// A different preset on each of four boards, folded from one batch into a
+// single transition
+Result bench_board_batch() {
+  Result r = {};
+  Result ignored = {};
+  send("BOARD ALL CFG 1", "SETTLED", ignored);
+  std::string out =
+      send("BOARD 0 CFG 2; BOARD 1 CFG 3; BOARD 2 CFG 4; BOARD 3 SET A B C D", "SETTLED", r);
+  Result query = {};
+  std::string boards = send("BOARDS?", "BOARDS", query);
+  r.ok = contains(out, "OK BATCH 4") && count_of(out, "SETTLED") == 1 &&
+         routed(find_vdp_config(2)->state, 0) && routed(find_vdp_config(3)->state, 1) &&
+         routed(find_vdp_config(4)->state, 2) && routed({A, B, C, D}, 3) &&
+         contains(boards, "BOARDS COUNT=4 PRESENT=0,1,2,3");
+  return r;
+}
+
+// The count I2C? reports for the last operation must match the bus.
+Result bench_i2c_count() {
+  Result r = {};
+  std::string out = send("SWTEST", "OK SWTEST", r);
+  Result ignored = {};
+  std::string query = send("I2C?", "I2C CLOCK", ignored);
+  std::string last = "LAST=" + std::to_string(r.transactions) + "\r";
+  r.ok = full_matrix(out) && contains(query, last.c_str());
+  return r;
+}
+
+// Reference scan, one cell at a time with fixed delays
+Result bench_swtest_slow() {
+  Result r = {};
+  std::string out = send("SWTEST SLOW", "OK SWTEST", r);
+  r.ok = full_matrix(out) && contains(out, "SCAN_US: ");
+  return r;
+}
+
+// SWTEST with the bus at 1 MHz
+Result bench_swtest_1mhz() {
+  Result r = {};
+  Result ignored = {};
+  send("I2C CLOCK 1000000", "OK I2C", ignored);
+  std::string out = send("SWTEST", "OK SWTEST", r);
+  r.ok = full_matrix(out) && sim::i2c_clock() == 1000000;
+  send("I2C CLOCK 400000", "OK I2C", ignored);
+  return r;
+}
+
+void report(const char *name, const Result &r) {
+  uint32_t runs = r.runs ? r.runs : 1;
+  printf("%-10s %5u %12.1f %12.1f %12.1f %12.1f  %s\n", name, r.runs,
+         static_cast<double>(r.transactions) / runs, static_cast<double>(r.bytes) / runs,
+         static_cast<double>(r.ack_ns) / runs / 1000.0, static_cast<double>(r.ns) / runs / 1000.0,
+         r.ok ? "ok" : "FAIL");
+}
+
+// Host cost of tokenizing and looking up one line. `valid` is whether the
+// line names a known command with an acceptable token count.
+bool bench_parse(const char *line, bool valid) {
+  constexpr int kIterations = 200000;
+  char buf[128];
+  size_t len = strlen(line);
+  ParsedLine parsed;
+  volatile uint8_t sink = 0;
+
+  auto start = std::chrono::steady_clock::now();
+#ifdef BENCH_HAVE_TSC
+  uint64_t tsc_start = __rdtsc();
+#endif
+  for (int i = 0; i < kIterations; i++) {
+    memcpy(buf, line, len + 1);
+    parse_line(buf, parsed);
+    sink = static_cast<uint8_t>(sink + parsed.argc);
+  }
+#ifdef BENCH_HAVE_TSC
+  double cycles = static_cast<double>(__rdtsc() - tsc_start) / kIterations;
+#else
+  double cycles = 0.0;
+#endif
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+                  .count() /
+              kIterations;
+
+  bool ok = (parsed.command != nullptr && parsed.args_ok) == valid;
+  printf("%-24s %10.1f %12.0f  %s\n", line, ns, cycles, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--verbose" || std::string(argv[i]) == "-v") {
+      verbose = true;
+    }
+  }
+
+  add_core0_tasks();
+  boot();
+
+  printf("OpenPauw native switching benchmark (firmware %s, I2C %u kHz)\n", FIRMWARE_VERSION,
+         sim::i2c_clock() / 1000);
+  printf("%-10s %5s %12s %12s %12s %12s  %s\n", "command", "runs", "i2c_txn/op",
+         "i2c_bytes/op", "ack_us/op", "t_us/op", "check");
+
+  bool ok = true;
+  struct Case {
+    const char *name;
+    Result (*fn)();
+  };
+  const Case cases[] = {
+      {"CFG n", bench_cfg},
+      {"SET", bench_set},
+      {"SWTEST", bench_swtest},
+      {"SWTEST 1M", bench_swtest_1mhz},
+      {"SW SLOW", bench_swtest_slow},
+      {"I2C? LAST", bench_i2c_count},
+      {"CFGTEST", bench_cfgtest},
+      {"CFG same", bench_cfg_same},
+      {"SET 1 leg", bench_set_one_leg},
+      {"SET short", bench_set_short},
+      {"STATE?", bench_state},
+      {"TEST STEP", bench_test_step},
+      {"STATE? bg", bench_state_busy},
+      {"LED quiet", bench_led_quiet},
+      {"BIN x5", bench_binary},
+      {"BATCH", bench_batch},
+      {"SEQ VdP", bench_seq},
+      {"SEQ EXT", bench_seq_ext},
+      {"SEQ SWEEP", bench_sweep},
+      {"TRIG in", bench_trigger},
+      {"TRIG adc", bench_trigger_adc},
+      {"EVT", bench_events},
+      {"STATS?", bench_stats},
+      {"PRESET", bench_presets},
+      {"PRESET test", bench_preset_unsafe},
+      {"BOOT", bench_boot},
+      {"ADC", bench_adc},
+      {"ADC flash", bench_adc_flash},
+      // These boot again with more expanders, so they run last
+      {"BOARD ALL", bench_board_all},
+      {"BOARD x4", bench_board_batch},
+  };
+  for (const Case &c : cases) {
+    Result r = c.fn();
+    report(c.name, r);
+    ok = ok && r.ok;
+  }
+
+  printf("\n%-24s %10s %12s  %s\n", "parse", "ns/line", "cycles/line", "check");
+  const struct {
+    const char *line;
+    bool valid;
+  } lines[] = {
+      {"PING", true},
+      {"STATE?", true},
+      {"CFG 1", true},
+      {"CFG 4", true},
+      {"cfg 2", true},
+      {"SET A B C D", true},
+      {"SET d c b a", true},
+      {"ENMASK 15", true},
+      {"TEST ON 500", true},
+      {"SEQ LOAD VDP:1000", true},
+      {"SEQ LOAD SWEEP:1000", true},
+      {"CFG", false},
+      {"NOPE 1 2", false},
+  };
+  for (const auto &l : lines) {
+    ok = bench_parse(l.line, l.valid) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+#include "Adafruit_MCP23X17.h"
+
+namespace {
+
+constexpr uint8_t kRegIodir = 0x00;
+constexpr uint8_t kRegGppu = 0x0C;
+constexpr uint8_t kRegGpio = 0x12;
+
+uint8_t port_register(uint8_t base, uint8_t pin) { return base + (pin < 8 ? 0 : 1); }
+
+}  // namespace
+
+bool Adafruit_MCP23X17::begin_I2C(uint8_t address, TwoWire *wire) {
+  address_ = address;
+  wire_ = wire;
+  wire_->begin();
+  wire_->beginTransmission(address_);
+  return wire_->endTransmission() == 0;
+}
+
+uint8_t Adafruit_MCP23X17::read_register(uint8_t reg) {
+  wire_->beginTransmission(address_);
+  wire_->write(reg);
+  wire_->endTransmission(false);
+  wire_->requestFrom(address_, 1);
+  int value = wire_->read();
+  return value < 0 ? 0 : static_cast<uint8_t>(value);
+}
+
+void Adafruit_MCP23X17::write_register(uint8_t reg, const uint8_t *data, uint8_t len) {
+  wire_->beginTransmission(address_);
+  wire_->write(reg);
+  wire_->write(data, len);
+  wire_->endTransmission();
+}
+
+void Adafruit_MCP23X17::write_bit(uint8_t reg, uint8_t bit, bool value) {
+  uint8_t current = read_register(reg);
+  if (value) {
+    current |= static_cast<uint8_t>(1 << bit);
+  } else {
+    current &= static_cast<uint8_t>(~(1 << bit));
+  }
+  write_register(reg, &current, 1);
+}
+
+void Adafruit_MCP23X17::pinMode(uint8_t pin, uint8_t mode) {
+  write_bit(port_register(kRegIodir, pin), pin % 8, mode != OUTPUT);
+  write_bit(port_register(kRegGppu, pin), pin % 8, mode == INPUT_PULLUP);
+}
+
+uint8_t Adafruit_MCP23X17::digitalRead(uint8_t pin) {
+  return (read_register(port_register(kRegGpio, pin)) >> (pin % 8)) & 0x01;
+}
+
+void Adafruit_MCP23X17::digitalWrite(uint8_t pin, uint8_t value) {
+  write_bit(port_register(kRegGpio, pin), pin % 8, value != LOW);
+}
+
+uint8_t Adafruit_MCP23X17::readGPIOA() { return read_register(kRegGpio); }
+
+uint8_t Adafruit_MCP23X17::readGPIOB() { return read_register(kRegGpio + 1); }
+
+uint16_t Adafruit_MCP23X17::readGPIOAB() {
+  wire_->beginTransmission(address_);
+  wire_->write(kRegGpio);
+  wire_->endTransmission(false);
+  wire_->requestFrom(address_, 2);
+  uint16_t lo = static_cast<uint16_t>(wire_->read() & 0xFF);
+  uint16_t hi = static_cast<uint16_t>(wire_->read() & 0xFF);
+  return static_cast<uint16_t>(lo | (hi << 8));
+}
+
+void Adafruit_MCP23X17::writeGPIOA(uint8_t value) { write_register(kRegGpio, &value, 1); }
+
+void Adafruit_MCP23X17::writeGPIOB(uint8_t value) { write_register(kRegGpio + 1, &value, 1); }
+
+void Adafruit_MCP23X17::writeGPIOAB(uint16_t value) {
+  uint8_t data[2] = {static_cast<uint8_t>(value & 0xFF), static_cast<uint8_t>(value >> 8)};
+  write_register(kRegGpio, data, 2);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Arduino.h"
+#include "Wire.h"
+
+// Adafruit MCP23X17 library (v2) stand-in. Each call issues the same I2C
+// transactions the real library does, so bus counts match hardware: pinMode()
+// and digitalWrite() are register read-modify-writes, writeGPIOAB() is a
+// single two-byte burst.
+class Adafruit_MCP23X17 {
+ public:
+  bool begin_I2C(uint8_t address = 0x20, TwoWire *wire = &Wire);
+
+  void pinMode(uint8_t pin, uint8_t mode);
+  uint8_t digitalRead(uint8_t pin);
+  void digitalWrite(uint8_t pin, uint8_t value);
+
+  uint8_t readGPIOA();
+  uint8_t readGPIOB();
+  uint16_t readGPIOAB();
+  void writeGPIOA(uint8_t value);
+  void writeGPIOB(uint8_t value);
+  void writeGPIOAB(uint16_t value);
+
+ private:
+  TwoWire *wire_ = &Wire;
+  uint8_t address_ = 0x20;
+
+  uint8_t read_register(uint8_t reg);
+  void write_register(uint8_t reg, const uint8_t *data, uint8_t len);
+  void write_bit(uint8_t reg, uint8_t bit, bool value);
+};
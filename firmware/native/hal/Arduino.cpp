@@ -0,0 +1,92 @@
+#include "Arduino.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+
+SimSerial Serial;
+RP2040 rp2040;
+
+void pinMode(uint8_t pin, uint8_t mode) { sim::gpio_set_mode(pin, mode); }
+
+void digitalWrite(uint8_t pin, uint8_t value) { sim::gpio_write(pin, value != LOW); }
+
+int digitalRead(uint8_t pin) { return sim::gpio_read(pin) ? HIGH : LOW; }
+
+void attachInterrupt(uint8_t pin, void (*isr)(), uint8_t mode) { sim::gpio_set_isr(pin, isr, mode); }
+
+void detachInterrupt(uint8_t pin) { sim::gpio_set_isr(pin, nullptr, 0); }
+
+unsigned long millis() {
+  sim::advance_ns(sim::kClockReadNs);
+  return static_cast<unsigned long>(sim::now_ns() / 1000000ull);
+}
+
+unsigned long micros() {
+  sim::advance_ns(sim::kClockReadNs);
+  return static_cast<unsigned long>(sim::now_ns() / 1000ull);
+}
+
+void delay(unsigned long ms) { sim::advance_ns(static_cast<uint64_t>(ms) * 1000000ull); }
+
+void delayMicroseconds(unsigned int us) { sim::advance_ns(static_cast<uint64_t>(us) * 1000ull); }
+
+int SimSerial::available() const {
+  sim::advance_ns(sim::kSerialPollNs);
+  return static_cast<int>(rx_.size() - rx_pos_);
+}
+
+int SimSerial::read() {
+  if (rx_pos_ >= rx_.size()) {
+    return -1;
+  }
+  int c = static_cast<unsigned char>(rx_[rx_pos_++]);
+  if (rx_pos_ == rx_.size()) {
+    rx_.clear();
+    rx_pos_ = 0;
+  }
+  return c;
+}
+
+size_t SimSerial::readBytes(char *buf, size_t len) {
+  size_t n = rx_.size() - rx_pos_;
+  if (n > len) {
+    n = len;
+  }
+  memcpy(buf, rx_.data() + rx_pos_, n);
+  rx_pos_ += n;
+  if (rx_pos_ == rx_.size()) {
+    rx_.clear();
+    rx_pos_ = 0;
+  }
+  return n;
+}
+
+size_t SimSerial::write(uint8_t c) {
+  if (tx_.empty()) {
+    tx_first_ns_ = sim::now_ns();
+  }
+  tx_ += static_cast<char>(c);
+  if (echo_) {
+    fputc(c, stdout);
+  }
+  return 1;
+}
+
+size_t SimSerial::write(const uint8_t *buf, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    write(buf[i]);
+  }
+  return len;
+}
+
+void SimSerial::inject(const char *data) { rx_ += data; }
+
+void SimSerial::inject(const char *data, size_t len) { rx_.append(data, len); }
+
+std::string SimSerial::take_output() {
+  std::string out;
+  out.swap(tx_);
+  return out;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+// Minimal Arduino core for the native build. Only what src/ uses is provided;
+// timing and pin access go through the hardware model in sim.h.
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "Print.h"
+
+#define LOW 0x0
+#define HIGH 0x1
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define INPUT_PULLDOWN 0x3
+
+#define CHANGE 0x2
+#define FALLING 0x3
+#define RISING 0x4
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+#define digitalPinToInterrupt(pin) (pin)
+void attachInterrupt(uint8_t pin, void (*isr)(), uint8_t mode);
+void detachInterrupt(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+class String {
+ public:
+  String() = default;
+  String(const char *s) : s_(s ? s : "") {}
+  String(const String &) = default;
+  String &operator=(const String &) = default;
+
+  void reserve(size_t n) { s_.reserve(n); }
+  unsigned int length() const { return static_cast<unsigned int>(s_.size()); }
+  const char *c_str() const { return s_.c_str(); }
+  char operator[](unsigned int i) const { return i < s_.size() ? s_[i] : '\0'; }
+
+  String &operator+=(char c) {
+    s_ += c;
+    return *this;
+  }
+  String &operator+=(const char *s) {
+    s_ += s;
+    return *this;
+  }
+  String &operator+=(const String &s) {
+    s_ += s.s_;
+    return *this;
+  }
+
+  bool operator==(const char *s) const { return s_ == s; }
+  bool operator==(const String &s) const { return s_ == s.s_; }
+  bool operator!=(const char *s) const { return s_ != s; }
+
+  bool startsWith(const char *prefix) const { return s_.compare(0, strlen(prefix), prefix) == 0; }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > s_.size()) from = static_cast<unsigned int>(s_.size());
+    if (to > s_.size()) to = static_cast<unsigned int>(s_.size());
+    String out;
+    if (to > from) out.s_ = s_.substr(from, to - from);
+    return out;
+  }
+  int indexOf(char c) const {
+    size_t pos = s_.find(c);
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+  }
+  long toInt() const { return strtol(s_.c_str(), nullptr, 10); }
+  void toCharArray(char *buf, unsigned int size) const {
+    if (size == 0) return;
+    strncpy(buf, s_.c_str(), size - 1);
+    buf[size - 1] = '\0';
+  }
+  void toUpperCase() {
+    for (auto &c : s_) c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+  }
+  void trim() {
+    size_t begin = 0;
+    while (begin < s_.size() && isspace(static_cast<unsigned char>(s_[begin]))) begin++;
+    size_t end = s_.size();
+    while (end > begin && isspace(static_cast<unsigned char>(s_[end - 1]))) end--;
+    s_ = s_.substr(begin, end - begin);
+  }
+
+ private:
+  std::string s_;
+};
+
+// USB CDC serial port. Host-side code feeds input with inject() and collects
+// everything the firmware printed with take_output().
+class SimSerial : public Print {
+ public:
+  void begin(unsigned long) {}
+  explicit operator bool() const { return true; }
+
+  int available() const;
+  int read();
+  // Never waits: returns what is buffered, up to `len` bytes
+  size_t readBytes(char *buf, size_t len);
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buf, size_t len) override;
+
+  void inject(const char *data);
+  void inject(const char *data, size_t len);
+  std::string take_output();
+  // Virtual time of the first byte written since the last take_output()
+  uint64_t first_output_ns() const { return tx_first_ns_; }
+  void set_echo(bool echo) { echo_ = echo; }
+
+ private:
+  std::string rx_;
+  size_t rx_pos_ = 0;
+  std::string tx_;
+  uint64_t tx_first_ns_ = 0;
+  bool echo_ = false;
+};
+
+extern SimSerial Serial;
+
+// arduino-pico's rp2040 helper; the native build has no tracked heap, so the
+// figures are fixed
+class RP2040 {
+ public:
+  static constexpr int kHeapBytes = 200 * 1024;
+  int getFreeHeap() const { return kHeapBytes; }
+  int getTotalHeap() const { return kHeapBytes; }
+};
+
+extern RP2040 rp2040;
@@ -0,0 +1,60 @@
+#include "LittleFS.h"
+
+#include <string.h>
+
+#include <map>
+
+LittleFSFS LittleFS;
+
+namespace {
+
+std::map<std::string, std::vector<uint8_t>> &files() {
+  static std::map<std::string, std::vector<uint8_t>> store;
+  return store;
+}
+
+}  // namespace
+
+size_t File::read(uint8_t *buf, size_t len) {
+  if (!data_ || writing_ || pos_ >= data_->size()) {
+    return 0;
+  }
+  size_t n = data_->size() - pos_;
+  if (n > len) {
+    n = len;
+  }
+  memcpy(buf, data_->data() + pos_, n);
+  pos_ += n;
+  return n;
+}
+
+size_t File::write(const uint8_t *buf, size_t len) {
+  if (!data_ || !writing_) {
+    return 0;
+  }
+  data_->insert(data_->end(), buf, buf + len);
+  return len;
+}
+
+bool LittleFSFS::format() {
+  files().clear();
+  return true;
+}
+
+File LittleFSFS::open(const char *path, const char *mode) {
+  bool writing = strcmp(mode, "w") == 0;
+  auto it = files().find(path);
+  if (writing) {
+    std::vector<uint8_t> &data = files()[path];
+    data.clear();
+    return File(&data, true);
+  }
+  if (it == files().end()) {
+    return File();
+  }
+  return File(&it->second, false);
+}
+
+bool LittleFSFS::exists(const char *path) const { return files().count(path) != 0; }
+
+bool LittleFSFS::remove(const char *path) { return files().erase(path) != 0; }
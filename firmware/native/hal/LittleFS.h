@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// The part of arduino-pico's LittleFS used by the firmware, kept in host
+// memory. Files live as long as the process, so they survive sim::reset()
+// the way flash survives a reboot; format() wipes them.
+class File {
+ public:
+  File() = default;
+  File(std::vector<uint8_t> *data, bool writing) : data_(data), writing_(writing) {}
+
+  explicit operator bool() const { return data_ != nullptr; }
+  size_t read(uint8_t *buf, size_t len);
+  size_t write(const uint8_t *buf, size_t len);
+  size_t size() const { return data_ ? data_->size() : 0; }
+  void close() { data_ = nullptr; }
+
+ private:
+  std::vector<uint8_t> *data_ = nullptr;
+  bool writing_ = false;
+  size_t pos_ = 0;
+};
+
+class LittleFSFS {
+ public:
+  bool begin() { return true; }
+  bool format();
+  // mode "r" or "w" (truncates); a missing file opened for reading is false
+  File open(const char *path, const char *mode);
+  bool exists(const char *path) const;
+  bool remove(const char *path);
+};
+
+extern LittleFSFS LittleFS;
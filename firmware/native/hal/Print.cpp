@@ -0,0 +1,46 @@
+#include "Print.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Arduino.h"
+
+size_t Print::write(const uint8_t *buf, size_t len) {
+  size_t n = 0;
+  for (size_t i = 0; i < len; i++) {
+    n += write(buf[i]);
+  }
+  return n;
+}
+
+size_t Print::print(const char *s) {
+  return write(reinterpret_cast<const uint8_t *>(s), strlen(s));
+}
+
+size_t Print::print(const String &s) { return print(s.c_str()); }
+
+size_t Print::print(char c) { return write(static_cast<uint8_t>(c)); }
+
+size_t Print::print(long value, int base) {
+  if (value < 0 && base == DEC) {
+    size_t n = print('-');
+    return n + print(static_cast<unsigned long>(-value), base);
+  }
+  return print(static_cast<unsigned long>(value), base);
+}
+
+size_t Print::print(unsigned long value, int base) {
+  return print(static_cast<unsigned long long>(value), base);
+}
+
+size_t Print::print(unsigned long long value, int base) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), base == HEX ? "%llX" : "%llu", value);
+  return print(buf);
+}
+
+size_t Print::print(double value, int digits) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, value);
+  return print(buf);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// Arduino Print base class for the native build: subclasses provide write()
+// and inherit the print()/println() formatting.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEC 10
+#define HEX 16
+
+class String;
+
+class Print {
+ public:
+  virtual ~Print() = default;
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t len);
+  virtual void flush() {}
+
+  size_t print(const char *s);
+  size_t print(const String &s);
+  size_t print(char c);
+  size_t print(int value, int base = DEC) { return print(static_cast<long>(value), base); }
+  size_t print(unsigned int value, int base = DEC) {
+    return print(static_cast<unsigned long>(value), base);
+  }
+  size_t print(unsigned char value, int base = DEC) {
+    return print(static_cast<unsigned long>(value), base);
+  }
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(unsigned long long value, int base = DEC);
+  size_t print(double value, int digits = 2);
+
+  size_t println() { return print("\r\n"); }
+  template <typename T>
+  size_t println(T value) {
+    size_t n = print(value);
+    return n + println();
+  }
+  template <typename T>
+  size_t println(T value, int format) {
+    size_t n = print(value, format);
+    return n + println();
+  }
+};
@@ -0,0 +1,67 @@
+#include "Wire.h"
+
+#include "sim.h"
+
+TwoWire Wire;
+
+void TwoWire::setClock(uint32_t hz) { sim::set_i2c_clock(hz); }
+
+void TwoWire::beginTransmission(uint8_t address) {
+  tx_address_ = address;
+  tx_len_ = 0;
+}
+
+size_t TwoWire::write(uint8_t value) {
+  if (tx_len_ >= kBufferSize) {
+    return 0;
+  }
+  tx_buf_[tx_len_++] = value;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t len) {
+  size_t n = 0;
+  while (n < len && write(data[n])) {
+    n++;
+  }
+  return n;
+}
+
+uint8_t TwoWire::endTransmission(bool send_stop) {
+  bool ack = sim::i2c_start(tx_address_, false);
+  if (ack) {
+    for (size_t i = 0; i < tx_len_; i++) {
+      sim::i2c_write_byte(tx_buf_[i]);
+    }
+  }
+  if (send_stop || !ack) {
+    sim::i2c_stop();
+  }
+  tx_len_ = 0;
+  return ack ? 0 : 2;
+}
+
+size_t TwoWire::requestFrom(uint8_t address, size_t len, bool send_stop) {
+  rx_len_ = 0;
+  rx_pos_ = 0;
+  if (len > kBufferSize) {
+    len = kBufferSize;
+  }
+  bool ack = sim::i2c_start(address, true);
+  if (ack) {
+    for (size_t i = 0; i < len; i++) {
+      rx_buf_[rx_len_++] = sim::i2c_read_byte();
+    }
+  }
+  if (send_stop || !ack) {
+    sim::i2c_stop();
+  }
+  return rx_len_;
+}
+
+int TwoWire::read() {
+  if (rx_pos_ >= rx_len_) {
+    return -1;
+  }
+  return rx_buf_[rx_pos_++];
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// I2C master on the simulated bus (see sim.h for the timing model).
+class TwoWire {
+ public:
+  void begin() {}
+  void setClock(uint32_t hz);
+  bool setSDA(uint8_t) { return true; }
+  bool setSCL(uint8_t) { return true; }
+
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t value);
+  size_t write(const uint8_t *data, size_t len);
+  uint8_t endTransmission(bool send_stop = true);
+  size_t requestFrom(uint8_t address, size_t len, bool send_stop = true);
+  int available() const { return static_cast<int>(rx_len_ - rx_pos_); }
+  int read();
+
+ private:
+  static constexpr size_t kBufferSize = 32;
+
+  uint8_t tx_address_ = 0;
+  uint8_t tx_buf_[kBufferSize] = {};
+  size_t tx_len_ = 0;
+  uint8_t rx_buf_[kBufferSize] = {};
+  size_t rx_len_ = 0;
+  size_t rx_pos_ = 0;
+};
+
+extern TwoWire Wire;
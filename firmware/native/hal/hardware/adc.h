@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "sim.h"
+
+// pico-sdk ADC API on the simulated converter (sim::adc_*). Register writes
+// cost one SIO access; the FIFO is not modeled beyond the DMA request, so
+// adc_fifo_setup() and adc_fifo_drain() only keep the call sites honest.
+
+struct adc_hw_t {
+  uint32_t fifo;  // DMA read address only
+};
+
+namespace sim {
+inline adc_hw_t adc_block = {0};
+}  // namespace sim
+
+#define adc_hw (&sim::adc_block)
+
+inline void adc_init() {
+  sim::adc_run(false);
+  sim::adc_set_round_robin(0);
+  sim::adc_select_input(0);
+  sim::adc_set_clkdiv(0.0f);
+}
+
+// Analog input: digital input and pulls off
+inline void adc_gpio_init(uint32_t gpio) {
+  sim::gpio_set_mode(static_cast<uint8_t>(gpio), 0x0);  // INPUT
+}
+
+inline void adc_select_input(uint32_t input) {
+  sim::advance_ns(sim::kSioAccessNs);
+  sim::adc_select_input(static_cast<uint8_t>(input));
+}
+
+inline void adc_set_round_robin(uint32_t input_mask) {
+  sim::advance_ns(sim::kSioAccessNs);
+  sim::adc_set_round_robin(static_cast<uint8_t>(input_mask));
+}
+
+inline void adc_fifo_setup(bool, bool, uint16_t, bool, bool) {
+  sim::advance_ns(sim::kSioAccessNs);
+}
+
+inline void adc_set_clkdiv(float clkdiv) {
+  sim::advance_ns(sim::kSioAccessNs);
+  sim::adc_set_clkdiv(clkdiv);
+}
+
+inline void adc_run(bool run) {
+  sim::advance_ns(sim::kSioAccessNs);
+  sim::adc_run(run);
+}
+
+inline void adc_fifo_drain() { sim::advance_ns(sim::kSioAccessNs); }
+
+inline uint16_t adc_read() { return sim::adc_convert(0); }
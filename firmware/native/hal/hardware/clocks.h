@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+// pico-sdk clock query; the simulated RP2040 runs at the arduino-pico default.
+
+enum clock_index { clk_sys = 5 };
+
+inline uint32_t clock_get_hz(clock_index) { return 133000000; }
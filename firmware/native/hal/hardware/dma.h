@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "sim.h"
+
+// pico-sdk DMA API on the simulated channels (sim::DmaChannel). Only what an
+// ADC-paced transfer into a buffer needs: the read address is taken to be
+// the ADC FIFO and every transfer is 16 bits.
+
+static constexpr uint32_t DREQ_ADC = 36;
+
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+
+struct dma_channel_config {
+  uint32_t dreq;
+  uint8_t chain_to;
+  uint8_t ring_bits;  // write ring only
+};
+
+inline int dma_claim_unused_channel(bool /*required*/) {
+  for (uint8_t i = 0; i < sim::kNumDmaChannels; i++) {
+    sim::DmaChannel &ch = sim::dma_channel(i);
+    if (!ch.claimed) {
+      ch.claimed = true;
+      return i;
+    }
+  }
+  return -1;
+}
+
+inline void dma_channel_unclaim(uint32_t channel) {
+  sim::dma_channel(static_cast<uint8_t>(channel)).claimed = false;
+}
+
+inline dma_channel_config dma_channel_get_default_config(uint32_t channel) {
+  return dma_channel_config{0x3F, static_cast<uint8_t>(channel), 0};
+}
+
+inline void channel_config_set_transfer_data_size(dma_channel_config *, dma_channel_transfer_size) {}
+inline void channel_config_set_read_increment(dma_channel_config *, bool) {}
+inline void channel_config_set_write_increment(dma_channel_config *, bool) {}
+inline void channel_config_set_dreq(dma_channel_config *c, uint32_t dreq) { c->dreq = dreq; }
+
+inline void channel_config_set_ring(dma_channel_config *c, bool write, uint32_t size_bits) {
+  c->ring_bits = write ? static_cast<uint8_t>(size_bits) : 0;
+}
+
+inline void channel_config_set_chain_to(dma_channel_config *c, uint32_t chain_to) {
+  c->chain_to = static_cast<uint8_t>(chain_to);
+}
+
+inline void dma_channel_configure(uint32_t channel, const dma_channel_config *config,
+                                  volatile void *write_addr, const volatile void * /*read_addr*/,
+                                  uint32_t transfer_count, bool trigger) {
+  sim::advance_ns(sim::kSioAccessNs);
+  sim::DmaChannel &ch = sim::dma_channel(static_cast<uint8_t>(channel));
+  ch.adc_dreq = config->dreq == DREQ_ADC;
+  ch.chain_to = config->chain_to;
+  ch.ring_bits = config->ring_bits;
+  ch.write = static_cast<uint16_t *>(const_cast<void *>(write_addr));
+  ch.trans_count = transfer_count;
+  if (trigger) {
+    sim::dma_start(static_cast<uint8_t>(channel));
+  }
+}
+
+inline void dma_channel_set_write_addr(uint32_t channel, volatile void *write_addr,
+                                       bool trigger) {
+  sim::advance_ns(sim::kSioAccessNs);
+  sim::dma_channel(static_cast<uint8_t>(channel)).write =
+      static_cast<uint16_t *>(const_cast<void *>(write_addr));
+  if (trigger) {
+    sim::dma_start(static_cast<uint8_t>(channel));
+  }
+}
+
+inline void dma_channel_start(uint32_t channel) { sim::dma_start(static_cast<uint8_t>(channel)); }
+
+inline void dma_channel_abort(uint32_t channel) { sim::dma_abort(static_cast<uint8_t>(channel)); }
+
+inline void dma_channel_set_irq1_enabled(uint32_t channel, bool enabled) {
+  sim::dma_channel(static_cast<uint8_t>(channel)).irq1_enabled = enabled;
+}
+
+inline bool dma_channel_get_irq1_status(uint32_t channel) {
+  return (sim::dma_irq1_status() >> channel) & 1u;
+}
+
+inline void dma_channel_acknowledge_irq1(uint32_t channel) {
+  sim::dma_acknowledge_irq1(static_cast<uint8_t>(channel));
+}
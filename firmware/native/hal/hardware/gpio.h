@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "sim.h"
+
+// pico-sdk SIO GPIO API on the simulated pins. Each call is one single-cycle
+// SIO register access covering every pin in the mask.
+
+inline void gpio_set_mask(uint32_t mask) { sim::gpio_write_mask(mask, mask); }
+inline void gpio_clr_mask(uint32_t mask) { sim::gpio_write_mask(mask, 0); }
+inline void gpio_put_masked(uint32_t mask, uint32_t value) { sim::gpio_write_mask(mask, value); }
+inline uint32_t gpio_get_all() { return sim::gpio_read_all(); }
+
+// Pull settings; an input with neither pull floats
+inline void gpio_pull_down(uint32_t gpio) {
+  sim::gpio_set_mode(static_cast<uint8_t>(gpio), 0x3);  // INPUT_PULLDOWN
+}
+inline void gpio_disable_pulls(uint32_t gpio) {
+  sim::gpio_set_mode(static_cast<uint8_t>(gpio), 0x0);  // INPUT
+}
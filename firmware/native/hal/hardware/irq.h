@@ -0,0 +1,19 @@
+#pragma once
+
+#include "sim.h"
+
+// pico-sdk IRQ API. Only the DMA IRQ 1 line is wired to the model; its
+// handler runs from inside sim::advance_ns() when a channel completes.
+
+static constexpr unsigned DMA_IRQ_0 = 11;
+static constexpr unsigned DMA_IRQ_1 = 12;
+
+typedef void (*irq_handler_t)();
+
+inline void irq_set_exclusive_handler(unsigned num, irq_handler_t handler) {
+  if (num == DMA_IRQ_1) {
+    sim::set_dma_irq1_handler(handler);
+  }
+}
+
+inline void irq_set_enabled(unsigned, bool) {}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "sim.h"
+
+// pico-sdk PIO API for the status pixel's state machine. Programs are not
+// executed: a word pushed to the TX FIFO goes straight to the simulated pixel
+// (sim::pixel_push) and costs one register access. The FIFO never fills.
+
+struct pio_hw_t {
+  uint8_t index;
+  uint8_t claimed;  // bit n: state machine n
+  uint8_t program_space;  // instruction slots used
+};
+typedef pio_hw_t *PIO;
+
+struct pio_program_t {
+  const uint16_t *instructions;
+  uint8_t length;
+  int8_t origin;
+};
+
+struct pio_sm_config {
+  uint32_t clkdiv;
+};
+
+enum pio_fifo_join { PIO_FIFO_JOIN_NONE = 0, PIO_FIFO_JOIN_TX = 1, PIO_FIFO_JOIN_RX = 2 };
+
+namespace sim {
+inline pio_hw_t pio_blocks[2] = {{0, 0, 0}, {1, 0, 0}};
+}  // namespace sim
+
+#define pio0 (&sim::pio_blocks[0])
+#define pio1 (&sim::pio_blocks[1])
+
+inline bool pio_can_add_program(PIO pio, const pio_program_t *program) {
+  return pio->program_space + program->length <= 32;
+}
+
+inline uint32_t pio_add_program(PIO pio, const pio_program_t *program) {
+  uint32_t offset = pio->program_space;
+  pio->program_space += program->length;
+  return offset;
+}
+
+inline int pio_claim_unused_sm(PIO pio, bool /*required*/) {
+  for (int sm = 0; sm < 4; sm++) {
+    if (!(pio->claimed & (1 << sm))) {
+      pio->claimed |= 1 << sm;
+      return sm;
+    }
+  }
+  return -1;
+}
+
+inline pio_sm_config pio_get_default_sm_config() { return pio_sm_config{1}; }
+inline void sm_config_set_wrap(pio_sm_config *, uint32_t, uint32_t) {}
+inline void sm_config_set_sideset(pio_sm_config *, uint32_t, bool, bool) {}
+inline void sm_config_set_sideset_pins(pio_sm_config *, uint32_t) {}
+inline void sm_config_set_out_shift(pio_sm_config *, bool, bool, uint32_t) {}
+inline void sm_config_set_fifo_join(pio_sm_config *, pio_fifo_join) {}
+inline void sm_config_set_clkdiv(pio_sm_config *, float) {}
+inline void pio_gpio_init(PIO, uint32_t) {}
+inline int pio_sm_set_consecutive_pindirs(PIO, uint32_t, uint32_t, uint32_t, bool) { return 0; }
+inline int pio_sm_init(PIO, uint32_t, uint32_t, const pio_sm_config *) { return 0; }
+inline void pio_sm_set_enabled(PIO, uint32_t, bool) {}
+
+inline bool pio_sm_is_tx_fifo_full(PIO, uint32_t) { return false; }
+
+inline void pio_sm_put(PIO, uint32_t, uint32_t data) {
+  sim::advance_ns(sim::kSioAccessNs);
+  sim::pixel_push(data);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "sim.h"
+
+// Cortex-M0+ event instructions. Both cores run on one host thread, so SEV has
+// nothing to wake and WFE just lets virtual time pass.
+
+inline void __sev() {}
+
+inline void __wfe() { sim::advance_ns(sim::kWfeSliceNs); }
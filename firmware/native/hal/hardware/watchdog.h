@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "sim.h"
+
+// Watchdog scratch registers and reset cause of the simulated RP2040. Only
+// the registers the firmware touches are modelled.
+struct watchdog_hw_t {
+  uint32_t scratch[8];
+};
+
+#define watchdog_hw (reinterpret_cast<watchdog_hw_t *>(sim::watchdog_scratch()))
+
+inline bool watchdog_caused_reboot() { return sim::watchdog_caused_reboot(); }
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "sim.h"
+
+// pico-sdk alarm API on the simulated RP2040 timer.
+
+typedef uint64_t absolute_time_t;
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+inline uint64_t time_us_64() { return sim::now_ns() / 1000ull; }
+
+inline alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data,
+                                  bool /*fire_if_past*/) {
+  return sim::add_alarm(sim::now_ns() + us * 1000ull, callback, user_data);
+}
+
+inline bool cancel_alarm(alarm_id_t id) { return sim::cancel_alarm(id); }
+
+inline absolute_time_t from_us_since_boot(uint64_t us) { return us; }
+
+// Sleep until `timeout` or an event. Waits at most sim::kWfeSliceNs per call;
+// returns true once the timeout has passed.
+inline bool best_effort_wfe_or_timeout(absolute_time_t timeout) {
+  uint64_t target = timeout * 1000ull;
+  uint64_t now = sim::now_ns();
+  if (now >= target) {
+    return true;
+  }
+  uint64_t slice = target - now < sim::kWfeSliceNs ? target - now : sim::kWfeSliceNs;
+  sim::advance_ns(slice);
+  return sim::now_ns() >= target;
+}
@@ -0,0 +1,687 @@
+#include "sim.h"
+
+#include <string.h>
+
+#include "Arduino.h"
+
+namespace sim {
+
+namespace {
+
+constexpr uint8_t kNumGpio = 30;
+constexpr uint8_t kMaxAlarms = 8;
+constexpr uint8_t kNumMcpRegisters = 0x16;
+constexpr uint8_t kRegIodirA = 0x00;
+constexpr uint8_t kRegIodirB = 0x01;
+constexpr uint8_t kRegGpioA = 0x12;
+constexpr uint8_t kRegGpioB = 0x13;
+constexpr uint8_t kRegOlatA = 0x14;
+constexpr uint8_t kRegOlatB = 0x15;
+
+// PCB wiring: J5 pads A-D are driven from these RP2040 pins (E-H on an 8-pad
+// mount), and the D output of U1-U4 is probed on J1-J4 (GP26-29). On a 4-pad
+// build GP6-9 are never outputs, so S5-S8 read as open.
+constexpr uint8_t kPadGpio[kNumPads] = {19, 20, 1, 0, 6, 7, 8, 9};
+constexpr uint8_t kProbeGpio[kNumChips] = {26, 27, 28, 29};
+
+struct Gpio {
+  uint8_t mode;
+  bool latch;
+  bool driven;  // held by test equipment rather than the board
+  bool level;   // externally driven level
+  uint32_t rising_edges;
+  IsrCallback isr;
+  uint8_t isr_mode;
+};
+
+struct Alarm {
+  int32_t id;  // 0 = free slot
+  uint64_t deadline_ns;
+  AlarmCallback callback;
+  void *user_data;
+};
+
+enum class BusPhase : uint8_t { IDLE, WRITE, READ };
+
+struct Mcp {
+  bool present;
+  uint8_t regs[kNumMcpRegisters];
+  uint8_t pointer;
+};
+
+struct Adc {
+  bool running;
+  uint8_t input;
+  uint8_t round_robin;  // bit n: input n
+  uint64_t period_ns;
+  uint64_t next_ns;     // when the running conversion finishes
+  uint32_t lost;
+  uint16_t noise;       // LFSR
+};
+
+struct State {
+  uint64_t now_ns;
+  uint32_t i2c_clock_hz;
+  BusStats bus;
+  BusPhase phase;
+  bool transaction_open;
+
+  Gpio gpio[kNumGpio];
+
+  Mcp mcp[kMaxBoards];
+  int8_t target;  // addressed board, -1 = none
+  bool mcp_pointer_set;
+
+  int8_t connected[kMaxBoards][kNumChips];  // -1 = off, else mux input index
+  int8_t stuck[kMaxBoards][kNumChips];      // kNoFault, or forced connected value
+  uint32_t switch_events;
+  uint64_t last_switch_ns;
+
+  Alarm alarms[kMaxAlarms];
+  int32_t next_alarm_id;
+  bool in_irq;
+  // pulse_input_at(): one rising edge, then low again, at pulse_ns
+  bool pulse_armed;
+  uint8_t pulse_pin;
+  uint64_t pulse_ns;
+
+  uint32_t pixel_word;
+  uint32_t pixel_pushes;
+  uint64_t last_pixel_ns;
+
+  Adc adc;
+  DmaChannel dma[kNumDmaChannels];
+  uint32_t dma_ints1;
+  void (*dma_irq1)();
+  bool dma_irq1_held;
+  uint32_t switch_ohms[kNumChips];
+};
+
+State s;
+
+// Outside State: watchdog_reset() keeps them
+uint32_t watchdog_scratch_regs[8];
+bool watchdog_boot;
+
+void run_isr(Gpio &g, bool rising) {
+  if (!g.isr || s.in_irq) {
+    return;
+  }
+  bool fire = g.isr_mode == CHANGE || (rising && g.isr_mode == RISING) ||
+              (!rising && g.isr_mode == FALLING);
+  if (fire) {
+    s.in_irq = true;
+    g.isr();
+    s.in_irq = false;
+  }
+}
+
+// Fire every alarm due at or before `target`, each at its own deadline.
+void run_alarms(uint64_t target) {
+  if (s.in_irq) {
+    return;
+  }
+  for (;;) {
+    Alarm *due = nullptr;
+    for (Alarm &a : s.alarms) {
+      if (a.id != 0 && a.deadline_ns <= target && (!due || a.deadline_ns < due->deadline_ns)) {
+        due = &a;
+      }
+    }
+    if (!due) {
+      return;
+    }
+    if (s.now_ns < due->deadline_ns) {
+      s.now_ns = due->deadline_ns;
+    }
+    Alarm fired = *due;
+    due->id = 0;
+    s.in_irq = true;
+    int64_t rearm_us = fired.callback(fired.id, fired.user_data);
+    s.in_irq = false;
+    if (rearm_us != 0) {
+      uint64_t base = rearm_us > 0 ? fired.deadline_ns : s.now_ns;
+      uint64_t delta = static_cast<uint64_t>(rearm_us > 0 ? rearm_us : -rearm_us) * 1000ull;
+      for (Alarm &a : s.alarms) {
+        if (a.id == 0) {
+          a = fired;
+          a.deadline_ns = base + delta;
+          break;
+        }
+      }
+    }
+  }
+}
+
+void bus_bits(uint32_t bits) {
+  uint64_t ns = static_cast<uint64_t>(bits) * 1000000000ull / s.i2c_clock_hz;
+  s.bus.busy_ns += ns;
+  advance_ns(ns);
+}
+
+ChipState decode_chip(uint16_t outputs, uint8_t index) {
+  uint8_t nibble = (outputs >> (index * 4)) & 0x0F;
+  return ChipState{(nibble & 0x01) != 0, static_cast<uint8_t>(nibble >> 1)};
+}
+
+void update_switches(uint8_t board) {
+  uint16_t outputs = mcp_outputs(board);
+  for (uint8_t i = 0; i < kNumChips; i++) {
+    ChipState c = decode_chip(outputs, i);
+    int8_t connected = c.enabled ? static_cast<int8_t>(c.address) : -1;
+    if (s.stuck[board][i] != kNoFault) {
+      connected = s.stuck[board][i];
+    }
+    if (connected != s.connected[board][i]) {
+      s.connected[board][i] = connected;
+      s.switch_events++;
+      s.last_switch_ns = s.now_ns;
+    }
+  }
+}
+
+uint8_t mcp_read(Mcp &m, uint8_t reg) {
+  if (reg == kRegGpioA) {
+    return m.regs[kRegOlatA] & static_cast<uint8_t>(~m.regs[kRegIodirA]);
+  }
+  if (reg == kRegGpioB) {
+    return m.regs[kRegOlatB] & static_cast<uint8_t>(~m.regs[kRegIodirB]);
+  }
+  return m.regs[reg];
+}
+
+void mcp_write(uint8_t board, uint8_t reg, uint8_t value) {
+  if (reg == kRegGpioA) {
+    reg = kRegOlatA;
+  } else if (reg == kRegGpioB) {
+    reg = kRegOlatB;
+  }
+  s.mcp[board].regs[reg] = value;
+  update_switches(board);
+}
+
+void mcp_advance_pointer(Mcp &m) { m.pointer = (m.pointer + 1) % kNumMcpRegisters; }
+
+void set_latch(Gpio &g, bool level) {
+  if (level && !g.latch) {
+    g.rising_edges++;
+  }
+  g.latch = level;
+}
+
+// Level seen on a pin: its own output, test equipment, or the pad a MAX328
+// connects it to
+bool pin_level(uint8_t pin) {
+  if (pin >= kNumGpio) {
+    return false;
+  }
+  const Gpio &g = s.gpio[pin];
+  if (g.mode == OUTPUT) {
+    return g.latch;
+  }
+  if (g.driven) {
+    return g.level;
+  }
+  for (uint8_t chip = 0; chip < kNumChips; chip++) {
+    if (kProbeGpio[chip] != pin) {
+      continue;
+    }
+    int8_t input = s.connected[0][chip];
+    if (input >= 0 && input < kNumPads) {
+      const Gpio &pad = s.gpio[kPadGpio[input]];
+      if (pad.mode == OUTPUT) {
+        return pad.latch;
+      }
+    }
+  }
+  return g.mode == INPUT_PULLUP;
+}
+
+// Probe voltage in mV: the level of the pad it is switched to, divided
+// down by the switch on-resistance against the pad's pulldown
+uint32_t probe_mv(uint8_t chip) {
+  const Gpio &g = s.gpio[kProbeGpio[chip]];
+  if (g.driven) {
+    return g.level ? kAdcFullScaleMv : 0;
+  }
+  int8_t input = s.connected[0][chip];
+  if (input < 0 || input >= kNumPads) {
+    return 0;
+  }
+  const Gpio &pad = s.gpio[kPadGpio[input]];
+  if (pad.mode != OUTPUT || !pad.latch) {
+    return 0;
+  }
+  if (g.mode != INPUT_PULLDOWN) {
+    return kAdcFullScaleMv;
+  }
+  uint64_t mv = static_cast<uint64_t>(kAdcFullScaleMv) * kPulldownOhms;
+  return static_cast<uint32_t>(mv / (kPulldownOhms + s.switch_ohms[chip]));
+}
+
+uint16_t convert(uint8_t input) {
+  uint32_t code = input < kNumChips ? probe_mv(input) * 4096 / kAdcFullScaleMv : 0;
+  // 16-bit Galois LFSR; the low bits give -2..+2 LSB
+  s.adc.noise = static_cast<uint16_t>((s.adc.noise >> 1) ^ (-(s.adc.noise & 1u) & 0xB400u));
+  int32_t noisy = static_cast<int32_t>(code) + static_cast<int32_t>(s.adc.noise % 5) - 2;
+  if (noisy < 0) {
+    noisy = 0;
+  }
+  return static_cast<uint16_t>(noisy > 4095 ? 4095 : noisy);
+}
+
+void dma_trigger(uint8_t channel) {
+  DmaChannel &ch = s.dma[channel];
+  ch.count = ch.trans_count;
+  ch.busy = ch.count > 0;
+}
+
+// One finished conversion: to the busy DMA channel paced by the ADC
+void adc_deliver(uint16_t code) {
+  for (uint8_t i = 0; i < kNumDmaChannels; i++) {
+    DmaChannel &ch = s.dma[i];
+    if (!ch.busy || !ch.adc_dreq) {
+      continue;
+    }
+    *ch.write++ = code;
+    if (ch.ring_bits != 0) {
+      uintptr_t mask = (uintptr_t{1} << ch.ring_bits) - 1;
+      uintptr_t at = reinterpret_cast<uintptr_t>(ch.write);
+      ch.write = reinterpret_cast<uint16_t *>(((at - sizeof(code)) & ~mask) | (at & mask));
+    }
+    if (--ch.count == 0) {
+      ch.busy = false;
+      if (ch.chain_to != i) {
+        dma_trigger(ch.chain_to);
+      }
+      if (ch.irq1_enabled) {
+        s.dma_ints1 |= 1u << i;
+        if (s.dma_irq1 && !s.in_irq && !s.dma_irq1_held) {
+          s.in_irq = true;
+          s.dma_irq1();
+          s.in_irq = false;
+        }
+      }
+    }
+    return;
+  }
+  s.adc.lost++;
+}
+
+void adc_next_input() {
+  if (s.adc.round_robin == 0) {
+    return;
+  }
+  do {
+    s.adc.input = (s.adc.input + 1) % 5;
+  } while (!(s.adc.round_robin & (1u << s.adc.input)));
+}
+
+}  // namespace
+
+void reset() {
+  memset(&s, 0, sizeof(s));
+  s.i2c_clock_hz = kDefaultI2cClockHz;
+  s.next_alarm_id = 1;
+  s.target = -1;
+  s.mcp[0].present = true;
+  for (Mcp &m : s.mcp) {
+    m.regs[kRegIodirA] = 0xFF;
+    m.regs[kRegIodirB] = 0xFF;
+  }
+  for (uint8_t i = 0; i < kNumGpio; i++) {
+    s.gpio[i].mode = INPUT;
+  }
+  for (uint8_t b = 0; b < kMaxBoards; b++) {
+    for (uint8_t i = 0; i < kNumChips; i++) {
+      s.connected[b][i] = -1;
+      s.stuck[b][i] = kNoFault;
+    }
+  }
+  for (uint8_t i = 0; i < kNumChips; i++) {
+    s.switch_ohms[i] = kSwitchOnOhms;
+  }
+  s.adc.noise = 0xACE1;
+  for (uint8_t i = 0; i < kNumDmaChannels; i++) {
+    s.dma[i].chain_to = i;
+  }
+  memset(watchdog_scratch_regs, 0, sizeof(watchdog_scratch_regs));
+  watchdog_boot = false;
+}
+
+void watchdog_reset() {
+  Mcp mcp[kMaxBoards];
+  int8_t connected[kMaxBoards][kNumChips];
+  int8_t stuck[kMaxBoards][kNumChips];
+  uint32_t switch_ohms[kNumChips];
+  uint32_t scratch[8];
+  memcpy(mcp, s.mcp, sizeof(mcp));
+  memcpy(connected, s.connected, sizeof(connected));
+  memcpy(stuck, s.stuck, sizeof(stuck));
+  memcpy(switch_ohms, s.switch_ohms, sizeof(switch_ohms));
+  memcpy(scratch, watchdog_scratch_regs, sizeof(scratch));
+  reset();
+  memcpy(s.mcp, mcp, sizeof(mcp));
+  memcpy(s.connected, connected, sizeof(connected));
+  memcpy(s.stuck, stuck, sizeof(stuck));
+  memcpy(s.switch_ohms, switch_ohms, sizeof(switch_ohms));
+  memcpy(watchdog_scratch_regs, scratch, sizeof(scratch));
+  watchdog_boot = true;
+}
+
+uint32_t *watchdog_scratch() { return watchdog_scratch_regs; }
+
+bool watchdog_caused_reboot() { return watchdog_boot; }
+
+uint64_t now_ns() { return s.now_ns; }
+
+// Alarms and ADC conversions run in deadline order
+void advance_ns(uint64_t ns) {
+  uint64_t target = s.now_ns + ns;
+  for (;;) {
+    bool pulse = s.pulse_armed && !s.in_irq && s.pulse_ns <= target;
+    bool adc = s.adc.running && !s.in_irq && s.adc.next_ns <= target;
+    if (!pulse && !adc) {
+      break;
+    }
+    pulse = pulse && (!adc || s.pulse_ns <= s.adc.next_ns);
+    uint64_t at = pulse ? s.pulse_ns : s.adc.next_ns;
+    run_alarms(at);
+    if (s.now_ns < at) {
+      s.now_ns = at;
+    }
+    if (pulse) {
+      s.pulse_armed = false;
+      drive_input(s.pulse_pin, true);
+      drive_input(s.pulse_pin, false);
+      continue;
+    }
+    uint16_t code = convert(s.adc.input);
+    adc_next_input();
+    s.adc.next_ns += s.adc.period_ns;
+    adc_deliver(code);
+  }
+  run_alarms(target);
+  if (s.now_ns < target) {
+    s.now_ns = target;
+  }
+}
+
+void set_i2c_clock(uint32_t hz) {
+  if (hz > 0) {
+    s.i2c_clock_hz = hz;
+  }
+}
+
+uint32_t i2c_clock() { return s.i2c_clock_hz; }
+
+const BusStats &bus_stats() { return s.bus; }
+
+void reset_bus_stats() { memset(&s.bus, 0, sizeof(s.bus)); }
+
+bool i2c_start(uint8_t address, bool read) {
+  if (!s.transaction_open) {
+    s.transaction_open = true;
+    if (s.bus.transactions == 0) {
+      s.bus.first_start_ns = s.now_ns;
+    }
+    s.bus.transactions++;
+    s.bus.busy_ns += kI2cOverheadNs;
+    advance_ns(kI2cOverheadNs);
+  }
+  bus_bits(1 + 9);  // (repeated) START + address byte
+  s.bus.bytes++;
+  uint8_t board = static_cast<uint8_t>(address - kMcpAddress);
+  bool acked = address >= kMcpAddress && board < kMaxBoards && s.mcp[board].present;
+  s.target = acked ? static_cast<int8_t>(board) : -1;
+  s.phase = read ? BusPhase::READ : BusPhase::WRITE;
+  if (!read) {
+    s.mcp_pointer_set = false;
+  }
+  return acked;
+}
+
+void i2c_write_byte(uint8_t value) {
+  bus_bits(9);
+  s.bus.bytes++;
+  if (s.target < 0 || s.phase != BusPhase::WRITE) {
+    return;
+  }
+  Mcp &m = s.mcp[s.target];
+  if (!s.mcp_pointer_set) {
+    m.pointer = value % kNumMcpRegisters;
+    s.mcp_pointer_set = true;
+    return;
+  }
+  mcp_write(static_cast<uint8_t>(s.target), m.pointer, value);
+  mcp_advance_pointer(m);
+}
+
+uint8_t i2c_read_byte() {
+  bus_bits(9);
+  s.bus.bytes++;
+  if (s.target < 0 || s.phase != BusPhase::READ) {
+    return 0xFF;
+  }
+  Mcp &m = s.mcp[s.target];
+  uint8_t value = mcp_read(m, m.pointer);
+  mcp_advance_pointer(m);
+  return value;
+}
+
+void i2c_stop() {
+  if (!s.transaction_open) {
+    return;
+  }
+  bus_bits(1);
+  s.transaction_open = false;
+  s.target = -1;
+  s.phase = BusPhase::IDLE;
+}
+
+void gpio_set_mode(uint8_t pin, uint8_t mode) {
+  if (pin >= kNumGpio) {
+    return;
+  }
+  s.gpio[pin].mode = mode;
+}
+
+void gpio_write(uint8_t pin, bool level) {
+  advance_ns(kGpioAccessNs);
+  if (pin >= kNumGpio) {
+    return;
+  }
+  set_latch(s.gpio[pin], level);
+}
+
+bool gpio_read(uint8_t pin) {
+  advance_ns(kGpioAccessNs);
+  return pin_level(pin);
+}
+
+void gpio_write_mask(uint32_t mask, uint32_t value) {
+  advance_ns(kSioAccessNs);
+  for (uint8_t pin = 0; pin < kNumGpio; pin++) {
+    if (mask & (1u << pin)) {
+      set_latch(s.gpio[pin], (value >> pin) & 1u);
+    }
+  }
+}
+
+uint32_t gpio_read_all() {
+  advance_ns(kSioAccessNs);
+  uint32_t value = 0;
+  for (uint8_t pin = 0; pin < kNumGpio; pin++) {
+    if (pin_level(pin)) {
+      value |= 1u << pin;
+    }
+  }
+  return value;
+}
+
+
+uint32_t rising_edges(uint8_t pin) { return pin < kNumGpio ? s.gpio[pin].rising_edges : 0; }
+
+void gpio_set_isr(uint8_t pin, IsrCallback isr, uint8_t mode) {
+  if (pin >= kNumGpio) {
+    return;
+  }
+  s.gpio[pin].isr = isr;
+  s.gpio[pin].isr_mode = mode;
+}
+
+void drive_input(uint8_t pin, bool level) {
+  if (pin >= kNumGpio) {
+    return;
+  }
+  Gpio &g = s.gpio[pin];
+  bool previous = g.driven ? g.level : (g.mode == INPUT_PULLUP);
+  g.driven = true;
+  g.level = level;
+  if (level != previous) {
+    if (level) {
+      g.rising_edges++;
+    }
+    run_isr(g, level);
+  }
+}
+
+void pulse_input_at(uint8_t pin, uint64_t at_ns) {
+  s.pulse_armed = true;
+  s.pulse_pin = pin;
+  s.pulse_ns = at_ns;
+}
+
+void pixel_push(uint32_t word) {
+  s.pixel_word = word;
+  s.pixel_pushes++;
+  s.last_pixel_ns = s.now_ns;
+}
+
+uint32_t pixel_word() { return s.pixel_word; }
+
+uint32_t pixel_pushes() { return s.pixel_pushes; }
+
+uint64_t last_pixel_ns() { return s.last_pixel_ns; }
+
+int32_t add_alarm(uint64_t deadline_ns, AlarmCallback callback, void *user_data) {
+  for (Alarm &a : s.alarms) {
+    if (a.id == 0) {
+      a.id = s.next_alarm_id++;
+      a.deadline_ns = deadline_ns;
+      a.callback = callback;
+      a.user_data = user_data;
+      return a.id;
+    }
+  }
+  return -1;
+}
+
+bool cancel_alarm(int32_t id) {
+  for (Alarm &a : s.alarms) {
+    if (id > 0 && a.id == id) {
+      a.id = 0;
+      return true;
+    }
+  }
+  return false;
+}
+
+void adc_select_input(uint8_t input) { s.adc.input = input % 5; }
+
+void adc_set_round_robin(uint8_t mask) { s.adc.round_robin = mask & 0x1F; }
+
+void adc_set_clkdiv(float div) {
+  uint64_t clocks = div < 95.0f ? 96 : static_cast<uint64_t>(1.0f + div);
+  s.adc.period_ns = clocks * 1000000000ull / kAdcClockHz;
+}
+
+void adc_run(bool run) {
+  if (run && !s.adc.running) {
+    if (s.adc.period_ns == 0) {
+      adc_set_clkdiv(0.0f);
+    }
+    s.adc.next_ns = s.now_ns + s.adc.period_ns;
+  }
+  s.adc.running = run;
+}
+
+bool adc_running() { return s.adc.running; }
+
+uint16_t adc_convert(uint8_t input) {
+  advance_ns(96ull * 1000000000ull / kAdcClockHz);
+  return convert(input);
+}
+
+uint32_t adc_lost_samples() { return s.adc.lost; }
+
+DmaChannel &dma_channel(uint8_t channel) { return s.dma[channel % kNumDmaChannels]; }
+
+void dma_start(uint8_t channel) { dma_trigger(channel % kNumDmaChannels); }
+
+void dma_abort(uint8_t channel) {
+  DmaChannel &ch = s.dma[channel % kNumDmaChannels];
+  ch.busy = false;
+  ch.count = 0;
+}
+
+void set_dma_irq1_handler(void (*handler)()) { s.dma_irq1 = handler; }
+
+uint32_t dma_irq1_status() { return s.dma_ints1; }
+
+void dma_acknowledge_irq1(uint8_t channel) { s.dma_ints1 &= ~(1u << channel); }
+
+void hold_dma_irq1(bool held) {
+  s.dma_irq1_held = held;
+  if (!held && s.dma_ints1 != 0 && s.dma_irq1 && !s.in_irq) {
+    s.in_irq = true;
+    s.dma_irq1();
+    s.in_irq = false;
+  }
+}
+
+void set_switch_resistance(uint8_t index, uint32_t ohms) {
+  if (index < kNumChips) {
+    s.switch_ohms[index] = ohms;
+  }
+}
+
+void set_mcp_present(bool present) { s.mcp[0].present = present; }
+
+void set_boards_present(uint8_t mask) {
+  for (uint8_t b = 0; b < kMaxBoards; b++) {
+    s.mcp[b].present = (mask >> b) & 1u;
+  }
+}
+
+uint8_t mcp_register(uint8_t reg) {
+  return reg < kNumMcpRegisters ? s.mcp[0].regs[reg] : 0;
+}
+
+uint16_t mcp_outputs(uint8_t board) {
+  if (board >= kMaxBoards) {
+    return 0;
+  }
+  const Mcp &m = s.mcp[board];
+  uint8_t a = m.regs[kRegOlatA] & static_cast<uint8_t>(~m.regs[kRegIodirA]);
+  uint8_t b = m.regs[kRegOlatB] & static_cast<uint8_t>(~m.regs[kRegIodirB]);
+  return static_cast<uint16_t>(a | (b << 8));
+}
+
+ChipState chip(uint8_t index) { return chip(0, index); }
+
+ChipState chip(uint8_t board, uint8_t index) { return decode_chip(mcp_outputs(board), index); }
+
+uint32_t switch_events() { return s.switch_events; }
+
+uint64_t last_switch_ns() { return s.last_switch_ns; }
+
+void set_stuck_switch(uint8_t board, uint8_t index, int8_t input) {
+  if (board >= kMaxBoards || index >= kNumChips) {
+    return;
+  }
+  s.stuck[board][index] = input;
+  update_switches(board);
+}
+
+}  // namespace sim
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <stdint.h>
+
+// Simulated OpenPauw hardware for the native (host) build.
+//
+// The firmware sources in src/ compile unchanged against the Arduino.h, Wire.h
+// and Adafruit_*.h shims in this directory. Those shims drive the model below:
+// a virtual clock, the RP2040 GPIO pins used by SwitchValidator, an I2C bus
+// with MCP23017 register files at 0x20-0x27 (only 0x20 present by default),
+// and four MAX328 muxes per expander whose EN/A0-A2 lines hang off the
+// MCP23017 outputs exactly as on the PCB. The switch validator probes only
+// see the muxes of board 0; the ADC reads the same probes as voltages.
+//
+// Nothing here is real time. delay(), I2C traffic and GPIO access advance the
+// virtual clock by modeled amounts so benchmarks are deterministic.
+
+namespace sim {
+
+// I2C timing model. Each byte is 9 bit times (8 data + ACK); START and STOP
+// add one bit time each; each transaction also pays a fixed driver overhead.
+static constexpr uint32_t kDefaultI2cClockHz = 100000;
+static constexpr uint32_t kI2cOverheadNs = 4000;
+// arduino-pico digitalWrite()/digitalRead() cost on a 133 MHz RP2040.
+static constexpr uint32_t kGpioAccessNs = 200;
+// SIO register access (gpio_get_all(), gpio_set_mask(), ...): one bus cycle
+// plus call overhead.
+static constexpr uint32_t kSioAccessNs = 15;
+// micros()/millis() cost, so code polling the clock always makes progress.
+static constexpr uint32_t kClockReadNs = 50;
+// Serial.available() polls the TinyUSB CDC FIFO; it also keeps an idle loop()
+// moving through virtual time.
+static constexpr uint32_t kSerialPollNs = 500;
+// A core sleeping in WFE hands the host thread back after at most this much
+// virtual time, so the bench can run the other core's pass.
+static constexpr uint32_t kWfeSliceNs = 1000;
+
+// RP2040 ADC: 48 MHz clock, 96 clocks per conversion at the fastest, 12 bits
+// over a 3.3 V reference.
+static constexpr uint32_t kAdcClockHz = 48000000;
+static constexpr uint32_t kAdcFullScaleMv = 3300;
+// Analog probe model: a probe pulled down on the RP2040 pad (about 50 kOhm)
+// and connected through a MAX328 switch to a pad driven high reads the
+// divider of the two. MAX328 on-resistance is 1-3.5 kOhm.
+static constexpr uint32_t kPulldownOhms = 50000;
+static constexpr uint32_t kSwitchOnOhms = 2500;
+static constexpr uint8_t kNumDmaChannels = 12;
+// ProbeAdc::reduce() per round (four samples: load, mask, add, two compares)
+// on a 133 MHz M0+, charged by the native build since host code takes no
+// virtual time.
+static constexpr uint32_t kAdcReduceNsPerRound = 400;
+
+static constexpr uint8_t kMcpAddress = 0x20;
+static constexpr uint8_t kMaxBoards = 8;
+static constexpr uint8_t kNumChips = 4;
+static constexpr uint8_t kNumPads = 8;  // MAX328 inputs S1-S8
+
+struct BusStats {
+  uint32_t transactions;
+  uint32_t bytes;  // including address bytes
+  uint64_t busy_ns;
+  uint64_t first_start_ns;  // when the first transaction began its driver call
+};
+
+struct ChipState {
+  bool enabled;
+  uint8_t address;  // 0-7 selects S1-S8
+};
+
+// Restore power-on state: clock at zero, MCP23017 registers at reset values,
+// all GPIO as inputs, counters cleared.
+void reset();
+
+// RP2040 watchdog reset: power-on state as reset(), but the watchdog scratch
+// registers keep their values and the reset cause reads as the watchdog.
+// The expanders and muxes are powered separately, so boards present, their
+// registers, the switches and stuck faults stay as they were.
+void watchdog_reset();
+// The eight watchdog scratch registers (used by the hardware/watchdog.h shim)
+uint32_t *watchdog_scratch();
+bool watchdog_caused_reboot();
+
+// Virtual clock
+uint64_t now_ns();
+void advance_ns(uint64_t ns);
+
+// I2C bus (used by the Wire shim)
+void set_i2c_clock(uint32_t hz);
+uint32_t i2c_clock();
+const BusStats &bus_stats();
+void reset_bus_stats();
+bool i2c_start(uint8_t address, bool read);
+void i2c_write_byte(uint8_t value);
+uint8_t i2c_read_byte();
+void i2c_stop();
+
+// RP2040 GPIO (used by the Arduino.h shim)
+void gpio_set_mode(uint8_t pin, uint8_t mode);
+void gpio_write(uint8_t pin, bool level);
+bool gpio_read(uint8_t pin);
+// Whole-bank SIO access (used by the hardware/gpio.h shim)
+void gpio_write_mask(uint32_t mask, uint32_t value);
+uint32_t gpio_read_all();
+// Rising edges seen on a pin, whether driven by firmware or externally
+uint32_t rising_edges(uint8_t pin);
+
+// GPIO interrupts (attachInterrupt) and inputs driven by test equipment
+typedef void (*IsrCallback)();
+void gpio_set_isr(uint8_t pin, IsrCallback isr, uint8_t mode);
+void drive_input(uint8_t pin, bool level);
+// A rising edge on `pin` at virtual time `at_ns`, then low again, taken
+// inside whatever advance_ns() crosses it (mid-task, like a real interrupt).
+// One pending at a time.
+void pulse_input_at(uint8_t pin, uint64_t at_ns);
+
+// Hardware alarms (used by the pico/time.h shim). Callbacks run from inside
+// advance_ns() at their deadline, like the RP2040 timer IRQ. A positive
+// return value re-arms the alarm that many us after its previous deadline,
+// a negative one that many us after the callback returns.
+typedef int64_t (*AlarmCallback)(int32_t id, void *user_data);
+int32_t add_alarm(uint64_t deadline_ns, AlarmCallback callback, void *user_data);
+bool cancel_alarm(int32_t id);
+
+// RP2040 ADC in free-running round-robin mode, paced by DREQ_ADC into DMA
+// (used by the hardware/adc.h and hardware/dma.h shims). While it runs, a
+// conversion finishes every (1 + clkdiv) ADC clocks of virtual time (96 at
+// least) and goes to the busy DMA channel that has DREQ_ADC; with none busy
+// it is lost, as from an overflowing FIFO. Inputs 0-3 are the J1-J4 probes.
+void adc_select_input(uint8_t input);
+void adc_set_round_robin(uint8_t mask);
+void adc_set_clkdiv(float div);
+void adc_run(bool run);
+bool adc_running();
+// One conversion of `input` now (adc_read()), 0-4095 with +-2 LSB of noise
+uint16_t adc_convert(uint8_t input);
+uint32_t adc_lost_samples();
+
+// DMA channels; only ADC-paced 16-bit transfers to memory are modeled. A
+// channel that completes sets its bit in the IRQ 1 status (if enabled there),
+// calls the IRQ 1 handler and triggers its chain_to channel, which goes on
+// from its current write address and reloaded count, as on the RP2040. With
+// ring_bits the write address wraps within its aligned 2^ring_bits bytes.
+struct DmaChannel {
+  bool claimed;
+  bool busy;
+  bool adc_dreq;
+  bool irq1_enabled;
+  uint8_t chain_to;  // itself for no chaining
+  uint8_t ring_bits; // 0 for no wrap
+  uint16_t *write;
+  uint32_t count;       // transfers left
+  uint32_t trans_count; // reloaded on each trigger
+};
+DmaChannel &dma_channel(uint8_t channel);
+void dma_start(uint8_t channel);
+void dma_abort(uint8_t channel);
+void set_dma_irq1_handler(void (*handler)());
+uint32_t dma_irq1_status();
+void dma_acknowledge_irq1(uint8_t channel);
+// Core 1 parked, as for a flash write: the IRQ 1 handler is not called, and
+// runs once for whatever is pending when released
+void hold_dma_irq1(bool held);
+
+// Fault injection for the analog probes: on-resistance of chip `index` of
+// board 0 (the only board the probes see). reset() restores kSwitchOnOhms.
+void set_switch_resistance(uint8_t index, uint32_t ohms);
+
+// WS2812 status pixel (used by the hardware/pio.h shim): the last word pushed
+// to its state machine (GRB, left-aligned) and when
+void pixel_push(uint32_t word);
+uint32_t pixel_word();
+uint32_t pixel_pushes();
+uint64_t last_pixel_ns();
+
+// MCP23017 register files; board n answers at kMcpAddress + n
+void set_mcp_present(bool present);  // board 0
+// Bit n set: board n answers. Takes effect for the next begin() probe.
+void set_boards_present(uint8_t mask);
+uint8_t mcp_register(uint8_t reg);  // board 0
+uint16_t mcp_outputs(uint8_t board = 0);
+
+// MAX328 switch model
+ChipState chip(uint8_t index);  // board 0
+ChipState chip(uint8_t board, uint8_t index);
+// Number of times any mux changed its connected input (including on/off).
+uint32_t switch_events();
+uint64_t last_switch_ns();
+
+// Fault injection: chip `index` of `board` stays connected to `input` (0-7,
+// or -1 for open) whatever its EN/A0-A2 lines say, like a damaged MAX328.
+// kNoFault releases it. reset() releases all.
+static constexpr int8_t kNoFault = -2;
+void set_stuck_switch(uint8_t board, uint8_t index, int8_t input);
+
+}  // namespace sim
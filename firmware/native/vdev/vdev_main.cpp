@@ -0,0 +1,260 @@
+// Virtual OpenPauw board for the native build.
+//
+// Runs the firmware objects of app.h against the simulated board
+// (native/hal/sim.h) and serves the USB serial port on a pseudo-terminal, so
+// the Python client, scripts/test_protocol.py and the measurement loop can
+// be exercised without a Feather. Virtual time is paced to the wall clock:
+// I2C traffic, the router's break/make/settle timing and dwell alarms take
+// as long as on the board, and the simulation sleeps when it is ahead.
+//
+// Usage: program [--link PATH] [--boards MASK] [--stuck B:C:P]... [--dmm-us N]
+//
+//   --link PATH    also make PATH a symlink to the pty (e.g. /tmp/openpauw)
+//   --boards MASK  MCP23017s present, bit n = 0x20 + n (default 0x01)
+//   --stuck B:C:P  hold chip C (0-3) of board B on pad P (A-H), or open (-)
+//   --dmm-us N     answer each settled pulse on GP24 with a trigger-in edge
+//                  on GP25 N us later, like a DMM wired for SEQ RUN ... EXT
+
+#include <Arduino.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+
+#include "app.h"
+#include "sim.h"
+
+namespace {
+
+// Most virtual time run between checks of the pty
+constexpr uint64_t kSliceNs = 1000000ull;
+// Trigger-in pulse width from the emulated DMM
+constexpr uint64_t kDmmPulseNs = 10000ull;
+
+volatile sig_atomic_t running = 1;
+
+struct Fault {
+  uint8_t board;
+  uint8_t chip;
+  int8_t input;
+};
+
+struct Options {
+  const char *link = nullptr;
+  uint8_t boards = 0x01;
+  Fault faults[sim::kMaxBoards * sim::kNumChips];
+  uint8_t fault_count = 0;
+  int64_t dmm_us = -1;  // < 0: GP25 left alone
+};
+
+void usage() {
+  fprintf(stderr,
+          "usage: program [--link PATH] [--boards MASK] [--stuck B:C:P]... [--dmm-us N]\n");
+}
+
+// B:C:P with P a pad letter or '-' for open
+bool parse_fault(const char *text, Fault &fault) {
+  unsigned board = 0;
+  unsigned chip = 0;
+  char pad = 0;
+  if (sscanf(text, "%u:%u:%c", &board, &chip, &pad) != 3 || board >= sim::kMaxBoards ||
+      chip >= sim::kNumChips) {
+    return false;
+  }
+  if (pad == '-') {
+    fault = Fault{static_cast<uint8_t>(board), static_cast<uint8_t>(chip), -1};
+    return true;
+  }
+  pad = static_cast<char>(toupper(pad));
+  if (pad < 'A' || pad >= 'A' + sim::kNumPads) {
+    return false;
+  }
+  fault = Fault{static_cast<uint8_t>(board), static_cast<uint8_t>(chip),
+                static_cast<int8_t>(pad - 'A')};
+  return true;
+}
+
+bool parse_args(int argc, char **argv, Options &opt) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--link" && has_value) {
+      opt.link = argv[++i];
+    } else if (arg == "--boards" && has_value) {
+      opt.boards = static_cast<uint8_t>(strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--stuck" && has_value &&
+               opt.fault_count < sizeof(opt.faults) / sizeof(opt.faults[0])) {
+      if (!parse_fault(argv[++i], opt.faults[opt.fault_count])) {
+        fprintf(stderr, "bad --stuck %s (want board:chip:pad, pad A-H or -)\n", argv[i]);
+        return false;
+      }
+      opt.fault_count++;
+    } else if (arg == "--dmm-us" && has_value) {
+      opt.dmm_us = strtol(argv[++i], nullptr, 0);
+    } else {
+      usage();
+      return false;
+    }
+  }
+  return true;
+}
+
+// Master side of a raw pty; the slave stays open here too so the master
+// does not see a hangup while no client has the port open.
+int open_pty(int &slave) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    return -1;
+  }
+  slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  if (slave < 0) {
+    return -1;
+  }
+  termios tio;
+  tcgetattr(slave, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+  return master;
+}
+
+void boot(const Options &opt) {
+  sim::reset();
+  sim::set_boards_present(opt.boards);
+  for (uint8_t i = 0; i < opt.fault_count; i++) {
+    const Fault &f = opt.faults[i];
+    sim::set_stuck_switch(f.board, f.chip, f.input);
+  }
+  // setup(), with setup1() run where core 0 waits for core 1
+  begin_core0();
+  add_core0_tasks();
+  driver.begin();
+  announce_when_ready();
+}
+
+// Emulated DMM on the trigger pins: every settled pulse is answered with a
+// trigger-in pulse once the "reading" is done. One reading at a time.
+class DmmLoop {
+ public:
+  explicit DmmLoop(int64_t reading_us) : reading_ns_(reading_us * 1000) {}
+
+  void poll() {
+    if (reading_ns_ < 0) {
+      return;
+    }
+    uint64_t now = sim::now_ns();
+    uint32_t edges = sim::rising_edges(SequenceEngine::kTriggerOutPin);
+    if (edges != seen_edges_ && rise_ns_ == 0 && fall_ns_ == 0) {
+      seen_edges_ = edges;
+      rise_ns_ = now + static_cast<uint64_t>(reading_ns_);
+    }
+    if (rise_ns_ != 0 && now >= rise_ns_) {
+      sim::drive_input(SequenceEngine::kTriggerInPin, true);
+      rise_ns_ = 0;
+      fall_ns_ = now + kDmmPulseNs;
+    }
+    if (fall_ns_ != 0 && now >= fall_ns_) {
+      sim::drive_input(SequenceEngine::kTriggerInPin, false);
+      fall_ns_ = 0;
+    }
+  }
+
+ private:
+  int64_t reading_ns_;
+  uint32_t seen_edges_ = 0;
+  uint64_t rise_ns_ = 0;
+  uint64_t fall_ns_ = 0;
+};
+
+// Write everything; a client that stops reading only stalls the simulation
+void write_all(int fd, const std::string &data) {
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t n = write(fd, data.data() + done, data.size() - done);
+    if (n > 0) {
+      done += static_cast<size_t>(n);
+    } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+      return;
+    } else {
+      pollfd p{fd, POLLOUT, 0};
+      ::poll(&p, 1, 10);
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!parse_args(argc, argv, opt)) {
+    return 2;
+  }
+
+  int slave = -1;
+  int master = open_pty(slave);
+  if (master < 0) {
+    perror("pty");
+    return 1;
+  }
+  const char *path = ptsname(master);
+  if (opt.link) {
+    unlink(opt.link);
+    if (symlink(path, opt.link) != 0) {
+      perror(opt.link);
+      return 1;
+    }
+  }
+  signal(SIGINT, [](int) { running = 0; });
+  signal(SIGTERM, [](int) { running = 0; });
+
+  printf("OpenPauw virtual board (firmware %s, %u pads) on %s\n", FIRMWARE_VERSION,
+         static_cast<unsigned>(kPadCount), opt.link ? opt.link : path);
+  fflush(stdout);
+
+  boot(opt);
+  DmmLoop dmm(opt.dmm_us);
+  auto start = std::chrono::steady_clock::now();
+  char buf[256];
+
+  while (running) {
+    uint64_t wall_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                 std::chrono::steady_clock::now() - start)
+                                                 .count());
+    // Catch up with the wall clock, one slice at a time so input is not
+    // held back behind a long stretch of virtual time
+    uint64_t target = wall_ns < sim::now_ns() + kSliceNs ? wall_ns : sim::now_ns() + kSliceNs;
+    while (sim::now_ns() < target) {
+      driver.update();
+      core0.run();
+      dmm.poll();
+    }
+    std::string out = Serial.take_output();
+    if (!out.empty()) {
+      write_all(master, out);
+    }
+
+    // Ahead of the wall clock: sleep until input arrives or the next ms
+    pollfd p{master, POLLIN, 0};
+    ::poll(&p, 1, sim::now_ns() > wall_ns ? 1 : 0);
+    ssize_t n = read(master, buf, sizeof(buf));
+    if (n > 0) {
+      Serial.inject(buf, static_cast<size_t>(n));
+    }
+  }
+
+  if (opt.link) {
+    unlink(opt.link);
+  }
+  close(slave);
+  close(master);
+  return 0;
+}
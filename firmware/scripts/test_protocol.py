@@ -11,12 +11,15 @@ except ImportError:  # pragma: no cover
     sys.exit(2)
 
 
+# kConfigs in src/vdp_sequences.cpp, (IP, IM, VP, VM); PRESET LIST is
+# checked against it so the two cannot drift apart again
 CFG_MAP = {
-    1: ("A", "B", "C", "D"),
-    2: ("B", "A", "D", "C"),
-    3: ("B", "C", "D", "A"),
-    4: ("C", "B", "A", "D"),
+    1: ("C", "B", "A", "D"),
+    2: ("B", "C", "D", "A"),
+    3: ("D", "A", "B", "C"),
+    4: ("A", "D", "C", "B"),
 }
+USER_CFG = 200
 
 
 def find_default_port():
@@ -69,7 +72,11 @@ def read_lines_for(ser, duration_s):
 def send_cmd(ser, cmd, timeout_s=1.0):
     ser.write((cmd + "\n").encode("ascii"))
     ser.flush()
-    return read_line(ser, timeout_s)
+    line = read_line(ser, timeout_s)
+    # CFG/SET report SETTLED asynchronously after their OK line
+    while line.startswith("SETTLED "):
+        line = read_line(ser, timeout_s)
+    return line
 
 
 def parse_state(line):
@@ -88,6 +95,29 @@ def parse_state(line):
     return cfg, data.get("IP"), data.get("IM"), data.get("VP"), data.get("VM")
 
 
+def read_presets(ser, timeout_s):
+    """PRESET LIST as {cfg: (user, ip, im, vp, vm)}; None without the OK line."""
+    ser.write(b"PRESET LIST\n")
+    ser.flush()
+    presets = {}
+    while True:
+        line = read_line(ser, timeout_s)
+        if not line:
+            return None
+        if line.startswith("OK PRESET LIST"):
+            return presets
+        if not line.startswith("PRESET "):
+            continue
+        data = dict(part.split("=", 1) for part in line.split()[1:] if "=" in part)
+        presets[int(data["CFG"])] = (
+            data.get("USER") == "1",
+            data.get("IP"),
+            data.get("IM"),
+            data.get("VP"),
+            data.get("VM"),
+        )
+
+
 def main():
     parser = argparse.ArgumentParser(description="Test OpenPauw serial protocol.")
     parser.add_argument("--port", help="Serial port (e.g. /dev/ttyACM0)")
@@ -104,17 +134,6 @@ def main():
     ser.reset_input_buffer()
 
     print(f"Port: {port}")
-    print("Waiting for READY...")
-    ready = False
-    end = time.time() + args.timeout
-    while time.time() < end:
-        line = read_line(ser, 0.1)
-        if line == "READY":
-            ready = True
-            break
-    if not ready:
-        print("WARN: READY not seen, continuing anyway.")
-
     failures = []
 
     def check(name, ok, detail=""):
@@ -127,9 +146,16 @@ def main():
             print(msg)
             failures.append(name)
 
+    # A board still booting answers once it is up
+    line = send_cmd(ser, "READY?", args.timeout)
+    check("READY?", line.startswith("READY FW=") and " MCP=1" in line, f"got '{line}'")
+
     line = send_cmd(ser, "PING", args.timeout)
     check("PING", line == "PONG", f"got '{line}'")
 
+    line = send_cmd(ser, "BOOT?", args.timeout)
+    check("BOOT?", line.startswith("BOOT RESET=") and "SELFTEST=PASS" in line, f"got '{line}'")
+
     for cfg_id, mapping in CFG_MAP.items():
         line = send_cmd(ser, f"CFG {cfg_id}", args.timeout)
         check(f"CFG {cfg_id}", line == f"OK CFG {cfg_id}", f"got '{line}'")
@@ -162,6 +188,32 @@ def main():
     line = send_cmd(ser, "CFG 9", args.timeout)
     check("CFG invalid", line == "ERR", f"got '{line}'")
 
+    presets = read_presets(ser, args.timeout)
+    if presets is None:
+        check("PRESET LIST", False, "no OK PRESET LIST")
+    else:
+        builtin = {cfg: presets.get(cfg) for cfg in CFG_MAP}
+        expected = {cfg: (False,) + mapping for cfg, mapping in CFG_MAP.items()}
+        check("PRESET LIST", builtin == expected, f"got {builtin}")
+
+    # Saved preset round trip; leaves the store as it was
+    line = send_cmd(ser, f"PRESET SAVE {USER_CFG} {' '.join(custom)}", args.timeout)
+    check("PRESET SAVE", line == f"OK PRESET SAVE {USER_CFG}", f"got '{line}'")
+    line = send_cmd(ser, f"CFG {USER_CFG}", args.timeout)
+    check("CFG saved", line == f"OK CFG {USER_CFG}", f"got '{line}'")
+    line = send_cmd(ser, f"PRESET DEL {USER_CFG}", args.timeout)
+    check("PRESET DEL", line == f"OK PRESET DEL {USER_CFG}", f"got '{line}'")
+    line = send_cmd(ser, f"CFG {USER_CFG}", args.timeout)
+    check("CFG deleted", line == "ERR", f"got '{line}'")
+
+    # Probe ADC: two records, no drive (no test harness needed)
+    line = send_cmd(ser, "ADC START 500000 1250 2", args.timeout)
+    check("ADC START", line == "OK ADC START 500000 1250", f"got '{line}'")
+    records = [l for l in read_lines_for(ser, 0.2) if l.startswith("ADC seq=")]
+    check("ADC records", len(records) == 2, f"got {records}")
+    line = send_cmd(ser, "ADC?", args.timeout)
+    check("ADC?", "ACTIVE=0" in line and "RECORDS=2" in line, f"got '{line}'")
+
     ser.write(b"HELP\n")
     ser.flush()
     help_lines = read_lines_for(ser, 0.5)
@@ -0,0 +1,6 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+cd "$(dirname "$0")/.."
+python -m platformio run -e native_vdev
+.pio/build/native_vdev/program "$@"
@@ -0,0 +1,54 @@
+#include "app.h"
+
+#include <Arduino.h>
+
+#include "boot_log.h"
+#include "status_led.h"
+
+OutputRing core1_out;
+EventLog event_log;
+Max328Router router(event_log);
+TestMode test_mode(router, core1_out);
+SwitchValidator switch_validator(router.port(), core1_out);
+SequenceEngine sequence(router, core1_out);
+ProbeAdc probe_adc(router);
+SwitchDriver driver(router, test_mode, switch_validator, sequence, probe_adc, core1_out,
+                    event_log);
+Protocol protocol(driver);
+Scheduler core0;
+
+void begin_core0() {
+  Serial.begin(115200);
+  boot_log.mark(BootLog::Phase::USB);
+
+  status_led.begin();
+  boot_log.mark(BootLog::Phase::LED);
+  protocol.begin();
+}
+
+// USB RX, core 1 output and snapshot changes all wake the core, so both
+// tasks run on every pass; serial first, so the LED never delays a reply.
+void add_core0_tasks() {
+  core0.add([](void *, uint64_t) {
+    protocol.update();
+    return kNoDeadline;
+  }, nullptr, true);
+  core0.add([](void *, uint64_t) {
+    // No LED traffic while the MAX328s break, make and settle. The end of
+    // the window changes the core 1 snapshot, which wakes core 0 again.
+    if (router.quiet()) {
+      return kNoDeadline;
+    }
+    status_led.update();
+    return status_led.next_deadline_us();
+  }, nullptr, true);
+}
+
+// The settle, the expander self-test and the preset store are finished
+// after READY (BOOT?)
+void announce_when_ready() {
+  while (!driver.ready()) {
+    delayMicroseconds(10);
+  }
+  protocol.announce_ready();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "event_log.h"
+#include "max328_router.h"
+#include "output_ring.h"
+#include "probe_adc.h"
+#include "protocol.h"
+#include "scheduler.h"
+#include "sequence_engine.h"
+#include "switch_driver.h"
+#include "switch_validator.h"
+#include "test_mode.h"
+
+// The firmware's objects and the order they start in, shared by main.cpp and
+// the native bench and virtual board so those run exactly what the board
+// runs. Core 1 owns the MCP23017 and everything that switches the MAX328s;
+// core 0 runs USB serial, command parsing and the status LED. Core 1 prints
+// through core1_out, which core 0 forwards to Serial, and records switching
+// events in event_log, which core 0 streams after EVT ON. Each core runs a
+// Scheduler and sleeps when none of its tasks is due.
+extern OutputRing core1_out;
+extern EventLog event_log;
+extern Max328Router router;
+extern TestMode test_mode;
+extern SwitchValidator switch_validator;
+extern SequenceEngine sequence;
+extern ProbeAdc probe_adc;
+extern SwitchDriver driver;
+extern Protocol protocol;
+extern Scheduler core0;
+
+// Core 0's part of setup() before READY: USB serial, the status LED and the
+// protocol, each marked in boot_log
+void begin_core0();
+// Core 0's scheduler tasks; added once, before the first boot
+void add_core0_tasks();
+// Wait until core 1 (setup1(), driver.begin()) has probed the expanders and
+// written CFG 1, then send READY
+void announce_when_ready();
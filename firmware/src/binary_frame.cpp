@@ -0,0 +1,62 @@
+#include "binary_frame.h"
+
+uint16_t crc16_ccitt(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= static_cast<uint16_t>(data[i]) << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021)
+                           : static_cast<uint16_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t code_pos = 0;
+  size_t out_pos = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < len; i++) {
+    if (in[i] != 0) {
+      out[out_pos++] = in[i];
+      code++;
+    }
+    if (in[i] == 0 || code == 0xFF) {
+      out[code_pos] = code;
+      code_pos = out_pos;
+      code = 1;
+      // A full block at the very end needs no trailing code byte
+      if (in[i] == 0 || i + 1 < len) {
+        out_pos++;
+      }
+    }
+  }
+  out[code_pos] = code;
+  return out_pos;
+}
+
+size_t cobs_decode(const uint8_t *in, size_t len, uint8_t *out, size_t out_size) {
+  size_t out_pos = 0;
+  size_t i = 0;
+  while (i < len) {
+    uint8_t code = in[i++];
+    if (code == 0 || i + code - 1 > len) {
+      return 0;
+    }
+    for (uint8_t j = 1; j < code; j++) {
+      if (in[i] == 0 || out_pos >= out_size) {
+        return 0;
+      }
+      out[out_pos++] = in[i++];
+    }
+    // A block shorter than 0xFE data bytes ends in an implicit zero, except
+    // at the very end of the packet.
+    if (code != 0xFF && i < len) {
+      if (out_pos >= out_size) {
+        return 0;
+      }
+      out[out_pos++] = 0;
+    }
+  }
+  return out_pos;
+}
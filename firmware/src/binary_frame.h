@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary mode (entered with "MODE BIN"). Every packet is COBS-encoded and
+// terminated by a 0x00 byte:
+//
+//   request:  id  op  payload...         crc16
+//   response: id  op  status  payload... crc16
+//   event:    id  op  status  payload... crc16   (op >= 0x80)
+//
+// crc16 is CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) over everything
+// before it; it and all multi-byte fields are little-endian. Request ids are
+// chosen by the host (1-255, 0 is reserved for unsolicited events) and echoed
+// in the response, so any number of requests can be sent back to back.
+// EVT_SETTLED carries the id of the CFG/SET that settled.
+
+enum class BinOp : uint8_t {
+  PING = 0x01,        // -> empty
+  VERSION = 0x02,     // -> version string
+  STATE = 0x03,       // -> BinState
+  MODE_ASCII = 0x04,  // -> empty, then back to line mode
+  EVT_STREAM = 0x05,  // on (0/1) -> empty; EVT_LOG frames follow while on
+  CFG = 0x10,         // cfg_id -> empty, later EVT_SETTLED with the same id
+  SET = 0x11,         // ip im vp vm (0-3 = A-D) -> empty, later EVT_SETTLED
+  ENMASK = 0x12,      // mask (0-15) -> empty
+
+  EVT_SETTLED = 0x80,  // cfg_id, t_us (u32); id = request that settled
+  EVT_TEXT = 0x81,     // one line of text output (SEQ STEP, TEST STEP, ...)
+  EVT_LOG = 0x82,      // dropped (u32), then up to kBinEventBatch EventLog::Event
+  EVT_ADC = 0x83,      // dropped (u32), then up to kBinAdcBatch ProbeAdc::Record
+};
+
+enum class BinStatus : uint8_t {
+  OK = 0,
+  BAD_CRC = 1,
+  BAD_FRAME = 2,
+  BAD_OP = 3,
+  BAD_ARG = 4,
+  SEQ_ACTIVE = 5,
+  NO_BOARD = 6,  // no MCP23017 at 0x20
+};
+
+// STATE response payload
+struct BinState {
+  uint8_t cfg_id;
+  uint8_t ip;  // 0-3 = A-D
+  uint8_t im;
+  uint8_t vp;
+  uint8_t vm;
+  uint8_t enable_mask;
+  uint8_t flags;  // kBinStateRouting | kBinStateSeqActive | kBinStateTestActive
+};
+static_assert(sizeof(BinState) == 7, "BinState is sent as-is");
+
+static constexpr uint8_t kBinStateRouting = 1 << 0;  // break or settle in progress
+static constexpr uint8_t kBinStateSeqActive = 1 << 1;
+static constexpr uint8_t kBinStateTestActive = 1 << 2;
+
+// Largest decoded packet, including header and CRC
+static constexpr size_t kBinMaxPacket = 136;
+// EventLog records per EVT_LOG frame (16 bytes each, after the 4-byte
+// drop counter)
+static constexpr size_t kBinEventBatch = 7;
+// ProbeAdc records per EVT_ADC frame (36 bytes each, after the drop counter)
+static constexpr size_t kBinAdcBatch = 3;
+// COBS adds one byte per 254 plus one
+static constexpr size_t kBinMaxEncoded = kBinMaxPacket + kBinMaxPacket / 254 + 1;
+
+uint16_t crc16_ccitt(const uint8_t *data, size_t len);
+// Returns the encoded length (no 0x00 delimiter); `out` needs len + len / 254 + 1
+size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out);
+// Returns the decoded length, or 0 if the input is not valid COBS or does not
+// fit in `out_size`
+size_t cobs_decode(const uint8_t *in, size_t len, uint8_t *out, size_t out_size);
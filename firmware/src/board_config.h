@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+// Compile-time board descriptor. Each MAX328 is an 8:1 mux with A0-A2 wired
+// per chip, so up to eight contacts (S1-S8) can be routed. OPENPAUW_PADS
+// selects how many are wired on this mount. Everything sized by kPadCount
+// (pad parsing, the SWTEST matrix, test-mode cycling) follows it, so the
+// 4-pad build is the same code as before.
+#ifndef OPENPAUW_PADS
+#define OPENPAUW_PADS 4
+#endif
+
+struct BoardDescriptor {
+  static constexpr uint8_t kMaxPads = 8;  // MAX328 inputs S1-S8
+
+  uint8_t pad_count;
+  // RP2040 GPIO that drives each pad during SWTEST/CFGTEST
+  uint8_t pad_pins[kMaxPads];
+};
+
+// J5 pads A-D on MOSI (GP19), MISO (GP20), RX (GP1), TX (GP0); a second
+// 4-contact sample (pads E-H) on D4, D5, D6, D9 (GP6-GP9)
+inline constexpr BoardDescriptor kBoard8 = {8, {19, 20, 1, 0, 6, 7, 8, 9}};
+
+// The first `pads` pads of kBoard8: A-D, then as many of E-H as are wired
+constexpr BoardDescriptor board_with_pads(uint8_t pads) {
+  BoardDescriptor board = {pads, {}};
+  for (uint8_t i = 0; i < pads; i++) {
+    board.pad_pins[i] = kBoard8.pad_pins[i];
+  }
+  return board;
+}
+
+// Below 4 the VdP presets have nothing to route
+#if OPENPAUW_PADS < 4 || OPENPAUW_PADS > 8
+#error "OPENPAUW_PADS must be 4 to 8"
+#endif
+inline constexpr BoardDescriptor kBoard = board_with_pads(OPENPAUW_PADS);
+
+constexpr uint8_t kPadCount = kBoard.pad_count;
+
+constexpr uint32_t board_pad_mask() {
+  uint32_t mask = 0;
+  for (uint8_t i = 0; i < kPadCount; i++) {
+    mask |= 1u << kBoard.pad_pins[i];
+  }
+  return mask;
+}
@@ -0,0 +1,77 @@
+#include "boot_log.h"
+
+#include <hardware/watchdog.h>
+#include <pico/time.h>
+
+#include "board_config.h"
+#include "protocol.h"
+
+BootLog boot_log;
+
+namespace {
+
+// Scratch 0-3 are free for the application; the bootrom uses 4-7
+constexpr uint8_t kScratchMagic = 0;
+constexpr uint8_t kScratchResult = 1;
+
+// FNV-1a of the firmware version with the pad count, so a cache written by
+// other firmware is not trusted
+constexpr uint32_t cache_magic() {
+  uint32_t hash = 2166136261u;
+  for (const char *p = FIRMWARE_VERSION; *p != '\0'; p++) {
+    hash = (hash ^ static_cast<uint8_t>(*p)) * 16777619u;
+  }
+  return (hash ^ kPadCount) * 16777619u;
+}
+
+constexpr const char *kPhaseNames[BootLog::kPhaseCount] = {
+    "USB", "LED", "MCP", "ROUTE", "READY", "PRESETS", "SETTLED", "SELFTEST",
+};
+
+}  // namespace
+
+BootLog::BootLog() { reset(); }
+
+void BootLog::reset() {
+  for (auto &at : at_us_) {
+    at.store(0, std::memory_order_relaxed);
+  }
+  self_test_.store(SelfTest::PENDING, std::memory_order_relaxed);
+  cached_.store(false, std::memory_order_relaxed);
+}
+
+void BootLog::mark(Phase phase) {
+  // At least 1, since 0 means not reached
+  uint32_t now = static_cast<uint32_t>(time_us_64());
+  at_us_[static_cast<uint8_t>(phase)].store(now ? now : 1, std::memory_order_release);
+}
+
+uint32_t BootLog::at_us(Phase phase) const {
+  return at_us_[static_cast<uint8_t>(phase)].load(std::memory_order_acquire);
+}
+
+const char *BootLog::name(Phase phase) { return kPhaseNames[static_cast<uint8_t>(phase)]; }
+
+bool BootLog::load_cache(uint8_t &boards) {
+  if (!watchdog_caused_reboot() || watchdog_hw->scratch[kScratchMagic] != cache_magic()) {
+    return false;
+  }
+  boards = static_cast<uint8_t>(watchdog_hw->scratch[kScratchResult]);
+  return true;
+}
+
+void BootLog::set_self_test(bool pass, uint8_t boards, bool cached) {
+  // Only a passing result is worth trusting on the next boot
+  watchdog_hw->scratch[kScratchMagic] = pass ? cache_magic() : 0;
+  watchdog_hw->scratch[kScratchResult] = boards;
+  cached_.store(cached, std::memory_order_relaxed);
+  self_test_.store(pass ? SelfTest::PASS : SelfTest::FAIL, std::memory_order_release);
+}
+
+BootLog::SelfTest BootLog::self_test() const {
+  return self_test_.load(std::memory_order_acquire);
+}
+
+bool BootLog::cached() const { return cached_.load(std::memory_order_acquire); }
+
+bool BootLog::watchdog_reset() const { return watchdog_caused_reboot(); }
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+// When each boot phase finished, in us since reset, for BOOT?. Each core
+// marks its own phases; one not reached yet reads 0. READY goes out once
+// the expanders are probed and CFG 1 is written. The CFG 1 settle, the
+// preset store and the expander self-test finish after it.
+//
+// The self-test result and the expanders found are cached in the watchdog
+// scratch registers. After a watchdog reset the next boot takes them from
+// there: absent addresses are not probed again and the self-test is not
+// repeated, so the host is back in a few ms.
+class BootLog {
+ public:
+  enum class Phase : uint8_t {
+    USB,       // core 0: Serial.begin()
+    LED,       // core 0: status pixel
+    MCP,       // core 1: expanders probed and configured
+    ROUTE,     // core 1: CFG 1 written
+    READY,     // core 0: READY sent
+    PRESETS,   // core 0: preset store read, saved sequence handed to core 1
+    SETTLED,   // core 1: CFG 1 settled
+    SELFTEST,  // core 1: expander readback checked, or taken from the cache
+  };
+  static constexpr uint8_t kPhaseCount = 8;
+
+  enum class SelfTest : uint8_t { PENDING, PASS, FAIL };
+
+  BootLog();
+  // Back to the power-on state; for the native bench, which boots the same
+  // objects more than once
+  void reset();
+
+  void mark(Phase phase);
+  uint32_t at_us(Phase phase) const;
+  static const char *name(Phase phase);
+
+  // Core 1, before probing: the boards the last boot found, if this boot
+  // follows a watchdog reset and that boot finished its self-test
+  bool load_cache(uint8_t &boards);
+  // Core 1: result of this boot's self-test (cached: from load_cache())
+  void set_self_test(bool pass, uint8_t boards, bool cached);
+  SelfTest self_test() const;
+  bool cached() const;
+  bool watchdog_reset() const;
+
+ private:
+  std::atomic<uint32_t> at_us_[kPhaseCount];
+  std::atomic<SelfTest> self_test_;
+  std::atomic<bool> cached_;
+};
+
+extern BootLog boot_log;
@@ -0,0 +1,166 @@
+#include "command_parser.h"
+
+#include <string.h>
+
+namespace {
+
+constexpr uint8_t kAny = ParsedLine::kMaxTokens;
+
+// Sorted by name (byte order) for find_command()
+constexpr CommandEntry kCommands[] = {
+    {"ADC", CommandId::ADC, 2, 6, false},  // ADC START rate avg n DRIVE
+    {"ADC?", CommandId::ADC_QUERY, 1, 1, false},
+    {"BEGIN", CommandId::BEGIN, 1, 1, false},
+    {"BOARD", CommandId::BOARD, 3, 7, false},  // BOARD n SET a b c d
+    {"BOARDS?", CommandId::BOARDS_QUERY, 1, 1, false},
+    {"BOOT?", CommandId::BOOT_QUERY, 1, 1, false},
+    {"CFG", CommandId::CFG, 2, 2, true},
+    {"CFGTEST", CommandId::CFGTEST, 1, 1, true},
+    {"END", CommandId::END, 1, 1, false},
+    {"ENMASK", CommandId::ENMASK, 2, 2, true},
+    {"EVT", CommandId::EVT, 2, 2, false},  // EVT ON|OFF
+    {"EVT?", CommandId::EVT_QUERY, 1, 1, false},
+    {"HELP", CommandId::HELP, 1, 1, false},
+    {"I2C", CommandId::I2C, 3, 3, false},
+    {"I2C?", CommandId::I2C_QUERY, 1, 1, false},
+    {"MODE", CommandId::MODE, 2, 2, false},
+    {"PING", CommandId::PING, 1, 1, false},
+    {"PRESET", CommandId::PRESET, 2, 8, false},  // PRESET SAVE n a b c d +
+    {"READY?", CommandId::READY_QUERY, 1, 1, false},
+    {"SEQ", CommandId::SEQ, 2, kAny, false},
+    {"SEQ?", CommandId::SEQ_QUERY, 1, 1, false},
+    {"SET", CommandId::SET, 5, 5, true},
+    {"STATE?", CommandId::STATE_QUERY, 1, 1, false},
+    {"STATS", CommandId::STATS, 2, 2, false},  // STATS RESET
+    {"STATS?", CommandId::STATS_QUERY, 1, 1, false},
+    {"SWTEST", CommandId::SWTEST, 1, 2, true},
+    {"TEST", CommandId::TEST, 1, 3, true},
+    {"TEST?", CommandId::TEST_QUERY, 1, 1, false},
+    {"VER", CommandId::VERSION, 1, 1, false},
+    {"VERSION", CommandId::VERSION, 1, 1, false},
+};
+constexpr size_t kCommandCount = sizeof(kCommands) / sizeof(kCommands[0]);
+
+constexpr int compare_names(const char *a, const char *b) {
+  while (*a != '\0' && *a == *b) {
+    a++;
+    b++;
+  }
+  return static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b);
+}
+
+constexpr bool commands_sorted() {
+  for (size_t i = 1; i < kCommandCount; i++) {
+    if (compare_names(kCommands[i - 1].name, kCommands[i].name) >= 0) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(commands_sorted(), "kCommands must be sorted by name");
+static_assert(kCommandCount == kCommandTableSize, "kCommandTableSize is out of date");
+
+bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\0';
+}
+
+}  // namespace
+
+void parse_line(char *line, ParsedLine &out) { parse_line(line, strlen(line), out); }
+
+void parse_line(char *line, size_t len, ParsedLine &out) {
+  out.command = nullptr;
+  out.argc = 0;
+  out.args_ok = false;
+
+  uint8_t tokens = 0;
+  char *p = line;
+  char *end = line + len;
+  while (p < end) {
+    while (p < end && is_space(*p)) {
+      *p++ = '\0';
+    }
+    if (p == end) {
+      break;
+    }
+    if (tokens < ParsedLine::kMaxTokens) {
+      out.argv[tokens] = p;
+    }
+    tokens++;
+    while (p < end && !is_space(*p)) {
+      if (*p >= 'a' && *p <= 'z') {
+        *p = static_cast<char>(*p - 'a' + 'A');
+      }
+      p++;
+    }
+  }
+  if (tokens == 0) {
+    return;
+  }
+
+  out.argc = tokens < ParsedLine::kMaxTokens ? tokens : ParsedLine::kMaxTokens;
+  out.command = find_command(out.argv[0]);
+  out.args_ok = out.command && tokens >= out.command->min_tokens &&
+                tokens <= out.command->max_tokens;
+}
+
+void parse_tail(const ParsedLine &line, uint8_t skip, ParsedLine &out) {
+  out.command = nullptr;
+  out.argc = 0;
+  out.args_ok = false;
+  if (line.argc <= skip) {
+    return;
+  }
+  out.argc = static_cast<uint8_t>(line.argc - skip);
+  for (uint8_t i = 0; i < out.argc; i++) {
+    out.argv[i] = line.argv[skip + i];
+  }
+  out.command = find_command(out.argv[0]);
+  out.args_ok = out.command && out.argc >= out.command->min_tokens &&
+                out.argc <= out.command->max_tokens;
+}
+
+const CommandEntry *find_command(const char *name) {
+  size_t lo = 0;
+  size_t hi = kCommandCount;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    int cmp = compare_names(name, kCommands[mid].name);
+    if (cmp == 0) {
+      return &kCommands[mid];
+    }
+    if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return nullptr;
+}
+
+const CommandEntry *command_at(size_t index) {
+  return index < kCommandCount ? &kCommands[index] : nullptr;
+}
+
+size_t command_index(const CommandEntry *entry) {
+  return static_cast<size_t>(entry - kCommands);
+}
+
+bool parse_uint32(const char *token, uint32_t &value) {
+  if (*token == '\0') {
+    return false;
+  }
+  uint32_t result = 0;
+  for (const char *p = token; *p != '\0'; p++) {
+    if (*p < '0' || *p > '9') {
+      return false;
+    }
+    uint32_t digit = static_cast<uint32_t>(*p - '0');
+    if (result > (UINT32_MAX - digit) / 10) {
+      return false;
+    }
+    result = result * 10 + digit;
+  }
+  value = result;
+  return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Line-mode command parsing without heap allocation. A received line is
+// upper-cased and split into tokens in place, and the first token is looked
+// up by binary search in a compile-time table sorted by name.
+
+enum class CommandId : uint8_t {
+  ADC,
+  ADC_QUERY,
+  BEGIN,
+  BOARD,
+  BOARDS_QUERY,
+  BOOT_QUERY,
+  CFG,
+  CFGTEST,
+  END,
+  ENMASK,
+  EVT,
+  EVT_QUERY,
+  HELP,
+  I2C,
+  I2C_QUERY,
+  MODE,
+  PING,
+  PRESET,
+  READY_QUERY,
+  SEQ,
+  SEQ_QUERY,
+  SET,
+  STATE_QUERY,
+  STATS,
+  STATS_QUERY,
+  SWTEST,
+  TEST,
+  TEST_QUERY,
+  VERSION,
+};
+
+struct CommandEntry {
+  const char *name;
+  CommandId id;
+  uint8_t min_tokens;  // including the command itself
+  uint8_t max_tokens;
+  bool routing;  // drives the switches; refused while a sequence runs
+};
+
+struct ParsedLine {
+  static constexpr uint8_t kMaxTokens = 34;  // SEQ LOAD + 32 steps
+
+  const CommandEntry *command;  // nullptr if the first token is unknown
+  uint8_t argc;                 // 0 for a blank line
+  char *argv[kMaxTokens];
+  bool args_ok;  // argc within the command's limits
+};
+
+// Parse a NUL-terminated line. The line is modified: it is upper-cased and
+// argv points into it.
+void parse_line(char *line, ParsedLine &out);
+// Parse `len` bytes; line[len] must be NUL. NUL bytes inside count as
+// separators, so a segment that has already been parsed can be parsed again
+// (batches are validated first and run later).
+void parse_line(char *line, size_t len, ParsedLine &out);
+// The command that starts at token `skip` of an already parsed line, e.g.
+// the CFG 2 in BOARD 1 CFG 2. argv points into the same buffer.
+void parse_tail(const ParsedLine &line, uint8_t skip, ParsedLine &out);
+const CommandEntry *find_command(const char *name);
+// Entries in the command table; aliases (VER, VERSION) count separately
+constexpr size_t kCommandTableSize = 30;
+const CommandEntry *command_at(size_t index);
+size_t command_index(const CommandEntry *entry);
+// Decimal digits only, no sign or whitespace, must fit in 32 bits
+bool parse_uint32(const char *token, uint32_t &value);
@@ -0,0 +1,30 @@
+#include "event_log.h"
+
+#include <hardware/sync.h>
+
+EventLog::EventLog() : next_seq_(0), dropped_(0) {}
+
+uint32_t EventLog::pack_pads(uint8_t ip, uint8_t im, uint8_t vp, uint8_t vm) {
+  return static_cast<uint32_t>(ip) | (static_cast<uint32_t>(im) << 4) |
+         (static_cast<uint32_t>(vp) << 8) | (static_cast<uint32_t>(vm) << 12);
+}
+
+void EventLog::record(Type type, uint8_t board, uint8_t a, uint8_t b, uint32_t value) {
+  uint32_t seq = next_seq_.load(std::memory_order_relaxed);
+  next_seq_.store(seq + 1, std::memory_order_relaxed);
+  Event event = {seq, static_cast<uint32_t>(micros()), value, static_cast<uint8_t>(type), board, a, b};
+  if (!ring_.push(event)) {
+    dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return;
+  }
+  // Core 0 may be asleep with nothing else to do
+  __sev();
+}
+
+bool EventLog::pop(Event &event) { return ring_.pop(event); }
+
+size_t EventLog::pending() const { return ring_.readable(); }
+
+uint32_t EventLog::dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+uint32_t EventLog::next_seq() const { return next_seq_.load(std::memory_order_relaxed); }
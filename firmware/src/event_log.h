@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "spsc_queue.h"
+
+// Timestamped record of what core 1 did to the switches, for hosts that log
+// long runs without polling STATE?. Core 1 records; core 0 streams the
+// records out after EVT ON and discards them otherwise. A record that finds
+// the ring full is dropped but still takes a sequence number, so the host
+// sees the gap.
+class EventLog {
+ public:
+  static constexpr size_t kSize = 128;
+
+  enum class Type : uint8_t {
+    ROUTE = 1,    // board, a = cfg_id, b = enable mask, value = pads
+    ENMASK = 2,   // board, a = enable mask
+    SETTLED = 3,  // board 0, a = cfg_id, value = us from first write to settled
+    SWTEST = 4,   // a = pass (full matrix), value = connections
+    CFGTEST = 5,  // a = pass, b = cfg_id
+  };
+
+  // Sent as-is in EVT_LOG frames
+  struct Event {
+    uint32_t seq;
+    uint32_t t_us;  // micros() when recorded
+    uint32_t value;
+    uint8_t type;
+    uint8_t board;
+    uint8_t a;
+    uint8_t b;
+  };
+  static_assert(sizeof(Event) == 16, "EventLog::Event is sent as-is");
+
+  // ROUTE value: I+ in bits 0-3, I- 4-7, V+ 8-11, V- 12-15 (Pad)
+  static uint32_t pack_pads(uint8_t ip, uint8_t im, uint8_t vp, uint8_t vm);
+
+  EventLog();
+
+  // Core 1
+  void record(Type type, uint8_t board, uint8_t a, uint8_t b = 0, uint32_t value = 0);
+
+  // Core 0
+  bool pop(Event &event);
+  size_t pending() const;
+  // Records lost to a full ring since boot
+  uint32_t dropped() const;
+  // Sequence number the next record will get
+  uint32_t next_seq() const;
+
+ private:
+  SpscQueue<Event, kSize> ring_;
+  std::atomic<uint32_t> next_seq_;
+  std::atomic<uint32_t> dropped_;
+};
@@ -1,41 +1,20 @@
 #include <Arduino.h>
 
-#include "max328_router.h"
-#include "protocol.h"
-#include "status_led.h"
-#include "switch_validator.h"
-#include "test_mode.h"
-#include "vdp_sequences.h"
-
-Max328Router router;
-TestMode test_mode(router);
-SwitchValidator switch_validator(router.mcp());
-Protocol protocol(router, &test_mode, &switch_validator);
+#include "app.h"
 
+// The objects, and which core runs what, are in app.h; the native bench and
+// virtual board boot through the same functions.
 void setup() {
-  Serial.begin(115200);
-
-  status_led.begin();
-
-  router.begin();
-  test_mode.begin();
-  switch_validator.begin();
-
-  RouterState default_state;
-  if (get_vdp_config(1, default_state)) {
-    router.apply_state(default_state, 1);
-  }
+  begin_core0();
+  add_core0_tasks();
+  announce_when_ready();
+}
 
-  Serial.println("READY");
+void loop() { core0.run(); }
 
-  protocol.begin();
-}
+void setup1() { driver.begin(); }
 
-void loop() {
-  protocol.update();
-  test_mode.update();
-  status_led.update();
-}
+void loop1() { driver.update(); }
 
 // Python (pyserial) example:
 //
@@ -2,118 +2,354 @@
 
 #include <ctype.h>
 
+#include "scheduler.h"
+
+namespace {
+
+// MCP23017 address bits that select `pad` on one MAX328
+constexpr uint16_t address_bits(const Max328Router::ChipPins &pins, uint8_t pad) {
+  return static_cast<uint16_t>(((pad & 0x01) ? 1 << pins.a0 : 0) |
+                               ((pad & 0x02) ? 1 << pins.a1 : 0) |
+                               ((pad & 0x04) ? 1 << pins.a2 : 0));
+}
+
+struct RouteWords {
+  uint16_t word[Max328Router::kRouteCount];  // by Max328Router::route_index()
+};
+
+constexpr RouteWords build_route_words() {
+  RouteWords words = {};
+  for (size_t i = 0; i < Max328Router::kRouteCount; i++) {
+    size_t n = i;
+    uint8_t vm = static_cast<uint8_t>(n % kPadCount);
+    n /= kPadCount;
+    uint8_t vp = static_cast<uint8_t>(n % kPadCount);
+    n /= kPadCount;
+    uint8_t im = static_cast<uint8_t>(n % kPadCount);
+    uint8_t ip = static_cast<uint8_t>(n / kPadCount);
+    words.word[i] = address_bits(Max328Router::kU1Pins, ip) |
+                    address_bits(Max328Router::kU2Pins, im) |
+                    address_bits(Max328Router::kU3Pins, vp) |
+                    address_bits(Max328Router::kU4Pins, vm);
+  }
+  return words;
+}
+
+struct EnableWords {
+  uint16_t word[Max328Router::kEnableAll + 1];  // by enable mask
+};
+
+constexpr EnableWords build_enable_words() {
+  EnableWords words = {};
+  for (uint8_t mask = 0; mask <= Max328Router::kEnableAll; mask++) {
+    words.word[mask] =
+        static_cast<uint16_t>(((mask & Max328Router::kEnableIp) ? 1 << Max328Router::kU1Pins.en : 0) |
+                              ((mask & Max328Router::kEnableIm) ? 1 << Max328Router::kU2Pins.en : 0) |
+                              ((mask & Max328Router::kEnableVp) ? 1 << Max328Router::kU3Pins.en : 0) |
+                              ((mask & Max328Router::kEnableVm) ? 1 << Max328Router::kU4Pins.en : 0));
+  }
+  return words;
+}
+
+constexpr RouteWords kRouteWords = build_route_words();
+constexpr EnableWords kEnableWords = build_enable_words();
+
+// I+ on S3, I- on S2, V+ on S1, V- on S4 (preset 1): GPA 0b0010'0100, GPB 0b0110'0000
+static_assert(kRouteWords.word[Max328Router::route_index({Pad::C, Pad::B, Pad::A, Pad::D})] ==
+                  0x6024,
+              "route table does not match the MCP23017 pin map");
+static_assert(kEnableWords.word[Max328Router::kEnableAll] == Max328Router::kEnablePins,
+              "enable table does not match the MCP23017 pin map");
+
+}  // namespace
+
 char pad_to_char(Pad pad) {
-  switch (pad) {
-    case Pad::A:
-      return 'A';
-    case Pad::B:
-      return 'B';
-    case Pad::C:
-      return 'C';
-    case Pad::D:
-      return 'D';
-    default:
-      return '?';
+  if (pad >= kPadCount) {
+    return '?';
   }
+  return static_cast<char>('A' + pad);
 }
 
 bool parse_pad_char(char c, Pad &pad) {
-  switch (toupper(static_cast<unsigned char>(c))) {
-    case 'A':
-      pad = Pad::A;
-      return true;
-    case 'B':
-      pad = Pad::B;
-      return true;
-    case 'C':
-      pad = Pad::C;
-      return true;
-    case 'D':
-      pad = Pad::D;
-      return true;
-    default:
-      return false;
+  uint8_t index = static_cast<uint8_t>(toupper(static_cast<unsigned char>(c)) - 'A');
+  if (index >= kPadCount) {
+    return false;
   }
+  pad = static_cast<Pad>(index);
+  return true;
 }
 
-Max328Router::Max328Router()
-    : state_{Pad::A, Pad::A, Pad::A, Pad::A},
-      cfg_id_(0),
-      enable_mask_(kEnableAll) {}
+Max328Router::Max328Router(EventLog &events)
+    : events_(events),
+      boards_{},
+      present_(0),
+      phase_(Phase::IDLE),
+      settle_us_(0),
+      deadline_us_(0),
+      hold_until_us_(0),
+      hold_(false),
+      settled_us_(0),
+      transition_us_(0),
+      quiet_(false) {
+  for (Board &board : boards_) {
+    // Any safe routing until a preset is applied
+    board.state = {Pad::A, Pad::B, Pad::C, Pad::D};
+    board.enable_mask = kEnableAll;
+  }
+}
 
-void Max328Router::begin() {
-  if (!mcp_.begin_I2C(kMcpAddress)) {
-    Serial.println("ERROR: MCP23017 not found at 0x20");
+void Max328Router::begin(uint8_t probe) {
+  // No board 0 is reported by READY MCP=0; routing commands then get ERR NO_BOARD
+  present_ = 0;
+  if (!ports_[0].begin(kMcpAddress)) {
     return;
   }
-
-  // Set all 16 pins as OUTPUT and LOW
-  for (uint8_t i = 0; i < 16; i++) {
-    mcp_.pinMode(i, OUTPUT);
+  present_ = 1;
+  for (uint8_t b = 1; b < kMaxBoards; b++) {
+    if ((probe & (1 << b)) && ports_[b].begin(kMcpAddress + b)) {
+      present_ |= static_cast<uint8_t>(1 << b);
+    }
+  }
+  for (uint8_t b = 0; b < kMaxBoards; b++) {
+    if (present(b)) {
+      ports_[b].write(port_value(boards_[b].state, boards_[b].enable_mask));
+    }
   }
-  mcp_.writeGPIOAB(0x0000);
+}
 
-  apply_enable_mask();
+bool Max328Router::verify() {
+  if (present_ == 0) {
+    return false;
+  }
+  for (uint8_t b = 0; b < kMaxBoards; b++) {
+    if (present(b) && !ports_[b].verify()) {
+      return false;
+    }
+  }
+  return true;
 }
 
 void Max328Router::apply_state(const RouterState &state, uint8_t cfg_id) {
-  state_ = state;
-  cfg_id_ = cfg_id;
+  boards_[0].state = state;
+  boards_[0].cfg_id = cfg_id;
+  start_transition();
+}
 
-  // Disable all chips, set addresses, then re-enable
-  uint8_t prev_mask = enable_mask_;
-  enable_mask_ = 0;
-  write_all();
-  delay(1);
-  enable_mask_ = prev_mask;
+void Max328Router::apply_state(const RouterState &state, uint8_t cfg_id, uint8_t enable_mask) {
+  boards_[0].enable_mask = enable_mask & kEnableAll;
+  apply_state(state, cfg_id);
+}
 
-  write_all();
-  delay(kSettleDelayMs);
+void Max328Router::stage(uint8_t board, const RouterState &state, uint8_t cfg_id,
+                         uint8_t enable_mask) {
+  if (board >= kMaxBoards) {
+    return;
+  }
+  boards_[board].state = state;
+  boards_[board].cfg_id = cfg_id;
+  boards_[board].enable_mask = enable_mask & kEnableAll;
 }
 
-const RouterState &Max328Router::state() const { return state_; }
+void Max328Router::commit() { start_transition(); }
+
+uint8_t Max328Router::boards() const { return present_; }
 
-uint8_t Max328Router::cfg_id() const { return cfg_id_; }
+bool Max328Router::present(uint8_t board) const {
+  return board < kMaxBoards && (present_ & (1 << board));
+}
 
-void Max328Router::set_chip(const ChipPins &pins, Pad pad) {
-  uint8_t value = static_cast<uint8_t>(pad);
-  mcp_.digitalWrite(pins.a0, (value & 0x01) ? HIGH : LOW);
-  mcp_.digitalWrite(pins.a1, (value & 0x02) ? HIGH : LOW);
-  mcp_.digitalWrite(pins.a2, (value & 0x04) ? HIGH : LOW);
+void Max328Router::update() {
+  if (phase_ == Phase::IDLE) {
+    return;
+  }
+  uint32_t now = micros();
+  if (static_cast<int32_t>(now - deadline_us_) < 0) {
+    return;
+  }
+  if (phase_ == Phase::BREAK) {
+    // Boards that did not break get their (unchanged) value: no I2C
+    for (uint8_t b = 0; b < kMaxBoards; b++) {
+      if (present(b)) {
+        ports_[b].write(boards_[b].make_value);
+      }
+    }
+    begin_settle();
+    return;
+  }
+  finish(now);
 }
 
+bool Max328Router::busy() const { return phase_ != Phase::IDLE; }
+
+uint64_t Max328Router::next_deadline_us() const {
+  return phase_ == Phase::IDLE ? kNoDeadline : deadline_from_micros(deadline_us_);
+}
+
+bool Max328Router::quiet() const { return quiet_.load(std::memory_order_acquire); }
+
+void Max328Router::wait_settled() {
+  while (phase_ != Phase::IDLE) {
+    int32_t remaining = static_cast<int32_t>(deadline_us_ - micros());
+    if (remaining > 0) {
+      delayMicroseconds(static_cast<uint32_t>(remaining));
+    }
+    update();
+  }
+}
+
+uint32_t Max328Router::settled_us() const { return settled_us_; }
+
+uint32_t Max328Router::transition_us() const { return transition_us_; }
+
+void Max328Router::start_transition() {
+  quiet_.store(true, std::memory_order_release);
+  // Legs made by a superseded transition may still be settling. An
+  // interrupted break keeps whatever hold its own transition carried.
+  if (phase_ == Phase::SETTLE) {
+    hold_ = true;
+    hold_until_us_ = deadline_us_;
+  } else if (phase_ == Phase::IDLE) {
+    hold_ = false;
+  }
+
+  // Disable only the legs that move, set addresses, then re-enable. Every
+  // board is planned first so they all share one break and one settle.
+  TransitionPlan plans[kMaxBoards] = {};
+  uint32_t settle_ms = 0;
+  bool needs_break = false;
+  for (uint8_t b = 0; b < kMaxBoards; b++) {
+    if (!present(b)) {
+      continue;
+    }
+    Board &board = boards_[b];
+    plans[b] = plan_transition(ports_[b].value(), ports_[b].known(), board.state,
+                               board.enable_mask);
+    board.make_value = plans[b].make_value;
+    if (plans[b].settle_ms > settle_ms) {
+      settle_ms = plans[b].settle_ms;
+    }
+    needs_break = needs_break || plans[b].needs_break;
+  }
+  settle_us_ = settle_ms * 1000;
+  transition_us_ = micros();
+
+  for (uint8_t b = 0; b < kMaxBoards; b++) {
+    if (!present(b)) {
+      continue;
+    }
+    if (plans[b].needs_write) {
+      const Board &board = boards_[b];
+      events_.record(EventLog::Type::ROUTE, b, board.cfg_id, board.enable_mask,
+                     EventLog::pack_pads(board.state.ip, board.state.im, board.state.vp,
+                                         board.state.vm));
+    }
+    if (needs_break) {
+      if (plans[b].needs_break) {
+        ports_[b].write(plans[b].break_value);
+      }
+    } else if (plans[b].needs_write) {
+      ports_[b].write(plans[b].make_value);
+    }
+  }
+  if (needs_break) {
+    phase_ = Phase::BREAK;
+    deadline_us_ = micros() + kBreakDelayMs * 1000;
+    return;
+  }
+  begin_settle();
+}
+
+void Max328Router::begin_settle() {
+  uint32_t now = micros();
+  deadline_us_ = now + settle_us_;
+  if (hold_ && static_cast<int32_t>(hold_until_us_ - deadline_us_) > 0) {
+    deadline_us_ = hold_until_us_;
+  }
+  hold_ = false;
+  if (deadline_us_ == now) {
+    finish(now);
+    return;
+  }
+  phase_ = Phase::SETTLE;
+}
+
+void Max328Router::finish(uint32_t now) {
+  phase_ = Phase::IDLE;
+  settled_us_ = now;
+  quiet_.store(false, std::memory_order_release);
+  events_.record(EventLog::Type::SETTLED, 0, boards_[0].cfg_id, 0, now - transition_us_);
+}
+
+const RouterState &Max328Router::state(uint8_t board) const { return boards_[board].state; }
+
+uint8_t Max328Router::cfg_id(uint8_t board) const { return boards_[board].cfg_id; }
+
 void Max328Router::set_enable_mask(uint8_t mask) {
-  enable_mask_ = mask & kEnableAll;
-  apply_enable_mask();
+  boards_[0].enable_mask = mask & kEnableAll;
+  if (phase_ != Phase::IDLE) {
+    // Fold the new mask into the pending transition
+    start_transition();
+    return;
+  }
+  quiet_.store(true, std::memory_order_release);
+  ports_[0].write(port_value(boards_[0].state, boards_[0].enable_mask), kEnablePins);
+  quiet_.store(false, std::memory_order_release);
+  events_.record(EventLog::Type::ENMASK, 0, boards_[0].enable_mask);
 }
 
-uint8_t Max328Router::enable_mask() const { return enable_mask_; }
+uint8_t Max328Router::enable_mask(uint8_t board) const { return boards_[board].enable_mask; }
 
-void Max328Router::apply_enable_mask() {
-  mcp_.digitalWrite(kU1Pins.en, (enable_mask_ & kEnableIp) ? HIGH : LOW);
-  mcp_.digitalWrite(kU2Pins.en, (enable_mask_ & kEnableIm) ? HIGH : LOW);
-  mcp_.digitalWrite(kU3Pins.en, (enable_mask_ & kEnableVp) ? HIGH : LOW);
-  mcp_.digitalWrite(kU4Pins.en, (enable_mask_ & kEnableVm) ? HIGH : LOW);
+uint16_t Max328Router::port_value(const RouterState &state, uint8_t enable_mask) {
+  return kRouteWords.word[route_index(state)] | kEnableWords.word[enable_mask & kEnableAll];
 }
 
-void Max328Router::write_all() {
-  // Build the full 16-bit port value and write in one I2C transaction
-  uint16_t port_value = 0;
+Max328Router::TransitionPlan Max328Router::plan_transition(uint16_t from_value,
+                                                           bool from_known,
+                                                           const RouterState &to_state,
+                                                           uint8_t to_mask) {
+  // Indexed like the kEnable* bits: I+, I-, V+, V-
+  static constexpr ChipPins kPins[] = {kU1Pins, kU2Pins, kU3Pins, kU4Pins};
+
+  TransitionPlan plan = {};
+  plan.make_value = port_value(to_state, to_mask);
+  plan.break_value = plan.make_value;
+  plan.needs_write = !from_known || plan.make_value != from_value;
+
+  for (uint8_t leg = 0; leg < 4; leg++) {
+    const ChipPins &pins = kPins[leg];
+    uint16_t en_bit = 1 << pins.en;
+    uint16_t addr_bits = (1 << pins.a0) | (1 << pins.a1) | (1 << pins.a2);
 
-  auto set_bits = [&](const ChipPins &pins, Pad pad, bool enabled) {
-    uint8_t value = static_cast<uint8_t>(pad);
-    if (enabled) port_value |= (1 << pins.en);
-    if (value & 0x01) port_value |= (1 << pins.a0);
-    if (value & 0x02) port_value |= (1 << pins.a1);
-    if (value & 0x04) port_value |= (1 << pins.a2);
-  };
+    bool was_on = !from_known || (from_value & en_bit);
+    bool is_on = plan.make_value & en_bit;
+    bool moved = !from_known || ((from_value ^ plan.make_value) & addr_bits);
+    if (was_on == is_on && (!is_on || !moved)) {
+      continue;  // same pad (or still off): leave this leg alone
+    }
 
-  set_bits(kU1Pins, state_.ip, enable_mask_ & kEnableIp);
-  set_bits(kU2Pins, state_.im, enable_mask_ & kEnableIm);
-  set_bits(kU3Pins, state_.vp, enable_mask_ & kEnableVp);
-  set_bits(kU4Pins, state_.vm, enable_mask_ & kEnableVm);
+    plan.changed_mask |= static_cast<uint8_t>(1 << leg);
+    if (was_on && is_on) {
+      // Connected leg moving to another pad: break it first
+      plan.break_value &= ~en_bit;
+      plan.needs_break = true;
+    }
+    if (is_on) {
+      uint32_t settle_ms = (leg < 2) ? kCurrentSettleMs : kVoltageSettleMs;
+      if (settle_ms > plan.settle_ms) {
+        plan.settle_ms = settle_ms;
+      }
+    }
+  }
 
-  mcp_.writeGPIOAB(port_value);
+  return plan;
 }
 
-Adafruit_MCP23X17 &Max328Router::mcp() { return mcp_; }
+McpPort &Max328Router::port(uint8_t board) { return ports_[board]; }
+
+uint32_t Max328Router::transactions() const {
+  uint32_t total = 0;
+  for (const McpPort &port : ports_) {
+    total += port.transactions();
+  }
+  return total;
+}
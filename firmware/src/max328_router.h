@@ -1,9 +1,15 @@
 #pragma once
 
-#include <Adafruit_MCP23X17.h>
 #include <Arduino.h>
 
-enum Pad : uint8_t { A = 0, B = 1, C = 2, D = 3 };
+#include <atomic>
+
+#include "board_config.h"
+#include "event_log.h"
+#include "mcp_port.h"
+
+// Contact on MAX328 input S(n+1). Only the first kPadCount are wired.
+enum Pad : uint8_t { A = 0, B = 1, C = 2, D = 3, E = 4, F = 5, G = 6, H = 7 };
 
 struct RouterState {
   Pad ip;
@@ -13,18 +19,30 @@ struct RouterState {
 };
 
 char pad_to_char(Pad pad);
+// Accepts A up to the last wired pad, either case
 bool parse_pad_char(char c, Pad &pad);
 
 class Max328Router {
  public:
-  static constexpr uint32_t kSettleDelayMs = 50;
+  // Settle time after a leg is connected to a new pad. The current legs wait
+  // for the source to recover from the open circuit during the break; the
+  // voltage legs only for the DMM input to recharge.
+  static constexpr uint32_t kCurrentSettleMs = 50;
+  static constexpr uint32_t kVoltageSettleMs = 20;
+  // Break interval between disabling a leg and reconnecting it elsewhere
+  static constexpr uint32_t kBreakDelayMs = 1;
   static constexpr uint8_t kEnableIp = 1 << 0;
   static constexpr uint8_t kEnableIm = 1 << 1;
   static constexpr uint8_t kEnableVp = 1 << 2;
   static constexpr uint8_t kEnableVm = 1 << 3;
   static constexpr uint8_t kEnableAll = kEnableIp | kEnableIm | kEnableVp | kEnableVm;
 
+  // Up to eight switch matrices share the I2C bus, board n at kMcpAddress + n
+  // (A0-A2 strapped on each MCP23017). Board 0 is required; the others are
+  // found by probing at begin().
   static constexpr uint8_t kMcpAddress = 0x20;
+  static constexpr uint8_t kMaxBoards = 8;
+  static constexpr uint8_t kAllBoards = 0xFF;
 
   // MCP23017 pin assignments per chip (EN, A0, A1, A2)
   // Port A: U1 (I+) and U2 (I-)
@@ -40,24 +58,118 @@ class Max328Router {
   static constexpr ChipPins kU2Pins = {4, 5, 6, 7};    // GPA4-7: I-
   static constexpr ChipPins kU3Pins = {8, 9, 10, 11};   // GPB0-3: V+
   static constexpr ChipPins kU4Pins = {12, 13, 14, 15}; // GPB4-7: V-
+  static constexpr uint16_t kEnablePins =
+      (1 << kU1Pins.en) | (1 << kU2Pins.en) | (1 << kU3Pins.en) | (1 << kU4Pins.en);
+
+  // Every RouterState has a slot in a table of port words built at compile
+  // time (kPadCount^4 entries: 256 on a 4-pad build, 4096 on 8 pads).
+  static constexpr size_t kRouteCount =
+      static_cast<size_t>(kPadCount) * kPadCount * kPadCount * kPadCount;
+  static constexpr size_t route_index(const RouterState &state) {
+    return ((static_cast<size_t>(state.ip) * kPadCount + state.im) * kPadCount + state.vp) *
+               kPadCount +
+           state.vm;
+  }
+  // False if the state shorts the current source (I+ and I- on one pad) or
+  // ties the voltage inputs together (V+ and V- on one pad). Presets are
+  // checked at compile time, SET and sequence steps when they are parsed.
+  static constexpr bool route_safe(const RouterState &state) {
+    return state.ip != state.im && state.vp != state.vm;
+  }
+
+  // Break/make sequence for going from the current port value to a new one.
+  // Only legs whose connected pad changes are broken; the others stay on.
+  struct TransitionPlan {
+    uint16_t break_value;  // port value during the break (changed legs off)
+    uint16_t make_value;   // final port value
+    uint8_t changed_mask;  // legs whose connected pad changes (kEnable* bits)
+    bool needs_write;
+    bool needs_break;
+    uint32_t settle_ms;
+  };
 
-  Max328Router();
-  void begin();
+  // Table lookup: the address word of `state` plus the enable bits of the mask
+  static uint16_t port_value(const RouterState &state, uint8_t enable_mask);
+  // from_known=false means the port contents are unknown; every leg is then
+  // treated as changed.
+  static TransitionPlan plan_transition(uint16_t from_value, bool from_known,
+                                        const RouterState &to_state, uint8_t to_mask);
+
+  // Every route write, enable-mask write and settle is recorded in `events`
+  explicit Max328Router(EventLog &events);
+  // Probe board 0 and every other board in `probe`, and configure those
+  // that answer
+  void begin(uint8_t probe = 0xFF);
+  // Read back every present board's outputs; false if one does not answer
+  // with what was written, or no board is present
+  bool verify();
+  // Starts the break/make sequence on board 0 and returns; update() finishes
+  // the break and settle intervals. A new state supersedes one that is still
+  // pending.
   void apply_state(const RouterState &state, uint8_t cfg_id);
-  const RouterState &state() const;
-  uint8_t cfg_id() const;
+  // Same, with a new enable mask folded into the one transition
+  void apply_state(const RouterState &state, uint8_t cfg_id, uint8_t enable_mask);
+  // Set the target of board `board` without switching anything. commit()
+  // then moves every board to its target in one transition: all break writes
+  // back to back, one break interval, all make writes, one settle window.
+  void stage(uint8_t board, const RouterState &state, uint8_t cfg_id, uint8_t enable_mask);
+  void commit();
+  // Bit n set if board n answered at begin()
+  uint8_t boards() const;
+  bool present(uint8_t board) const;
+  // Advance a pending transition; call from loop()
+  void update();
+  // True while a break or settle interval is still running
+  bool busy() const;
+  // time_us_64() at which update() next has work, or kNoDeadline when idle
+  uint64_t next_deadline_us() const;
+  // True from the first break/make write of a transition to the end of its
+  // settle. Safe from core 0, which holds status LED updates meanwhile.
+  bool quiet() const;
+  // Block until the pending transition has settled
+  void wait_settled();
+  // micros() timestamp at which the last transition finished settling
+  uint32_t settled_us() const;
+  // micros() timestamp of the last transition's first break/make write,
+  // taken once it is planned
+  uint32_t transition_us() const;
+  const RouterState &state(uint8_t board = 0) const;
+  uint8_t cfg_id(uint8_t board = 0) const;
+  // Board 0
   void set_enable_mask(uint8_t mask);
-  uint8_t enable_mask() const;
+  uint8_t enable_mask(uint8_t board = 0) const;
 
-  Adafruit_MCP23X17 &mcp();
+  // Board 0 is shared with SwitchValidator; its shadow always holds what
+  // the pins are driven to, so transitions after a scan are planned from the
+  // real state.
+  McpPort &port(uint8_t board = 0);
+  // I2C transactions to all boards since begin()
+  uint32_t transactions() const;
 
  private:
-  Adafruit_MCP23X17 mcp_;
-  RouterState state_;
-  uint8_t cfg_id_;
-  uint8_t enable_mask_;
-
-  void set_chip(const ChipPins &pins, Pad pad);
-  void apply_enable_mask();
-  void write_all();
+  struct Board {
+    RouterState state;
+    uint8_t cfg_id;
+    uint8_t enable_mask;
+    uint16_t make_value;  // final port value of the pending transition
+  };
+
+  EventLog &events_;
+  McpPort ports_[kMaxBoards];
+  Board boards_[kMaxBoards];
+  uint8_t present_;
+
+  enum class Phase : uint8_t { IDLE, BREAK, SETTLE };
+  Phase phase_;
+  uint32_t settle_us_;
+  uint32_t deadline_us_;
+  uint32_t hold_until_us_;  // earlier legs still settling when superseded
+  bool hold_;
+  uint32_t settled_us_;
+  uint32_t transition_us_;  // micros() at the first write of the transition
+  std::atomic<bool> quiet_;
+
+  void start_transition();
+  void begin_settle();
+  void finish(uint32_t now);
 };
@@ -0,0 +1,65 @@
+#include "mcp_port.h"
+
+#include <pico/time.h>
+
+McpPort::McpPort() : shadow_(0), known_(false), clock_hz_(kDefaultClockHz), transactions_(0) {}
+
+bool McpPort::begin(uint8_t address, uint32_t clock_hz) {
+  if (!mcp_.begin_I2C(address)) {
+    return false;
+  }
+  set_clock(clock_hz);
+  for (uint8_t i = 0; i < 16; i++) {
+    mcp_.pinMode(i, OUTPUT);
+  }
+  mcp_.writeGPIOAB(0x0000);
+  shadow_ = 0;
+  known_ = true;
+  transactions_ = 0;
+  return true;
+}
+
+bool McpPort::valid_clock(uint32_t hz) { return hz == 100000 || hz == 400000 || hz == 1000000; }
+
+bool McpPort::set_clock(uint32_t hz) {
+  if (!valid_clock(hz)) {
+    return false;
+  }
+  Wire.setClock(hz);
+  clock_hz_ = hz;
+  return true;
+}
+
+uint32_t McpPort::clock() const { return clock_hz_; }
+
+void McpPort::write(uint16_t value, uint16_t mask) {
+  uint16_t next = static_cast<uint16_t>((shadow_ & ~mask) | (value & mask));
+  uint16_t changed = known_ ? static_cast<uint16_t>(next ^ shadow_) : 0xFFFF;
+  if (changed == 0) {
+    return;
+  }
+  uint64_t start_us = time_us_64();
+  if ((changed & 0xFF00) == 0) {
+    mcp_.writeGPIOA(static_cast<uint8_t>(next & 0xFF));
+  } else if ((changed & 0x00FF) == 0) {
+    mcp_.writeGPIOB(static_cast<uint8_t>(next >> 8));
+  } else {
+    mcp_.writeGPIOAB(next);
+  }
+  transaction_time_.record(static_cast<uint32_t>(time_us_64() - start_us));
+  transactions_++;
+  shadow_ = next;
+  known_ = true;
+}
+
+uint16_t McpPort::value() const { return shadow_; }
+
+bool McpPort::verify() { return known_ && mcp_.readGPIOAB() == shadow_; }
+
+bool McpPort::known() const { return known_; }
+
+uint32_t McpPort::transactions() const { return transactions_; }
+
+const PerfHistogram &McpPort::transaction_time() const { return transaction_time_; }
+
+void McpPort::reset_transaction_time() { transaction_time_.reset(); }
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Adafruit_MCP23X17.h>
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "perf_stats.h"
+
+// MCP23017 with all 16 pins as outputs and a shadow copy of the output latch.
+// Pin changes are merged into the shadow and go out as one I2C write: an
+// 8-bit port write when only GPA or GPB changes, a GPIOAB burst when both do,
+// and nothing at all when neither does. The library's digitalWrite() would
+// cost a register read-modify-write per pin instead.
+class McpPort {
+ public:
+  // Fast mode; the MCP23017 is rated for 1.7 MHz and the RP2040 for 1 MHz
+  static constexpr uint32_t kDefaultClockHz = 400000;
+
+  McpPort();
+  // Configure every pin as an output and clear the latch
+  bool begin(uint8_t address, uint32_t clock_hz = kDefaultClockHz);
+  // 100 kHz, 400 kHz or 1 MHz
+  static bool valid_clock(uint32_t hz);
+  // False (and no change) for a clock valid_clock() rejects
+  bool set_clock(uint32_t hz);
+  uint32_t clock() const;
+
+  // Drive the pins in `mask` to the matching bits of `value`
+  void write(uint16_t value, uint16_t mask = 0xFFFF);
+  uint16_t value() const;
+  // Read the pins back; true if they match what was written
+  bool verify();
+  // False until begin() succeeds
+  bool known() const;
+  // I2C transactions issued since begin()
+  uint32_t transactions() const;
+  // Duration of each write() transaction, for STATS?
+  const PerfHistogram &transaction_time() const;
+  void reset_transaction_time();
+
+ private:
+  Adafruit_MCP23X17 mcp_;
+  uint16_t shadow_;
+  bool known_;
+  uint32_t clock_hz_;
+  uint32_t transactions_;
+  PerfHistogram transaction_time_;
+};
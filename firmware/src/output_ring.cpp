@@ -0,0 +1,74 @@
+#include "output_ring.h"
+
+#include <hardware/sync.h>
+
+OutputRing::OutputRing() : dropped_(0) {}
+
+size_t OutputRing::write(uint8_t c) {
+#ifdef OPENPAUW_NATIVE
+  // Both cores share one thread on the host; waiting would never end.
+  if (!ring_.push(c)) {
+    dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return 0;
+  }
+#else
+  // Core 0 drains every pass; a full ring only means the USB host is slow.
+  while (!ring_.push(c)) {
+    tight_loop_contents();
+  }
+#endif
+  if (c == '\n') {
+    // A whole line is ready; wake core 0 to forward it
+    __sev();
+  }
+  return 1;
+}
+
+size_t OutputRing::write(const uint8_t *buf, size_t len) {
+  size_t n = 0;
+  for (size_t i = 0; i < len; i++) {
+    n += write(buf[i]);
+  }
+  return n;
+}
+
+void OutputRing::drain(Print &out) {
+  size_t available = ring_.readable();
+  size_t end = available;
+  while (end > 0 && ring_.peek(end - 1) != '\n') {
+    end--;
+  }
+  uint8_t chunk[64];
+  while (end > 0) {
+    size_t n = end < sizeof(chunk) ? end : sizeof(chunk);
+    for (size_t i = 0; i < n; i++) {
+      chunk[i] = ring_.peek(i);
+    }
+    out.write(chunk, n);
+    ring_.discard(n);
+    end -= n;
+  }
+}
+
+bool OutputRing::read_line(char *buf, size_t size, size_t &len) {
+  size_t available = ring_.readable();
+  size_t end = 0;
+  while (end < available && ring_.peek(end) != '\n') {
+    end++;
+  }
+  if (end == available) {
+    return false;
+  }
+  len = 0;
+  for (size_t i = 0; i < end; i++) {
+    char c = static_cast<char>(ring_.peek(i));
+    if (c != '\r' && len + 1 < size) {
+      buf[len++] = c;
+    }
+  }
+  buf[len] = '\0';
+  ring_.discard(end + 1);
+  return true;
+}
+
+uint32_t OutputRing::dropped() const { return dropped_.load(std::memory_order_relaxed); }
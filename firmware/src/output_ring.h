@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "spsc_queue.h"
+
+// Print target for code running on core 1. Text is buffered in a lock-free
+// ring and copied to the USB serial port by core 0, one whole line at a time,
+// so output from the two cores never interleaves within a line.
+class OutputRing : public Print {
+ public:
+  static constexpr size_t kSize = 2048;
+
+  OutputRing();
+
+  // Core 1
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buf, size_t len) override;
+
+  // Core 0: forward every complete line to `out`
+  void drain(Print &out);
+  // Core 0: take one complete line without its line ending. Returns false if
+  // none is buffered; longer lines are cut to `size` - 1 characters.
+  bool read_line(char *buf, size_t size, size_t &len);
+  // Bytes lost because the ring was full
+  uint32_t dropped() const;
+
+ private:
+  SpscQueue<uint8_t, kSize> ring_;
+  std::atomic<uint32_t> dropped_;
+};
@@ -0,0 +1,73 @@
+#include "perf_stats.h"
+
+#include <pico/time.h>
+
+PerfHistogram::PerfHistogram() { reset(); }
+
+void PerfHistogram::record(uint32_t us) {
+  uint8_t bucket = us == 0 ? 0 : static_cast<uint8_t>(32 - __builtin_clz(us));
+  if (bucket >= kBuckets) {
+    bucket = kBuckets - 1;
+  }
+  buckets_[bucket]++;
+  count_++;
+  total_us_ += us;
+  if (us < min_us_) {
+    min_us_ = us;
+  }
+  if (us > max_us_) {
+    max_us_ = us;
+  }
+}
+
+void PerfHistogram::reset() {
+  count_ = 0;
+  total_us_ = 0;
+  min_us_ = UINT32_MAX;
+  max_us_ = 0;
+  memset(buckets_, 0, sizeof(buckets_));
+}
+
+uint32_t PerfHistogram::count() const { return count_; }
+
+void PerfHistogram::print(Print &out) const {
+  out.print(" N=");
+  out.print(count_);
+  out.print(" MIN_US=");
+  out.print(count_ ? min_us_ : 0);
+  out.print(" MEAN_US=");
+  out.print(count_ ? static_cast<uint32_t>(total_us_ / count_) : 0);
+  out.print(" MAX_US=");
+  out.print(max_us_);
+  out.print(" HIST=");
+  uint8_t last = 0;
+  for (uint8_t i = 0; i < kBuckets; i++) {
+    if (buckets_[i]) {
+      last = i;
+    }
+  }
+  for (uint8_t i = 0; i <= last; i++) {
+    if (i) {
+      out.print(',');
+    }
+    out.print(buckets_[i]);
+  }
+  out.println();
+}
+
+LoopTimer::LoopTimer() : last_us_(0) {}
+
+void LoopTimer::tick() {
+  uint64_t now = time_us_64();
+  if (last_us_ != 0) {
+    period_.record(static_cast<uint32_t>(now - last_us_));
+  }
+  last_us_ = now;
+}
+
+void LoopTimer::reset() {
+  last_us_ = 0;
+  period_.reset();
+}
+
+const PerfHistogram &LoopTimer::period() const { return period_; }
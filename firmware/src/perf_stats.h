@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Always-on timing counters. record() is a few adds and a count of leading
+// zeros, cheap enough to leave in production builds. Each histogram is
+// written by one core only; STATS? has the owning core print it.
+class PerfHistogram {
+ public:
+  // Bucket k counts samples below 2^k us (bucket 0: under 1 us); the last
+  // bucket also takes everything longer.
+  static constexpr uint8_t kBuckets = 16;
+
+  PerfHistogram();
+  void record(uint32_t us);
+  void reset();
+  uint32_t count() const;
+  // " N=<count> MIN_US=.. MEAN_US=.. MAX_US=.. HIST=<b0>,<b1>,..." up to the
+  // last non-empty bucket, and the line end
+  void print(Print &out) const;
+
+ private:
+  uint32_t count_;
+  uint64_t total_us_;
+  uint32_t min_us_;
+  uint32_t max_us_;
+  uint32_t buckets_[kBuckets];
+};
+
+// Period of a loop() body, timed from one call of tick() to the next
+class LoopTimer {
+ public:
+  LoopTimer();
+  void tick();
+  void reset();
+  const PerfHistogram &period() const;
+
+ private:
+  uint64_t last_us_;  // 0 until the first tick after a reset
+  PerfHistogram period_;
+};
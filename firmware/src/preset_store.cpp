@@ -0,0 +1,257 @@
+#include "preset_store.h"
+
+#include <LittleFS.h>
+#include <string.h>
+
+#include "vdp_sequences.h"
+
+namespace {
+
+// Both files: 4-byte magic, format version, record count, then the records.
+// LittleFS commits a file when it is closed, so a reset during a save
+// leaves the previous contents.
+constexpr const char *kPresetPath = "/presets.bin";
+constexpr const char *kSequencePath = "/sequence.bin";
+constexpr uint8_t kPresetMagic[4] = {'O', 'P', 'W', 'P'};
+constexpr uint8_t kSequenceMagic[4] = {'O', 'P', 'W', 'S'};
+constexpr uint8_t kVersion = 1;
+constexpr size_t kHeaderSize = 6;
+// id, I+, I-, V+, V-, field
+constexpr size_t kPresetRecord = 6;
+// cfg_id, I+, I-, V+, V-, field, dwell_us (little-endian)
+constexpr size_t kStepRecord = 10;
+
+bool read_header(File &file, const uint8_t (&magic)[4], uint8_t &count) {
+  uint8_t header[kHeaderSize];
+  if (file.read(header, kHeaderSize) != kHeaderSize || memcmp(header, magic, 4) != 0 ||
+      header[4] != kVersion) {
+    return false;
+  }
+  count = header[5];
+  return true;
+}
+
+bool write_header(File &file, const uint8_t (&magic)[4], uint8_t count) {
+  uint8_t header[kHeaderSize] = {magic[0], magic[1], magic[2], magic[3], kVersion, count};
+  return file.write(header, kHeaderSize) == kHeaderSize;
+}
+
+void pack_state(const RouterState &state, int8_t field, uint8_t *out) {
+  out[0] = static_cast<uint8_t>(state.ip);
+  out[1] = static_cast<uint8_t>(state.im);
+  out[2] = static_cast<uint8_t>(state.vp);
+  out[3] = static_cast<uint8_t>(state.vm);
+  out[4] = static_cast<uint8_t>(field);
+}
+
+// False for pads this build does not wire or routing the router refuses
+bool unpack_state(const uint8_t *in, RouterState &state, int8_t &field) {
+  for (uint8_t i = 0; i < 4; i++) {
+    if (in[i] >= kPadCount) {
+      return false;
+    }
+  }
+  state = {static_cast<Pad>(in[0]), static_cast<Pad>(in[1]), static_cast<Pad>(in[2]),
+           static_cast<Pad>(in[3])};
+  field = static_cast<int8_t>(in[4]);
+  return field >= -1 && field <= 1 && Max328Router::route_safe(state);
+}
+
+}  // namespace
+
+PresetStore::PresetStore() : table_{}, user_count_(0), skipped_(0), mounted_(false) {}
+
+void PresetStore::begin() {
+  mounted_ = false;
+  load_builtins();
+}
+
+bool PresetStore::mount() {
+  mounted_ = LittleFS.begin();
+  return load();
+}
+
+void PresetStore::load_builtins() {
+  for (Entry &entry : table_) {
+    entry.kind = Kind::NONE;
+  }
+  for (size_t i = 0; i < vdp_config_count(); i++) {
+    const VdpConfig &cfg = vdp_configs()[i];
+    table_[cfg.cfg_id] = {cfg.state, 0, Kind::BUILTIN};
+  }
+  for (size_t i = 0; i < hall_config_count(); i++) {
+    const HallConfig &cfg = hall_configs()[i];
+    table_[cfg.cfg_id] = {cfg.state, cfg.field, Kind::BUILTIN};
+  }
+  user_count_ = 0;
+  skipped_ = 0;
+}
+
+bool PresetStore::load() {
+  load_builtins();
+  if (!mounted_) {
+    return false;
+  }
+  File file = LittleFS.open(kPresetPath, "r");
+  if (!file) {
+    return true;  // nothing saved yet
+  }
+  uint8_t count = 0;
+  bool ok = read_header(file, kPresetMagic, count);
+  for (uint8_t i = 0; ok && i < count; i++) {
+    uint8_t record[kPresetRecord];
+    if (file.read(record, kPresetRecord) != kPresetRecord) {
+      ok = false;
+      break;
+    }
+    Entry entry = {{}, 0, Kind::USER};
+    if (record[0] < kFirstUserId || table_[record[0]].kind != Kind::NONE ||
+        !unpack_state(record + 1, entry.state, entry.field)) {
+      skipped_++;
+      continue;
+    }
+    table_[record[0]] = entry;
+    user_count_++;
+  }
+  file.close();
+  return ok;
+}
+
+bool PresetStore::get(uint8_t cfg_id, RouterState &state, int8_t &field) const {
+  const Entry &entry = table_[cfg_id];
+  if (entry.kind == Kind::NONE) {
+    return false;
+  }
+  state = entry.state;
+  field = entry.field;
+  return true;
+}
+
+bool PresetStore::get(uint8_t cfg_id, RouterState &state) const {
+  int8_t field = 0;
+  return get(cfg_id, state, field);
+}
+
+PresetStore::Result PresetStore::save(uint8_t cfg_id, const RouterState &state, int8_t field) {
+  if (cfg_id < kFirstUserId) {
+    return Result::BAD_ID;
+  }
+  // load() would drop the record anyway; refuse it before it is written
+  if (!Max328Router::route_safe(state)) {
+    return Result::UNSAFE;
+  }
+  Entry previous = table_[cfg_id];
+  table_[cfg_id] = {state, field, Kind::USER};
+  if (previous.kind == Kind::NONE) {
+    user_count_++;
+  }
+  if (!write_presets()) {
+    table_[cfg_id] = previous;
+    if (previous.kind == Kind::NONE) {
+      user_count_--;
+    }
+    return Result::FLASH;
+  }
+  return Result::OK;
+}
+
+PresetStore::Result PresetStore::remove(uint8_t cfg_id) {
+  if (cfg_id < kFirstUserId) {
+    return Result::BAD_ID;
+  }
+  Entry previous = table_[cfg_id];
+  if (previous.kind != Kind::USER) {
+    return Result::NOT_FOUND;
+  }
+  table_[cfg_id].kind = Kind::NONE;
+  user_count_--;
+  if (!write_presets()) {
+    table_[cfg_id] = previous;
+    user_count_++;
+    return Result::FLASH;
+  }
+  return Result::OK;
+}
+
+// The whole user table in one file; ids in ascending order
+bool PresetStore::write_presets() {
+  if (!mounted_) {
+    return false;
+  }
+  File file = LittleFS.open(kPresetPath, "w");
+  if (!file) {
+    return false;
+  }
+  bool ok = write_header(file, kPresetMagic, static_cast<uint8_t>(user_count_));
+  for (size_t id = kFirstUserId; ok && id < 256; id++) {
+    const Entry &entry = table_[id];
+    if (entry.kind != Kind::USER) {
+      continue;
+    }
+    uint8_t record[kPresetRecord];
+    record[0] = static_cast<uint8_t>(id);
+    pack_state(entry.state, entry.field, record + 1);
+    ok = file.write(record, kPresetRecord) == kPresetRecord;
+  }
+  file.close();
+  return ok;
+}
+
+bool PresetStore::save_sequence(const SequenceEngine::Step *steps, uint8_t count) {
+  if (!mounted_) {
+    return false;
+  }
+  if (count == 0) {
+    LittleFS.remove(kSequencePath);
+    return true;
+  }
+  File file = LittleFS.open(kSequencePath, "w");
+  if (!file) {
+    return false;
+  }
+  bool ok = write_header(file, kSequenceMagic, count);
+  for (uint8_t i = 0; ok && i < count; i++) {
+    const SequenceEngine::Step &step = steps[i];
+    uint8_t record[kStepRecord];
+    record[0] = step.cfg_id;
+    pack_state(step.state, step.field, record + 1);
+    for (uint8_t b = 0; b < 4; b++) {
+      record[6 + b] = static_cast<uint8_t>(step.dwell_us >> (8 * b));
+    }
+    ok = file.write(record, kStepRecord) == kStepRecord;
+  }
+  file.close();
+  return ok;
+}
+
+int PresetStore::load_sequence(SequenceEngine::Step *steps, uint8_t max_steps) {
+  if (!mounted_) {
+    return -1;
+  }
+  File file = LittleFS.open(kSequencePath, "r");
+  if (!file) {
+    return -1;
+  }
+  uint8_t count = 0;
+  if (!read_header(file, kSequenceMagic, count) || count > max_steps) {
+    file.close();
+    return -1;
+  }
+  // A step that does not fit this build spoils the whole sequence
+  for (uint8_t i = 0; i < count; i++) {
+    SequenceEngine::Step &step = steps[i];
+    uint8_t record[kStepRecord];
+    if (file.read(record, kStepRecord) != kStepRecord ||
+        !unpack_state(record + 1, step.state, step.field)) {
+      file.close();
+      return -1;
+    }
+    step.cfg_id = record[0];
+    step.dwell_us = 0;
+    for (uint8_t b = 0; b < 4; b++) {
+      step.dwell_us |= static_cast<uint32_t>(record[6 + b]) << (8 * b);
+    }
+  }
+  file.close();
+  return count;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "max328_router.h"
+#include "sequence_engine.h"
+
+// Routing presets by CFG id: the built-in VdP and Hall tables plus user
+// presets kept in flash (LittleFS), and the one saved sequence. Everything
+// is read into a table indexed by id at boot, so a lookup is one array
+// access however many presets are stored. Core 0 only; arduino-pico parks
+// core 1 while a flash page is erased or programmed, so the writes are
+// refused while a sequence runs.
+class PresetStore {
+ public:
+  // Ids 1-19 are reserved for built-in presets
+  static constexpr uint8_t kFirstUserId = 20;
+  static constexpr size_t kMaxUser = 256 - kFirstUserId;
+
+  enum class Kind : uint8_t { NONE, BUILTIN, USER };
+
+  struct Entry {
+    RouterState state;
+    int8_t field;  // as HallConfig::field; 0 for no field
+    Kind kind;
+  };
+
+  enum class Result : uint8_t { OK, BAD_ID, NOT_FOUND, FLASH, UNSAFE };
+
+  PresetStore();
+
+  // Built-in presets only; cheap enough to run before READY
+  void begin();
+  // Mount the file system and add the saved presets; false if the store
+  // could not be mounted (the built-ins are still there)
+  bool mount();
+  // Drop the user presets and read them from flash again
+  bool load();
+  bool mounted() const { return mounted_; }
+
+  const Entry &entry(uint8_t cfg_id) const { return table_[cfg_id]; }
+  bool get(uint8_t cfg_id, RouterState &state, int8_t &field) const;
+  bool get(uint8_t cfg_id, RouterState &state) const;
+  size_t user_count() const { return user_count_; }
+  // Records in flash that did not fit this build (pads beyond kPadCount,
+  // unsafe routing) and were left out by the last load
+  size_t skipped() const { return skipped_; }
+
+  // UNSAFE unless `state` is Max328Router::route_safe()
+  Result save(uint8_t cfg_id, const RouterState &state, int8_t field);
+  Result remove(uint8_t cfg_id);
+
+  bool save_sequence(const SequenceEngine::Step *steps, uint8_t count);
+  // Steps read back into `steps`; -1 if none is saved or it does not fit
+  int load_sequence(SequenceEngine::Step *steps, uint8_t max_steps);
+
+ private:
+  Entry table_[256];
+  size_t user_count_;
+  size_t skipped_;
+  bool mounted_;
+
+  void load_builtins();
+  bool write_presets();
+};
@@ -0,0 +1,280 @@
+#include "probe_adc.h"
+
+#include <hardware/adc.h>
+#include <hardware/dma.h>
+#include <hardware/gpio.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <pico/time.h>
+
+#include "board_config.h"
+#include "scheduler.h"
+
+#ifdef OPENPAUW_NATIVE
+#include "sim.h"
+#endif
+
+ProbeAdc *ProbeAdc::instance_ = nullptr;
+
+namespace {
+
+constexpr uint32_t kAdcClockHz = 48000000;
+constexpr uint32_t kFullScaleMv = 3300;
+constexpr uint8_t kRoundRobin = (1u << ProbeAdc::kChannels) - 1;
+
+}  // namespace
+
+uint32_t ProbeAdc::mean_mv(uint16_t mean) { return (mean * kFullScaleMv + 32768) / 65536; }
+
+uint32_t ProbeAdc::code_mv(uint16_t code) { return (code * kFullScaleMv + 2048) / 4096; }
+
+bool ProbeAdc::settings_ok(uint32_t rate_hz, uint32_t average) {
+  if (rate_hz < kMinRateHz || rate_hz > kMaxRateHz || average == 0 || average > kMaxAverage) {
+    return false;
+  }
+  return rate_hz <= static_cast<uint64_t>(kMaxRecordHz) * kChannels * average;
+}
+
+ProbeAdc::ProbeAdc(const Max328Router &router)
+    : router_(router),
+      dma_{-1, -1},
+      buffers_{},
+      buffer_rounds_(kBufferRounds),
+      filled_(0),
+      reduced_(0),
+      round_(0),
+      overruns_(0),
+      active_(false),
+      rate_hz_(0),
+      average_(0),
+      record_limit_(0),
+      drive_mask_(0),
+      start_us_(0),
+      samples_(0),
+      records_(0),
+      rounds_(0),
+      next_seq_(0),
+      dropped_(0) {
+  clear_accumulator();
+}
+
+void ProbeAdc::begin() {
+  instance_ = this;
+  active_ = false;
+  adc_init();
+  for (int &channel : dma_) {
+    channel = dma_claim_unused_channel(false);
+  }
+  irq_set_exclusive_handler(DMA_IRQ_1, dma_isr);
+  irq_set_enabled(DMA_IRQ_1, true);
+}
+
+bool ProbeAdc::start(uint32_t rate_hz, uint32_t average, uint32_t records, bool drive) {
+  if (dma_[0] < 0 || dma_[1] < 0 || !settings_ok(rate_hz, average)) {
+    return false;
+  }
+  stop();
+  rate_hz_ = rate_hz;
+  average_ = average;
+  record_limit_ = records;
+  records_ = 0;
+  samples_ = 0;
+  filled_.store(0, std::memory_order_relaxed);
+  reduced_ = 0;
+  round_ = 0;
+  clear_accumulator();
+  // A power of two, so each buffer is one DMA write ring
+  uint32_t ring_bits = 0;
+  buffer_rounds_ = 1;
+  while (buffer_rounds_ * 2 <= kBufferRounds &&
+         buffer_rounds_ * 2 <= rate_hz / (kChannels * kMinBufferHz)) {
+    buffer_rounds_ *= 2;
+  }
+  while ((1u << ring_bits) < buffer_rounds_ * sizeof(buffers_[0][0]) * kChannels) {
+    ring_bits++;
+  }
+
+  // Analog inputs, with the pulldowns back on as the load
+  for (uint8_t i = 0; i < kChannels; i++) {
+    adc_gpio_init(kFirstPin + i);
+    gpio_pull_down(kFirstPin + i);
+  }
+  drive_mask_ = 0;
+  if (drive) {
+    const RouterState &state = router_.state();
+    const Pad legs[kChannels] = {state.ip, state.im, state.vp, state.vm};
+    for (uint8_t leg = 0; leg < kChannels; leg++) {
+      if (router_.enable_mask() & (1u << leg)) {
+        drive_mask_ |= 1u << kBoard.pad_pins[static_cast<uint8_t>(legs[leg])];
+      }
+    }
+    gpio_put_masked(board_pad_mask(), drive_mask_);
+  }
+
+  adc_select_input(0);
+  adc_set_round_robin(kRoundRobin);
+  adc_fifo_setup(true, true, 1, false, false);
+  adc_set_clkdiv(static_cast<float>(kAdcClockHz) / static_cast<float>(rate_hz) - 1.0f);
+  adc_fifo_drain();
+
+  // Each channel fills its own buffer and hands over to the other. The write
+  // ring brings it back to the start of the buffer without help from the
+  // CPU, so a stalled core 1 costs overruns, never a write past the buffer.
+  for (uint8_t b = 0; b < 2; b++) {
+    dma_channel_config config = dma_channel_get_default_config(dma_[b]);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, ring_bits);
+    channel_config_set_dreq(&config, DREQ_ADC);
+    channel_config_set_chain_to(&config, dma_[1 - b]);
+    dma_channel_configure(dma_[b], &config, buffers_[b], &adc_hw->fifo,
+                          buffer_rounds_ * kChannels, false);
+    dma_channel_acknowledge_irq1(dma_[b]);
+    dma_channel_set_irq1_enabled(dma_[b], true);
+  }
+  dma_channel_start(dma_[0]);
+  start_us_ = micros();
+  adc_run(true);
+  active_ = true;
+  return true;
+}
+
+void ProbeAdc::stop() {
+  if (!active_) {
+    return;
+  }
+  adc_run(false);
+  // An abort can raise a completion interrupt of its own (RP2040-E13)
+  for (int channel : dma_) {
+    dma_channel_set_irq1_enabled(channel, false);
+    dma_channel_abort(channel);
+    dma_channel_acknowledge_irq1(channel);
+  }
+  adc_set_round_robin(0);
+  adc_fifo_drain();
+  // Digital inputs again, for SWTEST and CFGTEST
+  for (uint8_t i = 0; i < kChannels; i++) {
+    pinMode(kFirstPin + i, INPUT_PULLDOWN);
+  }
+  if (drive_mask_ != 0) {
+    gpio_clr_mask(drive_mask_);
+    drive_mask_ = 0;
+  }
+  active_ = false;
+}
+
+// A filled buffer is read while DMA fills the other. If core 1 fell more
+// than a buffer behind, the older ones are already being overwritten: they
+// are skipped (their time still counts) and reported as overruns, along
+// with the rest of one left part-reduced.
+void ProbeAdc::update() {
+  if (!active_) {
+    return;
+  }
+  uint32_t filled = filled_.load(std::memory_order_acquire);
+  if (filled == reduced_) {
+    return;
+  }
+  if (filled - reduced_ > 1) {
+    uint32_t lost = filled - reduced_ - 1;
+    overruns_ += lost;
+    samples_ += (static_cast<uint64_t>(lost) * buffer_rounds_ - round_) * kChannels;
+    reduced_ = filled - 1;
+    round_ = 0;
+  }
+  size_t end = round_ + kReduceRounds < buffer_rounds_ ? round_ + kReduceRounds : buffer_rounds_;
+  if (!reduce(buffers_[reduced_ % 2], round_, end)) {
+    return;
+  }
+  round_ = end;
+  if (round_ == buffer_rounds_) {
+    reduced_++;
+    round_ = 0;
+  }
+}
+
+uint64_t ProbeAdc::next_deadline_us() const {
+  if (active_ && filled_.load(std::memory_order_acquire) != reduced_) {
+    return time_us_64();
+  }
+  return kNoDeadline;
+}
+
+bool ProbeAdc::pop(Record &record) { return ring_.pop(record); }
+
+uint32_t ProbeAdc::dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+void ProbeAdc::dma_isr() {
+  ProbeAdc *self = instance_;
+  for (uint8_t b = 0; b < 2; b++) {
+    int channel = self->dma_[b];
+    if (channel < 0 || !dma_channel_get_irq1_status(channel)) {
+      continue;
+    }
+    dma_channel_acknowledge_irq1(channel);
+    self->filled_.store(self->filled_.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_release);
+  }
+}
+
+void ProbeAdc::clear_accumulator() {
+  rounds_ = 0;
+  for (uint8_t ch = 0; ch < kChannels; ch++) {
+    sum_[ch] = 0;
+    min_[ch] = 0x0FFF;
+    max_[ch] = 0;
+  }
+}
+
+bool ProbeAdc::reduce(const uint16_t *buffer, size_t first, size_t end) {
+#ifdef OPENPAUW_NATIVE
+  // Host arithmetic takes no virtual time; charge what the M0+ would take
+  sim::advance_ns((end - first) * sim::kAdcReduceNsPerRound);
+#endif
+  for (size_t round = first; round < end; round++) {
+    const uint16_t *codes = buffer + round * kChannels;
+    for (uint8_t ch = 0; ch < kChannels; ch++) {
+      uint16_t code = codes[ch] & 0x0FFF;
+      sum_[ch] += code;
+      if (code < min_[ch]) {
+        min_[ch] = code;
+      }
+      if (code > max_[ch]) {
+        max_[ch] = code;
+      }
+    }
+    samples_ += kChannels;
+    if (++rounds_ < average_) {
+      continue;
+    }
+    emit();
+    if (record_limit_ != 0 && records_ >= record_limit_) {
+      stop();
+      return false;
+    }
+  }
+  return true;
+}
+
+void ProbeAdc::emit() {
+  Record record;
+  record.seq = next_seq_.load(std::memory_order_relaxed);
+  next_seq_.store(record.seq + 1, std::memory_order_relaxed);
+  record.t_us = start_us_ + static_cast<uint32_t>(samples_ * 1000000ull / rate_hz_);
+  record.rounds = rounds_;
+  for (uint8_t ch = 0; ch < kChannels; ch++) {
+    record.mean[ch] = static_cast<uint16_t>((static_cast<uint64_t>(sum_[ch]) * 16 + rounds_ / 2) /
+                                            rounds_);
+    record.min[ch] = min_[ch];
+    record.max[ch] = max_[ch];
+  }
+  records_++;
+  clear_accumulator();
+  if (!ring_.push(record)) {
+    dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return;
+  }
+  // Core 0 may be asleep with nothing else to do
+  __sev();
+}
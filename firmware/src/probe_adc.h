@@ -0,0 +1,131 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "max328_router.h"
+#include "spsc_queue.h"
+
+// Analog acquisition on the J1-J4 probes (the D outputs of U1-U4 on GP26-29,
+// ADC inputs 0-3), which SwitchValidator only reads as digital inputs. The
+// ADC converts the four in round-robin, free running at up to 500 kS/s in
+// all, and two DMA channels chained to each other fill two buffers in turn,
+// each a write ring, so neither conversions nor DMA wait on the CPU. Core 1 reduces each full buffer while
+// the other fills, kReduceRounds at a time so that a trigger-in edge of an
+// EXT sequence never waits behind a whole buffer: every `average` rounds
+// (one conversion of each probe) become one Record with the mean, minimum
+// and maximum of each probe. As
+// with EventLog, records reach core 0 through a ring and are streamed from
+// there, as ADC lines or EVT_ADC frames.
+//
+// The pulldowns stay on while sampling. A pad driven high through a switch
+// therefore reads 3.3 V x Rpd / (Rpd + Ron), and a switch with a raised
+// on-resistance reads low even where SWTEST still sees a 1. With `drive`,
+// the pads routed when acquisition starts are driven high for it, as in
+// CFGTEST (test harness on J5).
+class ProbeAdc {
+ public:
+  static constexpr uint8_t kChannels = 4;
+  static constexpr uint8_t kFirstPin = 26;
+  // 96 ADC clocks per conversion at 48 MHz
+  static constexpr uint32_t kMaxRateHz = 500000;
+  static constexpr uint32_t kMinRateHz = 1000;
+  static constexpr uint32_t kMaxAverage = 1000000;  // sums stay within 32 bits
+  // Records per second the stream is sized for; `average` must keep below it
+  static constexpr uint32_t kMaxRecordHz = 1000;
+  // ADC START without arguments: 100 records/s at kMaxRateHz
+  static constexpr uint32_t kDefaultAverage = 1250;
+  // Rounds per DMA buffer, fewer at low rates so a buffer fills in at most
+  // 1 / kMinBufferHz; always a power of two
+  static constexpr size_t kBufferRounds = 256;
+  static constexpr uint32_t kMinBufferHz = 200;
+  static constexpr size_t kRingSize = 32;
+  // Rounds reduced per update(), about 6 us on the M0+ at 133 MHz
+  static constexpr size_t kReduceRounds = 16;
+
+  // Sent as-is in EVT_ADC frames
+  struct Record {
+    uint32_t seq;
+    uint32_t t_us;    // micros() at the last conversion, from the sample count
+    uint32_t rounds;  // conversions of each probe in this record
+    uint16_t mean[kChannels];  // 12-bit code x 16
+    uint16_t min[kChannels];   // 12-bit code
+    uint16_t max[kChannels];
+  };
+  static_assert(sizeof(Record) == 36, "ProbeAdc::Record is sent as-is");
+
+  // Record::mean and a 12-bit code in mV
+  static uint32_t mean_mv(uint16_t mean);
+  static uint32_t code_mv(uint16_t code);
+  // Core 0: whether start() would accept these
+  static bool settings_ok(uint32_t rate_hz, uint32_t average);
+
+  explicit ProbeAdc(const Max328Router &router);
+
+  // Core 1 (the DMA interrupt is taken on the core that calls begin())
+  void begin();
+  // records: stop after this many, 0 = until stop(). Restarts if running.
+  bool start(uint32_t rate_hz, uint32_t average, uint32_t records, bool drive);
+  void stop();
+  // Reduce up to kReduceRounds of the buffers DMA has filled
+  void update();
+  // time_us_64() at which update() next has work: now while a filled buffer
+  // is not fully reduced, else kNoDeadline (the DMA interrupt wakes the core)
+  uint64_t next_deadline_us() const;
+
+  bool active() const { return active_; }
+  uint32_t rate_hz() const { return rate_hz_; }
+  uint32_t average() const { return average_; }
+  bool drive() const { return drive_mask_ != 0; }
+  uint32_t records() const { return records_; }
+  // Buffers DMA filled again before core 1 had reduced them (data lost)
+  uint32_t overruns() const { return overruns_; }
+
+  // Core 0
+  bool pop(Record &record);
+  // Records lost to a full ring since boot
+  uint32_t dropped() const;
+
+ private:
+  const Max328Router &router_;
+  int dma_[2];
+  // Aligned for the DMA write ring, which wraps on a multiple of its size
+  alignas(kBufferRounds * kChannels * sizeof(uint16_t)) uint16_t
+      buffers_[2][kBufferRounds * kChannels];
+  size_t buffer_rounds_;
+  // Buffers filled since start(), counted by the DMA interrupt, and reduced
+  // by update(); buffer n % 2 is the nth filled. DMA starts on it again when
+  // the next one is full, so only the last filled one can still be read.
+  std::atomic<uint32_t> filled_;
+  uint32_t reduced_;
+  size_t round_;  // rounds of buffer reduced_ % 2 already reduced
+  uint32_t overruns_;
+
+  bool active_;
+  uint32_t rate_hz_;
+  uint32_t average_;
+  uint32_t record_limit_;
+  uint32_t drive_mask_;
+  uint32_t start_us_;
+  uint64_t samples_;
+  uint32_t records_;
+
+  // Record being accumulated
+  uint32_t rounds_;
+  uint32_t sum_[kChannels];
+  uint16_t min_[kChannels];
+  uint16_t max_[kChannels];
+
+  SpscQueue<Record, kRingSize> ring_;
+  std::atomic<uint32_t> next_seq_;
+  std::atomic<uint32_t> dropped_;
+
+  static ProbeAdc *instance_;
+  static void dma_isr();
+
+  void clear_accumulator();
+  // Rounds [first, end) of `buffer`; false if the record limit stopped it
+  bool reduce(const uint16_t *buffer, size_t first, size_t end);
+  void emit();
+};
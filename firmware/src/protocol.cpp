@@ -1,269 +1,1653 @@
 #include "protocol.h"
 
-#include <ctype.h>
-#include <stdlib.h>
+#include <pico/time.h>
+#include <string.h>
 
-#include "status_led.h"
-#include "switch_validator.h"
-#include "test_mode.h"
+#include "boot_log.h"
 #include "vdp_sequences.h"
 
-Protocol::Protocol(Max328Router &router, TestMode *test_mode,
-                   SwitchValidator *switch_validator)
-    : router_(router),
-      test_mode_(test_mode),
-      switch_validator_(switch_validator) {}
+Protocol::Protocol(SwitchDriver &driver)
+    : driver_(driver),
+      boot_pending_(false),
+      seq_count_(0),
+      mode_(Mode::ASCII),
+      rx_head_(0),
+      rx_tail_(0),
+      line_len_(0),
+      line_overflow_(false),
+      test_reply_(nullptr),
+      settled_count_(0),
+      streaming_(false),
+      events_dropped_(0),
+      adc_dropped_(0),
+      collecting_(false),
+      batch_overflow_(false),
+      batch_active_(false),
+      batch_len_(0),
+      batch_count_(0),
+      batch_next_(0),
+      frame_len_(0),
+      frame_overflow_(false),
+      stats_since_us_(0),
+      rx_lines_(0),
+      rx_too_long_(0),
+      out_dropped_base_(0),
+      heap_sample_us_(0),
+      heap_min_free_(0) {}
 
-void Protocol::begin() { line_.reserve(80); }
+void Protocol::begin() {
+  reset_stats();
+  presets_.begin();
+  boot_pending_ = true;
+}
+
+void Protocol::announce_ready() {
+  print_ready();
+  boot_log.mark(BootLog::Phase::READY);
+}
 
 void Protocol::update() {
-  while (Serial.available() > 0) {
-    char c = static_cast<char>(Serial.read());
+  // Input is held until core 1 has picked up the previous command, so every
+  // reply and query sees its effect and the command queue is empty whenever
+  // a line is handled.
+  loop_timer_.tick();
+  if (boot_pending_) {
+    finish_boot();
+  }
+  sample_heap();
+  bool caught_up = driver_.caught_up();
+  forward_output();
+  forward_events();
+  forward_adc();
+  if (!caught_up) {
+    return;
+  }
+  report_settled();
+  flush_test_reply();
+  if (batch_active_) {
+    run_batch();
+    if (batch_active_) {
+      return;
+    }
+  }
+
+  fill_rx();
+  while (rx_tail_ != rx_head_) {
+    uint8_t byte = rx_[rx_tail_++ % kRxSize];
+    if (mode_ == Mode::BINARY) {
+      handle_frame_byte(byte);
+      if (!driver_.caught_up()) {
+        return;
+      }
+      continue;
+    }
+    char c = static_cast<char>(byte);
     if (c == '\r') {
       continue;
     }
     if (c == '\n') {
-      String line = line_;
-      line_ = "";
-      line.trim();
-      if (line.length() > 0) {
-        handle_line(line);
+      size_t len = line_len_;
+      line_[len] = '\0';
+      line_len_ = 0;
+      rx_lines_++;
+      if (line_overflow_) {
+        // Never run a cut-off command; in BEGIN ... END the batch is refused
+        line_overflow_ = false;
+        rx_too_long_++;
+        if (collecting_) {
+          batch_overflow_ = true;
+        } else {
+          Serial.println("ERR LINE_TOO_LONG");
+        }
+        continue;
+      }
+      handle_line(line_, len);
+      if (!driver_.caught_up() || batch_active_) {
+        return;
       }
       continue;
     }
-    if (line_.length() < 120) {
-      line_ += c;
+    if (line_len_ < kMaxLine) {
+      line_[line_len_++] = c;
+    } else {
+      line_overflow_ = true;
     }
   }
 }
 
-void Protocol::handle_line(const String &line) {
-  String upper = line;
-  upper.toUpperCase();
+// Flash work left out of begin() so READY is not held up by it. Commands
+// sent meanwhile wait in the USB buffer.
+void Protocol::finish_boot() {
+  boot_pending_ = false;
+  presets_.mount();
+  restore_sequence();
+  boot_log.mark(BootLog::Phase::PRESETS);
+}
 
-  if (upper == "PING") {
-    Serial.println("PONG");
-    return;
+// Move whatever the serial port has buffered into rx_ in at most two bulk
+// reads (the ring may wrap). Bytes stay there while input is held.
+void Protocol::fill_rx() {
+  for (int pass = 0; pass < 2; pass++) {
+    size_t used = static_cast<uint16_t>(rx_head_ - rx_tail_);
+    size_t head = rx_head_ % kRxSize;
+    size_t span = kRxSize - used;
+    if (span > kRxSize - head) {
+      span = kRxSize - head;
+    }
+    int available = Serial.available();
+    if (span == 0 || available <= 0) {
+      return;
+    }
+    if (span > static_cast<size_t>(available)) {
+      span = static_cast<size_t>(available);
+    }
+    size_t n = Serial.readBytes(reinterpret_cast<char *>(rx_ + head), span);
+    rx_head_ = static_cast<uint16_t>(rx_head_ + n);
+    if (n < span) {
+      return;
+    }
   }
+}
 
-  if (upper == "VERSION" || upper == "VER") {
-    Serial.print("OpenPauw Firmware v");
-    Serial.println(FIRMWARE_VERSION);
-    return;
+void Protocol::flush_test_reply() {
+  if (test_reply_) {
+    Serial.println(test_reply_);
+    print_test_status();
+    test_reply_ = nullptr;
   }
+}
 
-  if (upper == "HELP") {
-    print_help();
+// Text printed on core 1: as is in line mode, one EVT_TEXT frame per line in
+// binary mode.
+void Protocol::forward_output() {
+  if (mode_ == Mode::ASCII) {
+    driver_.output().drain(Serial);
     return;
   }
+  char line[kBinMaxPacket - 5];
+  size_t len = 0;
+  while (driver_.output().read_line(line, sizeof(line), len)) {
+    send_frame(0, static_cast<uint8_t>(BinOp::EVT_TEXT), BinStatus::OK,
+               reinterpret_cast<const uint8_t *>(line), len);
+  }
+}
 
-  if (upper == "STATE?") {
-    print_state();
+// EventLog records: one "EVT seq=..." line each in line mode, EVT_LOG frames
+// of up to kBinEventBatch in binary mode. A pass sends what is there, so a
+// burst goes out in batches as core 1 records it.
+void Protocol::forward_events() {
+  EventLog &log = driver_.events();
+  EventLog::Event batch[kBinEventBatch];
+  if (!streaming_) {
+    while (log.pop(batch[0])) {
+    }
+    return;
+  }
+  size_t n = 0;
+  while (n < kBinEventBatch && log.pop(batch[n])) {
+    n++;
+  }
+  if (n == 0) {
+    return;
+  }
+  uint32_t dropped = log.dropped();
+  if (mode_ == Mode::BINARY) {
+    uint8_t payload[4 + sizeof(batch)];
+    memcpy(payload, &dropped, 4);
+    memcpy(payload + 4, batch, n * sizeof(EventLog::Event));
+    send_frame(0, static_cast<uint8_t>(BinOp::EVT_LOG), BinStatus::OK, payload,
+               4 + n * sizeof(EventLog::Event));
+    events_dropped_ = dropped;
     return;
   }
+  if (dropped != events_dropped_) {
+    Serial.print("EVT DROPPED total=");
+    Serial.println(dropped);
+    events_dropped_ = dropped;
+  }
+  for (size_t i = 0; i < n; i++) {
+    print_event(batch[i]);
+  }
+}
 
-  if (upper == "TEST?") {
-    if (!test_mode_) {
-      Serial.println("ERR");
+void Protocol::print_event(const EventLog::Event &event) {
+  Serial.print("EVT seq=");
+  Serial.print(event.seq);
+  Serial.print(" t_us=");
+  Serial.print(event.t_us);
+  switch (static_cast<EventLog::Type>(event.type)) {
+    case EventLog::Type::ROUTE: {
+      Serial.print(" type=route board=");
+      Serial.print(event.board);
+      Serial.print(" cfg=");
+      Serial.print(event.a);
+      Serial.print(" pads=");
+      for (uint8_t leg = 0; leg < 4; leg++) {
+        Serial.print(pad_to_char(static_cast<Pad>((event.value >> (leg * 4)) & 0x0F)));
+      }
+      Serial.print(" en=");
+      Serial.println(event.b);
       return;
     }
-    print_test_status();
+    case EventLog::Type::ENMASK:
+      Serial.print(" type=enmask board=");
+      Serial.print(event.board);
+      Serial.print(" en=");
+      Serial.println(event.a);
+      return;
+    case EventLog::Type::SETTLED:
+      Serial.print(" type=settled cfg=");
+      Serial.print(event.a);
+      Serial.print(" settle_us=");
+      Serial.println(event.value);
+      return;
+    case EventLog::Type::SWTEST:
+      Serial.print(" type=swtest pass=");
+      Serial.print(event.a);
+      Serial.print(" connections=");
+      Serial.println(event.value);
+      return;
+    case EventLog::Type::CFGTEST:
+      Serial.print(" type=cfgtest cfg=");
+      Serial.print(event.b);
+      Serial.print(" pass=");
+      Serial.println(event.a);
+      return;
+  }
+  Serial.print(" type=");
+  Serial.println(event.type);
+}
+
+// ProbeAdc records: one "ADC seq=..." line each in line mode, EVT_ADC frames
+// of up to kBinAdcBatch in binary mode. There are only records after ADC
+// START, so they are always sent.
+void Protocol::forward_adc() {
+  ProbeAdc &adc = driver_.adc();
+  ProbeAdc::Record batch[kBinAdcBatch];
+  size_t n = 0;
+  while (n < kBinAdcBatch && adc.pop(batch[n])) {
+    n++;
+  }
+  if (n == 0) {
+    return;
+  }
+  uint32_t dropped = adc.dropped();
+  if (mode_ == Mode::BINARY) {
+    uint8_t payload[4 + sizeof(batch)];
+    memcpy(payload, &dropped, 4);
+    memcpy(payload + 4, batch, n * sizeof(ProbeAdc::Record));
+    send_frame(0, static_cast<uint8_t>(BinOp::EVT_ADC), BinStatus::OK, payload,
+               4 + n * sizeof(ProbeAdc::Record));
+    adc_dropped_ = dropped;
+    return;
+  }
+  if (dropped != adc_dropped_) {
+    Serial.print("ADC DROPPED total=");
+    Serial.println(dropped);
+    adc_dropped_ = dropped;
+  }
+  for (size_t i = 0; i < n; i++) {
+    print_adc_record(batch[i]);
+  }
+}
+
+// Mean and peak-to-peak of each probe in mV, in I+ I- V+ V- order (J1-J4)
+void Protocol::print_adc_record(const ProbeAdc::Record &record) {
+  Serial.print("ADC seq=");
+  Serial.print(record.seq);
+  Serial.print(" t_us=");
+  Serial.print(record.t_us);
+  Serial.print(" n=");
+  Serial.print(record.rounds);
+  Serial.print(" mv=");
+  for (uint8_t ch = 0; ch < ProbeAdc::kChannels; ch++) {
+    if (ch > 0) {
+      Serial.print(",");
+    }
+    Serial.print(ProbeAdc::mean_mv(record.mean[ch]));
+  }
+  Serial.print(" pp=");
+  for (uint8_t ch = 0; ch < ProbeAdc::kChannels; ch++) {
+    if (ch > 0) {
+      Serial.print(",");
+    }
+    Serial.print(ProbeAdc::code_mv(record.max[ch]) - ProbeAdc::code_mv(record.min[ch]));
+  }
+  Serial.println();
+}
+
+void Protocol::report_settled() {
+  SwitchDriver::Snapshot snap = driver_.snapshot();
+  if (snap.settled_count == settled_count_) {
+    return;
+  }
+  settled_count_ = snap.settled_count;
+  if (mode_ == Mode::BINARY) {
+    uint32_t t_us = snap.settled_t_us;
+    uint8_t payload[5] = {snap.settled_cfg_id, static_cast<uint8_t>(t_us),
+                          static_cast<uint8_t>(t_us >> 8), static_cast<uint8_t>(t_us >> 16),
+                          static_cast<uint8_t>(t_us >> 24)};
+    send_frame(snap.settled_tag, static_cast<uint8_t>(BinOp::EVT_SETTLED), BinStatus::OK,
+               payload, sizeof(payload));
+    return;
+  }
+  Serial.print("SETTLED cfg=");
+  Serial.print(snap.settled_cfg_id);
+  Serial.print(" t_us=");
+  Serial.println(snap.settled_t_us);
+}
+
+void Protocol::sample_heap() {
+  uint64_t now = time_us_64();
+  if (now - heap_sample_us_ < kHeapSampleUs) {
     return;
   }
+  heap_sample_us_ = now;
+  int free_heap = rp2040.getFreeHeap();
+  if (free_heap < heap_min_free_) {
+    heap_min_free_ = free_heap;
+  }
+}
 
-  if (upper == "CFGTEST") {
-    if (!switch_validator_) {
-      Serial.println("ERR NO_VALIDATOR");
-      status_led.set_state(LedState::ERROR);
+void Protocol::handle_line(char *line, size_t len) {
+  uint64_t start_us = time_us_64();
+  if (collecting_) {
+    collect_line(line, len);
+    return;
+  }
+  if (memchr(line, ';', len)) {
+    memcpy(batch_, line, len);
+    batch_len_ = len;
+    start_batch();
+    return;
+  }
+
+  ParsedLine parsed;
+  parse_line(line, len, parsed);
+  if (parsed.argc == 0) {
+    return;
+  }
+  if (parsed.args_ok && parsed.command->id == CommandId::BEGIN) {
+    collecting_ = true;
+    batch_len_ = 0;
+    batch_overflow_ = false;
+    return;
+  }
+  execute(parsed);
+  if (parsed.command) {
+    command_time_[command_index(parsed.command)].record(
+        static_cast<uint32_t>(time_us_64() - start_us));
+  }
+}
+
+void Protocol::execute(const ParsedLine &parsed) {
+  if (!parsed.args_ok) {
+    Serial.println("ERR");
+    return;
+  }
+
+  SwitchDriver::Snapshot snap = driver_.snapshot();
+  // While a sequence runs it owns the router; only queries are allowed.
+  if (parsed.command->routing && snap.seq_active) {
+    Serial.println("ERR SEQ_ACTIVE");
+    return;
+  }
+  if (parsed.command->routing && snap.boards == 0) {
+    Serial.println("ERR NO_BOARD");
+    return;
+  }
+
+  char *const *argv = parsed.argv;
+  CommandId id = parsed.command->id;
+  switch (id) {
+    case CommandId::PING:
+      Serial.println("PONG");
+      return;
+
+    case CommandId::VERSION:
+      Serial.print("OpenPauw Firmware v");
+      Serial.println(FIRMWARE_VERSION);
+      return;
+
+    case CommandId::HELP:
+      print_help();
+      return;
+
+    case CommandId::STATE_QUERY:
+      print_state();
+      return;
+
+    case CommandId::READY_QUERY:
+      print_ready();
+      return;
+
+    case CommandId::BOOT_QUERY:
+      print_boot();
+      return;
+
+    case CommandId::BOARDS_QUERY: {
+      Serial.print("BOARDS COUNT=");
+      uint8_t count = 0;
+      for (uint8_t b = 0; b < Max328Router::kMaxBoards; b++) {
+        count += (snap.boards >> b) & 1;
+      }
+      Serial.print(count);
+      Serial.print(" PRESENT=");
+      const char *sep = "";
+      for (uint8_t b = 0; b < Max328Router::kMaxBoards; b++) {
+        if (snap.boards & (1 << b)) {
+          Serial.print(sep);
+          Serial.print(b);
+          sep = ",";
+        }
+      }
+      Serial.println();
       return;
     }
-    status_led.set_state(LedState::BUSY);
 
-    // Get current router state and verify the routing
-    const RouterState& state = router_.state();
-    bool pass = switch_validator_->verify_config(
-        static_cast<uint8_t>(state.ip),
-        static_cast<uint8_t>(state.im),
-        static_cast<uint8_t>(state.vp),
-        static_cast<uint8_t>(state.vm));
+    case CommandId::BOARD: {
+      uint8_t boards = 0;
+      ParsedLine sub;
+      if (!parse_board_command(parsed, boards, sub)) {
+        break;
+      }
+      boards &= snap.boards;
+      if (boards == 0) {
+        Serial.println("ERR NO_BOARD");
+        return;
+      }
+      if (sub.command->id == CommandId::STATE_QUERY) {
+        for (uint8_t b = 0; b < Max328Router::kMaxBoards; b++) {
+          if (boards & (1 << b)) {
+            print_board_state(snap, b);
+          }
+        }
+        return;
+      }
+      if (snap.seq_active) {
+        Serial.println("ERR SEQ_ACTIVE");
+        return;
+      }
+      // Every addressed board moves in the same break/make/settle cycle
+      Route route = {};
+      for (uint8_t b = 0; b < Max328Router::kMaxBoards; b++) {
+        if (boards & (1 << b)) {
+          route = board_route(snap, b);
+          parse_route(sub, route);
+          driver_.stage_route(b, route.state, route.cfg_id, route.enable_mask);
+        }
+      }
+      driver_.commit_routes(route.cfg_id, micros());
+      print_route_reply(sub.command->id, route, argv[1]);
+      return;
+    }
 
-    if (pass) {
-      Serial.println("OK CFGTEST PASS");
-      status_led.set_state(LedState::SWTEST_PASS);
-    } else {
-      Serial.println("ERR CFGTEST FAIL");
-      status_led.set_state(LedState::SWTEST_FAIL);
+    case CommandId::TEST_QUERY:
+      print_test_status();
+      return;
+
+    case CommandId::SEQ_QUERY:
+      print_seq_status();
+      return;
+
+    case CommandId::EVT_QUERY: {
+      EventLog &log = driver_.events();
+      Serial.print("EVT STREAM=");
+      Serial.print(streaming_ ? 1 : 0);
+      Serial.print(" NEXT_SEQ=");
+      Serial.print(log.next_seq());
+      Serial.print(" PENDING=");
+      Serial.print(log.pending());
+      Serial.print(" DROPPED=");
+      Serial.println(log.dropped());
+      return;
     }
-    return;
+
+    case CommandId::ADC_QUERY:
+      print_adc_status(snap);
+      return;
+
+    case CommandId::ADC: {
+      AdcRequest request;
+      if (!parse_adc(parsed, request)) {
+        break;
+      }
+      if (!request.start) {
+        driver_.adc_stop();
+        Serial.println("OK ADC STOP");
+        return;
+      }
+      if (request.drive && snap.test_active) {
+        Serial.println("ERR TEST_ACTIVE");
+        return;
+      }
+      driver_.adc_start(request.rate_hz, request.average, request.records, request.drive);
+      Serial.print("OK ADC START ");
+      Serial.print(request.rate_hz);
+      Serial.print(" ");
+      Serial.println(request.average);
+      return;
+    }
+
+    case CommandId::EVT:
+      if (strcmp(argv[1], "ON") == 0) {
+        // Records from before EVT ON were discarded, not dropped
+        streaming_ = true;
+        events_dropped_ = driver_.events().dropped();
+        Serial.println("OK EVT ON");
+        return;
+      }
+      if (strcmp(argv[1], "OFF") == 0) {
+        streaming_ = false;
+        Serial.println("OK EVT OFF");
+        return;
+      }
+      break;
+
+    case CommandId::STATS_QUERY:
+      print_stats();
+      return;
+
+    case CommandId::STATS:
+      if (strcmp(argv[1], "RESET") != 0) {
+        break;
+      }
+      reset_stats();
+      driver_.stats_reset();
+      Serial.println("OK STATS RESET");
+      return;
+
+    case CommandId::I2C_QUERY:
+      Serial.print("I2C CLOCK=");
+      Serial.print(snap.i2c_clock_hz);
+      Serial.print(" TXN=");
+      Serial.print(snap.i2c_txn);
+      Serial.print(" LAST=");
+      Serial.println(snap.i2c_txn_op);
+      return;
+
+    case CommandId::I2C: {
+      uint32_t hz = 0;
+      if (!parse_i2c_clock(parsed, hz)) {
+        break;
+      }
+      driver_.set_i2c_clock(hz);
+      Serial.print("OK I2C CLOCK ");
+      Serial.println(hz);
+      return;
+    }
+
+    case CommandId::MODE:
+      if (strcmp(argv[1], "BIN") == 0) {
+        Serial.println("OK MODE BIN");
+        mode_ = Mode::BINARY;
+        frame_len_ = 0;
+        frame_overflow_ = false;
+        return;
+      }
+      if (strcmp(argv[1], "ASCII") == 0) {
+        Serial.println("OK MODE ASCII");
+        return;
+      }
+      break;
+
+    case CommandId::SEQ:
+      handle_seq(parsed, snap);
+      return;
+
+    case CommandId::PRESET:
+      handle_preset(parsed, snap);
+      return;
+
+    case CommandId::CFGTEST:
+      // The probes are analog inputs while the ADC runs
+      if (snap.adc_active) {
+        Serial.println("ERR ADC_ACTIVE");
+        return;
+      }
+      // Runs on core 1, which prints the result and OK/ERR CFGTEST
+      driver_.cfgtest();
+      return;
+
+    case CommandId::SWTEST:
+      if (parsed.argc == 2 && strcmp(argv[1], "SLOW") != 0) {
+        break;
+      }
+      if (snap.adc_active) {
+        Serial.println("ERR ADC_ACTIVE");
+        return;
+      }
+      // Runs on core 1, which prints the matrix and OK SWTEST
+      driver_.swtest(parsed.argc == 2);
+      return;
+
+    case CommandId::CFG:
+    case CommandId::SET:
+    case CommandId::ENMASK: {
+      Route route = {snap.state, snap.cfg_id, snap.enable_mask};
+      if (!parse_route(parsed, route)) {
+        break;
+      }
+      if (id == CommandId::ENMASK) {
+        driver_.set_enable_mask(route.enable_mask);
+      } else {
+        driver_.apply_state(route.state, route.cfg_id, micros());
+      }
+      print_route_reply(id, route);
+      return;
+    }
+
+    case CommandId::TEST: {
+      TestAction action;
+      uint32_t interval_ms = snap.test_interval_ms;
+      if (!parse_test(parsed, action, interval_ms)) {
+        break;
+      }
+      // Test mode and ADC DRIVE both drive the harness pads
+      if (action != TestAction::STOP && snap.adc_active) {
+        Serial.println("ERR ADC_ACTIVE");
+        return;
+      }
+      if (action == TestAction::START) {
+        driver_.test_start(interval_ms);
+        test_reply_ = "OK TEST ON";
+      } else if (action == TestAction::STEP) {
+        driver_.test_step();
+        test_reply_ = "OK TEST STEP";
+      } else {
+        driver_.test_stop();
+        Serial.println("OK TEST OFF");
+      }
+      return;
+    }
+
+    case CommandId::BEGIN:
+    case CommandId::END:
+      break;
   }
+  Serial.println("ERR");
+}
 
-  if (upper.startsWith("CFG")) {
-    String tokens[2];
-    int count = split_tokens(upper, tokens, 2);
-    if (count == 2) {
-      int cfg_id = tokens[1].toInt();
+// CFG, SET and ENMASK edit `route` in place; false if the arguments are bad
+// or the SET pads are not Max328Router::route_safe().
+bool Protocol::parse_route(const ParsedLine &parsed, Route &route) {
+  char *const *argv = parsed.argv;
+  switch (parsed.command->id) {
+    case CommandId::CFG: {
+      uint32_t cfg_id = 0;
       RouterState state;
-      if (cfg_id >= 1 && cfg_id <= 4 && get_vdp_config(cfg_id, state)) {
-        router_.apply_state(state, static_cast<uint8_t>(cfg_id));
-        Serial.print("OK CFG ");
-        Serial.println(cfg_id);
-        return;
+      if (!parse_uint32(argv[1], cfg_id) || cfg_id > 255 ||
+          !presets_.get(static_cast<uint8_t>(cfg_id), state)) {
+        return false;
       }
+      route.state = state;
+      route.cfg_id = static_cast<uint8_t>(cfg_id);
+      return true;
     }
-    Serial.println("ERR");
+    case CommandId::SET: {
+      RouterState state;
+      if (!parse_pad_token(argv[1], state.ip) || !parse_pad_token(argv[2], state.im) ||
+          !parse_pad_token(argv[3], state.vp) || !parse_pad_token(argv[4], state.vm) ||
+          !Max328Router::route_safe(state)) {
+        return false;
+      }
+      route.state = state;
+      route.cfg_id = 0;
+      return true;
+    }
+    case CommandId::ENMASK: {
+      uint32_t mask = 0;
+      if (!parse_uint32(argv[1], mask) || mask > Max328Router::kEnableAll) {
+        return false;
+      }
+      route.enable_mask = static_cast<uint8_t>(mask);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+// I2C CLOCK <hz>
+// ADC START [rate_hz] [average] [records] [DRIVE]: numbers in that order,
+// each optional from the right; ADC STOP
+bool Protocol::parse_adc(const ParsedLine &parsed, AdcRequest &request) {
+  request = {false, ProbeAdc::kMaxRateHz, ProbeAdc::kDefaultAverage, 0, false};
+  if (strcmp(parsed.argv[1], "STOP") == 0) {
+    return parsed.argc == 2;
+  }
+  if (strcmp(parsed.argv[1], "START") != 0) {
+    return false;
+  }
+  request.start = true;
+  uint8_t argc = parsed.argc;
+  if (strcmp(parsed.argv[argc - 1], "DRIVE") == 0) {
+    request.drive = true;
+    argc--;
+  }
+  uint32_t *numbers[] = {&request.rate_hz, &request.average, &request.records};
+  if (argc - 2 > 3) {
+    return false;
+  }
+  for (uint8_t i = 2; i < argc; i++) {
+    if (!parse_uint32(parsed.argv[i], *numbers[i - 2])) {
+      return false;
+    }
+  }
+  return ProbeAdc::settings_ok(request.rate_hz, request.average);
+}
+
+void Protocol::print_adc_status(const SwitchDriver::Snapshot &snap) {
+  Serial.print("ADC ACTIVE=");
+  Serial.print(snap.adc_active ? 1 : 0);
+  Serial.print(" RATE=");
+  Serial.print(snap.adc_rate_hz);
+  Serial.print(" AVG=");
+  Serial.print(snap.adc_average);
+  Serial.print(" DRIVE=");
+  Serial.print(snap.adc_drive ? 1 : 0);
+  Serial.print(" RECORDS=");
+  Serial.print(snap.adc_records);
+  Serial.print(" OVERRUNS=");
+  Serial.print(snap.adc_overruns);
+  Serial.print(" DROPPED=");
+  Serial.println(driver_.adc().dropped());
+}
+
+bool Protocol::parse_i2c_clock(const ParsedLine &parsed, uint32_t &hz) {
+  return strcmp(parsed.argv[1], "CLOCK") == 0 && parse_uint32(parsed.argv[2], hz) &&
+         McpPort::valid_clock(hz);
+}
+
+void Protocol::print_route_reply(CommandId id, const Route &route, const char *board) {
+  Serial.print("OK ");
+  if (board) {
+    Serial.print("BOARD ");
+    Serial.print(board);
+    Serial.print(" ");
+  }
+  if (id == CommandId::SET) {
+    Serial.print("SET");
+    print_pads(route.state);
     return;
   }
+  Serial.print(id == CommandId::CFG ? "CFG " : "ENMASK ");
+  Serial.println(id == CommandId::CFG ? route.cfg_id : route.enable_mask);
+}
+
+// BOARD <n|ALL> <command>: `boards` gets the addressed board bits (ALL is
+// every bit; absent boards are dropped when it runs) and `sub` the command.
+// Only CFG, SET, ENMASK and STATE? can be addressed.
+bool Protocol::parse_board_command(const ParsedLine &parsed, uint8_t &boards,
+                                   ParsedLine &sub) {
+  const char *target = parsed.argv[1];
+  if (strcmp(target, "ALL") == 0) {
+    boards = Max328Router::kAllBoards;
+  } else if (target[0] >= '0' && target[0] < '0' + Max328Router::kMaxBoards &&
+             target[1] == '\0') {
+    boards = static_cast<uint8_t>(1 << (target[0] - '0'));
+  } else {
+    return false;
+  }
+  parse_tail(parsed, 2, sub);
+  if (!sub.args_ok) {
+    return false;
+  }
+  if (sub.command->id == CommandId::STATE_QUERY) {
+    return true;
+  }
+  Route route = {};
+  return is_route_command(sub) && parse_route(sub, route);
+}
+
+Protocol::Route Protocol::board_route(const SwitchDriver::Snapshot &snap, uint8_t board) {
+  return {snap.board_state[board], snap.board_cfg_id[board], snap.board_enable_mask[board]};
+}
+
+bool Protocol::parse_test(const ParsedLine &parsed, TestAction &action, uint32_t &interval_ms) {
+  if (parsed.argc == 1 || strcmp(parsed.argv[1], "ON") == 0) {
+    action = TestAction::START;
+    return parsed.argc < 3 || parse_uint32(parsed.argv[2], interval_ms);
+  }
+  if (parsed.argc != 2) {
+    return false;
+  }
+  if (strcmp(parsed.argv[1], "OFF") == 0) {
+    action = TestAction::STOP;
+    return true;
+  }
+  if (strcmp(parsed.argv[1], "STEP") == 0) {
+    action = TestAction::STEP;
+    return true;
+  }
+  return false;
+}
 
-  if (upper.startsWith("ENMASK")) {
-    String tokens[2];
-    int count = split_tokens(upper, tokens, 2);
-    uint32_t mask_value = 0;
-    if (count == 2 && parse_uint32(tokens[1], mask_value) && mask_value <= 15) {
-      router_.set_enable_mask(static_cast<uint8_t>(mask_value));
-      Serial.print("OK ENMASK ");
-      Serial.println(mask_value);
+// Lines between BEGIN and END are stored, not run
+void Protocol::collect_line(char *line, size_t len) {
+  ParsedLine parsed;
+  parse_line(line, len, parsed);
+  if (parsed.argc == 1 && parsed.command && parsed.command->id == CommandId::END) {
+    collecting_ = false;
+    if (batch_overflow_) {
+      Serial.println("ERR BATCH_FULL");
       return;
     }
-    Serial.println("ERR");
+    start_batch();
     return;
   }
+  if (parsed.argc == 0) {
+    return;
+  }
+  if (batch_len_ + len + 1 > kBatchSize) {
+    batch_overflow_ = true;
+    return;
+  }
+  // Already tokenized; parse_line() reads the NULs as separators
+  memcpy(batch_ + batch_len_, line, len);
+  batch_len_ += len;
+  batch_[batch_len_++] = ';';
+}
 
-  if (upper.startsWith("SET")) {
-    String tokens[5];
-    int count = split_tokens(upper, tokens, 5);
-    if (count == 5) {
+// Split batch_ at ';' and check every command before any of them runs.
+void Protocol::start_batch() {
+  batch_count_ = 0;
+  batch_[batch_len_] = '\0';
+  size_t start = 0;
+  for (size_t i = 0; i <= batch_len_; i++) {
+    if (i < batch_len_ && batch_[i] != ';') {
+      continue;
+    }
+    batch_[i] = '\0';
+    ParsedLine parsed;
+    parse_line(batch_ + start, i - start, parsed);
+    if (parsed.argc > 0) {
+      if (batch_count_ == kMaxBatchSteps) {
+        Serial.println("ERR BATCH_FULL");
+        return;
+      }
+      if (!batch_command_ok(parsed)) {
+        Serial.print("ERR BATCH ");
+        Serial.println(batch_count_ + 1);
+        return;
+      }
+      batch_steps_[batch_count_++] = {static_cast<uint16_t>(start),
+                                      static_cast<uint16_t>(i - start)};
+    }
+    start = i + 1;
+  }
+  batch_next_ = 0;
+  batch_active_ = true;
+  run_batch();
+}
+
+// Syntax and argument check only; state errors (SEQ_ACTIVE, ...) are
+// reported in place when the step runs.
+bool Protocol::batch_command_ok(const ParsedLine &parsed) {
+  if (!parsed.args_ok) {
+    return false;
+  }
+  switch (parsed.command->id) {
+    case CommandId::BEGIN:
+    case CommandId::END:
+    case CommandId::MODE:
+      return false;
+    case CommandId::CFG:
+    case CommandId::SET:
+    case CommandId::ENMASK: {
+      Route route = {};
+      return parse_route(parsed, route);
+    }
+    case CommandId::TEST: {
+      TestAction action;
+      uint32_t interval_ms = 0;
+      return parse_test(parsed, action, interval_ms);
+    }
+    case CommandId::BOARD: {
+      uint8_t boards = 0;
+      ParsedLine sub;
+      return parse_board_command(parsed, boards, sub);
+    }
+    case CommandId::I2C: {
+      uint32_t hz = 0;
+      return parse_i2c_clock(parsed, hz);
+    }
+    case CommandId::SWTEST:
+      return parsed.argc == 1 || strcmp(parsed.argv[1], "SLOW") == 0;
+    case CommandId::STATS:
+      return strcmp(parsed.argv[1], "RESET") == 0;
+    case CommandId::EVT:
+      return strcmp(parsed.argv[1], "ON") == 0 || strcmp(parsed.argv[1], "OFF") == 0;
+    case CommandId::ADC: {
+      AdcRequest request;
+      return parse_adc(parsed, request);
+    }
+    case CommandId::SEQ: {
+      const char *sub = parsed.argv[1];
+      if (strcmp(sub, "LOAD") == 0 || strcmp(sub, "ADD") == 0) {
+        SequenceEngine::Step steps[SequenceEngine::kMaxSteps];
+        return parse_seq_steps(parsed, steps) >= 0;
+      }
+      uint32_t loops = 0;
+      bool external = false;
+      return ((strcmp(sub, "RUN") == 0 || strcmp(sub, "SWEEP") == 0) &&
+              parse_seq_run(parsed, loops, external)) ||
+             (parsed.argc == 2 && (strcmp(sub, "ABORT") == 0 || strcmp(sub, "CONTINUE") == 0 ||
+                                   strcmp(sub, "SAVE") == 0));
+    }
+    case CommandId::PRESET: {
+      PresetRequest request;
+      return parse_preset(parsed, request);
+    }
+    default:
+      return true;
+  }
+}
+
+void Protocol::load_batch_step(uint8_t index, ParsedLine &parsed) {
+  const BatchStep &step = batch_steps_[index];
+  parse_line(batch_ + step.offset, step.len, parsed);
+}
+
+// Steps run one at a time, each once core 1 has picked up the one before
+// (and finished printing a scan), so replies stay in order and queries see
+// earlier steps. A run of CFG/SET/ENMASK steps, BOARD-addressed ones
+// included, is folded into one router transition: one break/make/settle
+// cycle for every board touched, and one SETTLED.
+void Protocol::run_batch() {
+  while (batch_next_ < batch_count_) {
+    if (!driver_.caught_up()) {
+      return;
+    }
+    SwitchDriver::Snapshot snap = driver_.snapshot();
+    if (snap.scanning) {
+      return;
+    }
+    forward_output();
+    flush_test_reply();
+
+    ParsedLine parsed;
+    load_batch_step(batch_next_, parsed);
+    if (!is_route_command(parsed)) {
+      batch_next_++;
+      execute(parsed);
+      continue;
+    }
+
+    Route routes[Max328Router::kMaxBoards];
+    for (uint8_t b = 0; b < Max328Router::kMaxBoards; b++) {
+      routes[b] = board_route(snap, b);
+    }
+    uint8_t touched = 0;
+    uint8_t settle_cfg_id = snap.cfg_id;
+    bool moved = false;
+    bool addressed = false;
+    while (batch_next_ < batch_count_) {
+      load_batch_step(batch_next_, parsed);
+      if (!is_route_command(parsed)) {
+        break;
+      }
+      batch_next_++;
+      uint8_t boards = 1;
+      ParsedLine sub = parsed;
+      const char *board_label = nullptr;
+      if (parsed.command->id == CommandId::BOARD) {
+        parse_board_command(parsed, boards, sub);
+        boards &= snap.boards;
+        board_label = parsed.argv[1];
+        addressed = true;
+      }
+      if (snap.seq_active) {
+        Serial.println("ERR SEQ_ACTIVE");
+        continue;
+      }
+      if (boards == 0) {
+        Serial.println("ERR NO_BOARD");
+        continue;
+      }
+      CommandId id = sub.command->id;
+      uint8_t last = 0;
+      for (uint8_t b = 0; b < Max328Router::kMaxBoards; b++) {
+        if (boards & (1 << b)) {
+          parse_route(sub, routes[b]);
+          last = b;
+        }
+      }
+      touched |= boards;
+      settle_cfg_id = routes[last].cfg_id;
+      moved = moved || id != CommandId::ENMASK;
+      print_route_reply(id, routes[last], board_label);
+    }
+    if (snap.seq_active || touched == 0) {
+      continue;
+    }
+    const Route &route = routes[0];
+    if (addressed) {
+      for (uint8_t b = 0; b < Max328Router::kMaxBoards; b++) {
+        if (touched & (1 << b)) {
+          driver_.stage_route(b, routes[b].state, routes[b].cfg_id, routes[b].enable_mask);
+        }
+      }
+      driver_.commit_routes(settle_cfg_id, micros());
+    } else if (moved) {
+      driver_.apply_route(route.state, route.cfg_id, route.enable_mask, micros());
+    } else {
+      driver_.set_enable_mask(route.enable_mask);
+    }
+  }
+
+  if (!driver_.caught_up() || driver_.snapshot().scanning) {
+    return;
+  }
+  forward_output();
+  flush_test_reply();
+  Serial.print("OK BATCH ");
+  Serial.println(batch_count_);
+  batch_active_ = false;
+}
+
+// CFG, SET or ENMASK, alone or addressed with BOARD
+bool Protocol::is_route_command(const ParsedLine &parsed) {
+  CommandId id = parsed.command->id;
+  if (id == CommandId::BOARD) {
+    ParsedLine sub;
+    parse_tail(parsed, 2, sub);
+    return sub.command && is_route_command(sub);
+  }
+  return id == CommandId::CFG || id == CommandId::SET || id == CommandId::ENMASK;
+}
+
+void Protocol::handle_frame_byte(uint8_t c) {
+  if (c != 0) {
+    if (frame_len_ < sizeof(frame_)) {
+      frame_[frame_len_++] = c;
+    } else {
+      frame_overflow_ = true;
+    }
+    return;
+  }
+  // A lone delimiter (sent by hosts to resync) is not a frame
+  if (frame_len_ > 0 || frame_overflow_) {
+    uint8_t packet[kBinMaxPacket];
+    size_t len = frame_overflow_ ? 0 : cobs_decode(frame_, frame_len_, packet, sizeof(packet));
+    if (len == 0) {
+      send_frame(0, 0, BinStatus::BAD_FRAME);
+    } else {
+      handle_frame(packet, len);
+    }
+  }
+  frame_len_ = 0;
+  frame_overflow_ = false;
+}
+
+void Protocol::handle_frame(const uint8_t *packet, size_t len) {
+  // id, op, crc16
+  if (len < 4) {
+    send_frame(0, 0, BinStatus::BAD_FRAME);
+    return;
+  }
+  uint8_t id = packet[0];
+  uint8_t op = packet[1];
+  uint16_t crc = static_cast<uint16_t>(packet[len - 2] | (packet[len - 1] << 8));
+  if (crc16_ccitt(packet, len - 2) != crc) {
+    send_frame(id, op, BinStatus::BAD_CRC);
+    return;
+  }
+  const uint8_t *payload = packet + 2;
+  size_t payload_len = len - 4;
+  SwitchDriver::Snapshot snap = driver_.snapshot();
+
+  switch (static_cast<BinOp>(op)) {
+    case BinOp::PING:
+      send_frame(id, op, BinStatus::OK);
+      return;
+
+    case BinOp::VERSION:
+      send_frame(id, op, BinStatus::OK, reinterpret_cast<const uint8_t *>(FIRMWARE_VERSION),
+                 strlen(FIRMWARE_VERSION));
+      return;
+
+    case BinOp::STATE: {
+      BinState state;
+      state.cfg_id = snap.cfg_id;
+      state.ip = static_cast<uint8_t>(snap.state.ip);
+      state.im = static_cast<uint8_t>(snap.state.im);
+      state.vp = static_cast<uint8_t>(snap.state.vp);
+      state.vm = static_cast<uint8_t>(snap.state.vm);
+      state.enable_mask = snap.enable_mask;
+      state.flags = static_cast<uint8_t>((snap.routing ? kBinStateRouting : 0) |
+                                         (snap.seq_active ? kBinStateSeqActive : 0) |
+                                         (snap.test_active ? kBinStateTestActive : 0));
+      send_frame(id, op, BinStatus::OK, reinterpret_cast<const uint8_t *>(&state),
+                 sizeof(state));
+      return;
+    }
+
+    case BinOp::EVT_STREAM:
+      if (payload_len != 1 || payload[0] > 1) {
+        send_frame(id, op, BinStatus::BAD_ARG);
+        return;
+      }
+      streaming_ = payload[0] != 0;
+      events_dropped_ = driver_.events().dropped();
+      send_frame(id, op, BinStatus::OK);
+      return;
+
+    case BinOp::MODE_ASCII:
+      send_frame(id, op, BinStatus::OK);
+      mode_ = Mode::ASCII;
+      line_len_ = 0;
+      collecting_ = false;
+      return;
+
+    case BinOp::CFG: {
       RouterState state;
-      if (parse_pad_token(tokens[1], state.ip) &&
-          parse_pad_token(tokens[2], state.im) &&
-          parse_pad_token(tokens[3], state.vp) &&
-          parse_pad_token(tokens[4], state.vm)) {
-        router_.apply_state(state, 0);
-        print_ok_set(state);
+      if (payload_len != 1 || !presets_.get(payload[0], state)) {
+        send_frame(id, op, BinStatus::BAD_ARG);
+        return;
+      }
+      if (snap.seq_active) {
+        send_frame(id, op, BinStatus::SEQ_ACTIVE);
+        return;
+      }
+      if (snap.boards == 0) {
+        send_frame(id, op, BinStatus::NO_BOARD);
         return;
       }
+      driver_.apply_state(state, payload[0], micros(), id);
+      send_frame(id, op, BinStatus::OK);
+      return;
     }
-    Serial.println("ERR");
+
+    case BinOp::SET: {
+      if (payload_len != 4 || payload[0] >= kPadCount || payload[1] >= kPadCount ||
+          payload[2] >= kPadCount || payload[3] >= kPadCount) {
+        send_frame(id, op, BinStatus::BAD_ARG);
+        return;
+      }
+      if (snap.seq_active) {
+        send_frame(id, op, BinStatus::SEQ_ACTIVE);
+        return;
+      }
+      if (snap.boards == 0) {
+        send_frame(id, op, BinStatus::NO_BOARD);
+        return;
+      }
+      RouterState state{static_cast<Pad>(payload[0]), static_cast<Pad>(payload[1]),
+                        static_cast<Pad>(payload[2]), static_cast<Pad>(payload[3])};
+      if (!Max328Router::route_safe(state)) {
+        send_frame(id, op, BinStatus::BAD_ARG);
+        return;
+      }
+      driver_.apply_state(state, 0, micros(), id);
+      send_frame(id, op, BinStatus::OK);
+      return;
+    }
+
+    case BinOp::ENMASK:
+      if (payload_len != 1 || payload[0] > Max328Router::kEnableAll) {
+        send_frame(id, op, BinStatus::BAD_ARG);
+        return;
+      }
+      if (snap.seq_active) {
+        send_frame(id, op, BinStatus::SEQ_ACTIVE);
+        return;
+      }
+      if (snap.boards == 0) {
+        send_frame(id, op, BinStatus::NO_BOARD);
+        return;
+      }
+      driver_.set_enable_mask(payload[0]);
+      send_frame(id, op, BinStatus::OK);
+      return;
+
+    default:
+      send_frame(id, op, BinStatus::BAD_OP);
+      return;
+  }
+}
+
+void Protocol::send_frame(uint8_t id, uint8_t op, BinStatus status, const uint8_t *payload,
+                          size_t len) {
+  uint8_t packet[kBinMaxPacket];
+  if (len > sizeof(packet) - 5) {
+    len = sizeof(packet) - 5;
+  }
+  packet[0] = id;
+  packet[1] = op;
+  packet[2] = static_cast<uint8_t>(status);
+  if (len > 0) {
+    memcpy(packet + 3, payload, len);
+  }
+  uint16_t crc = crc16_ccitt(packet, len + 3);
+  packet[len + 3] = static_cast<uint8_t>(crc & 0xFF);
+  packet[len + 4] = static_cast<uint8_t>(crc >> 8);
+
+  uint8_t encoded[kBinMaxEncoded + 1];
+  size_t n = cobs_encode(packet, len + 5, encoded);
+  encoded[n++] = 0;
+  Serial.write(encoded, n);
+}
+
+void Protocol::handle_seq(const ParsedLine &parsed, const SwitchDriver::Snapshot &snap) {
+  const char *sub = parsed.argv[1];
+  bool load = strcmp(sub, "LOAD") == 0;
+  if (load || strcmp(sub, "ADD") == 0) {
+    if (snap.seq_active) {
+      Serial.println("ERR SEQ_ACTIVE");
+      return;
+    }
+    // Parse the whole line before touching the stored sequence
+    SequenceEngine::Step steps[SequenceEngine::kMaxSteps];
+    int step_count = parse_seq_steps(parsed, steps);
+    if (step_count < 0) {
+      Serial.println("ERR");
+      return;
+    }
+    if (!load && snap.seq_steps + step_count > SequenceEngine::kMaxSteps) {
+      Serial.println("ERR SEQ_FULL");
+      return;
+    }
+    load_sequence(steps, step_count, !load);
+    Serial.print(load ? "OK SEQ LOAD " : "OK SEQ ADD ");
+    Serial.println(load ? step_count : snap.seq_steps + step_count);
     return;
   }
 
-  if (upper.startsWith("TEST")) {
-    if (!test_mode_) {
+  if (strcmp(sub, "RUN") == 0) {
+    uint32_t loops = 1;
+    bool external = false;
+    if (!parse_seq_run(parsed, loops, external)) {
       Serial.println("ERR");
       return;
     }
-    String tokens[3];
-    int count = split_tokens(upper, tokens, 3);
-    if (count == 1 || (count >= 2 && tokens[1] == "ON")) {
-      uint32_t interval_ms = test_mode_->interval_ms();
-      if (count == 3) {
-        uint32_t parsed = 0;
-        if (!parse_uint32(tokens[2], parsed)) {
-          Serial.println("ERR");
-          return;
-        }
-        interval_ms = parsed;
-      }
-      test_mode_->start(interval_ms);
-      Serial.println("OK TEST ON");
-      print_test_status();
+    if (snap.test_active) {
+      Serial.println("ERR TEST_ACTIVE");
       return;
     }
-    if (count == 2 && tokens[1] == "OFF") {
-      test_mode_->stop();
-      Serial.println("OK TEST OFF");
+    if (snap.seq_active || snap.seq_steps == 0) {
+      Serial.println(snap.seq_active ? "ERR SEQ_ACTIVE" : "ERR SEQ_EMPTY");
       return;
     }
-    if (count == 2 && tokens[1] == "STEP") {
-      test_mode_->step_once();
-      Serial.println("OK TEST STEP");
-      print_test_status();
+    driver_.seq_run(loops, external);
+    Serial.println("OK SEQ RUN");
+    return;
+  }
+
+  if (strcmp(sub, "SWEEP") == 0) {
+    // One pass of the VdP + Hall sweep; replaces the stored sequence
+    uint32_t dwell_us = 0;
+    bool external = false;
+    if (!parse_seq_run(parsed, dwell_us, external)) {
+      Serial.println("ERR");
       return;
     }
-    Serial.println("ERR");
+    if (snap.test_active) {
+      Serial.println("ERR TEST_ACTIVE");
+      return;
+    }
+    if (snap.seq_active) {
+      Serial.println("ERR SEQ_ACTIVE");
+      return;
+    }
+    SequenceEngine::Step steps[SequenceEngine::kMaxSteps];
+    int step_count = sweep_steps(steps, SequenceEngine::kMaxSteps, dwell_us);
+    load_sequence(steps, step_count, false);
+    driver_.seq_run(1, external);
+    Serial.print("OK SEQ SWEEP ");
+    Serial.println(step_count);
     return;
   }
 
-  if (upper == "SWTEST") {
-    if (!switch_validator_) {
-      Serial.println("ERR NO_VALIDATOR");
-      status_led.set_state(LedState::ERROR);
+  if (parsed.argc == 2 && strcmp(sub, "CONTINUE") == 0) {
+    if (!snap.seq_field_wait) {
+      Serial.println("ERR SEQ_NOT_WAITING");
       return;
     }
-    status_led.set_state(LedState::BUSY);
-    SwitchValidator::ScanResult result = switch_validator_->scan();
-    switch_validator_->print_result(result);
-    Serial.println("OK SWTEST");
+    driver_.seq_continue();
+    Serial.println("OK SEQ CONTINUE");
+    return;
+  }
 
-    // Set LED based on connection count
-    if (result.connection_count == 0) {
-      status_led.set_state(LedState::SWTEST_FAIL);  // Red - no connections
-    } else if (result.connection_count == 16) {
-      status_led.set_state(LedState::SWTEST_PASS);  // Green - expected full matrix
-    } else {
-      status_led.set_state(LedState::SWTEST_PARTIAL);  // Yellow - partial
+  if (parsed.argc == 2 && strcmp(sub, "ABORT") == 0) {
+    driver_.seq_abort();
+    Serial.println("OK SEQ ABORT");
+    return;
+  }
+
+  if (parsed.argc == 2 && strcmp(sub, "SAVE") == 0) {
+    // Core 1 is parked while flash is written, so never mid-sequence, and
+    // never while the ADC's DMA needs core 1's interrupt
+    if (snap.seq_active || snap.adc_active) {
+      Serial.println(snap.seq_active ? "ERR SEQ_ACTIVE" : "ERR ADC_ACTIVE");
+      return;
+    }
+    if (!presets_.save_sequence(seq_steps_, seq_count_)) {
+      Serial.println("ERR FLASH");
+      return;
     }
+    Serial.print("OK SEQ SAVE ");
+    Serial.println(seq_count_);
     return;
   }
 
   Serial.println("ERR");
 }
 
-int Protocol::split_tokens(const String &line, String *tokens, int max_tokens) {
-  int count = 0;
-  int i = 0;
-  int len = line.length();
+// Replace (or extend) the sequence on core 1 and the copy kept for SEQ SAVE
+void Protocol::load_sequence(const SequenceEngine::Step *steps, int step_count, bool append) {
+  if (!append) {
+    driver_.seq_clear();
+    seq_count_ = 0;
+  }
+  for (int i = 0; i < step_count; i++) {
+    driver_.seq_add(steps[i]);
+    seq_steps_[seq_count_++] = steps[i];
+  }
+}
 
-  while (i < len && count < max_tokens) {
-    while (i < len && isspace(static_cast<unsigned char>(line[i]))) {
-      i++;
+// The SEQ SAVE sequence, loaded at boot so SEQ RUN works without a SEQ LOAD
+void Protocol::restore_sequence() {
+  SequenceEngine::Step steps[SequenceEngine::kMaxSteps];
+  int step_count = presets_.load_sequence(steps, SequenceEngine::kMaxSteps);
+  if (step_count > 0) {
+    load_sequence(steps, step_count, false);
+  }
+}
+
+// SEQ LOAD/ADD step tokens into `steps`; returns the step count or -1
+int Protocol::parse_seq_steps(const ParsedLine &parsed, SequenceEngine::Step *steps) {
+  int step_count = 0;
+  for (int i = 2; i < parsed.argc; i++) {
+    int n = parse_seq_token(parsed.argv[i], steps + step_count,
+                            SequenceEngine::kMaxSteps - step_count);
+    if (n <= 0) {
+      return -1;
     }
-    if (i >= len) {
-      break;
+    step_count += n;
+  }
+  return step_count;
+}
+
+bool Protocol::parse_seq_run(const ParsedLine &parsed, uint32_t &loops, bool &external) {
+  for (int i = 2; i < parsed.argc; i++) {
+    if (strcmp(parsed.argv[i], "EXT") == 0) {
+      external = true;
+    } else if (!parse_uint32(parsed.argv[i], loops)) {
+      return false;
     }
-    int start = i;
-    while (i < len && !isspace(static_cast<unsigned char>(line[i]))) {
-      i++;
+  }
+  return true;
+}
+
+// Step token: <target>[:<dwell_us>] where target is a preset id, four
+// pad letters in I+ I- V+ V- order, VDP for all VdP presets in order, or
+// SWEEP for the VdP + Hall sweep.
+int Protocol::parse_seq_token(const char *token, SequenceEngine::Step *steps, int max_steps) {
+  uint32_t dwell_us = 0;
+  const char *colon = strchr(token, ':');
+  size_t target_len = colon ? static_cast<size_t>(colon - token) : strlen(token);
+  if (colon && !parse_uint32(colon + 1, dwell_us)) {
+    return -1;
+  }
+  char target[6];
+  if (target_len == 0 || target_len >= sizeof(target)) {
+    return -1;
+  }
+  memcpy(target, token, target_len);
+  target[target_len] = '\0';
+
+  if (strcmp(target, "VDP") == 0) {
+    int count = static_cast<int>(vdp_config_count());
+    if (count > max_steps) {
+      return -1;
     }
-    tokens[count++] = line.substring(start, i);
+    for (int i = 0; i < count; i++) {
+      steps[i] = {vdp_configs()[i].state, vdp_configs()[i].cfg_id, dwell_us, 0};
+    }
+    return count;
+  }
+  if (strcmp(target, "SWEEP") == 0) {
+    return sweep_steps(steps, max_steps, dwell_us);
+  }
+
+  if (max_steps < 1) {
+    return -1;
+  }
+  SequenceEngine::Step &step = steps[0];
+  step.dwell_us = dwell_us;
+  step.field = 0;
+  if (target_len == 4) {
+    step.cfg_id = 0;
+    if (parse_pad_char(target[0], step.state.ip) && parse_pad_char(target[1], step.state.im) &&
+        parse_pad_char(target[2], step.state.vp) && parse_pad_char(target[3], step.state.vm) &&
+        Max328Router::route_safe(step.state)) {
+      return 1;
+    }
+    return -1;
+  }
+  uint32_t cfg_id = 0;
+  if (!parse_uint32(target, cfg_id) || cfg_id > 255 ||
+      !presets_.get(static_cast<uint8_t>(cfg_id), step.state, step.field)) {
+    return -1;
+  }
+  step.cfg_id = static_cast<uint8_t>(cfg_id);
+  return 1;
+}
+
+// The sweep_order() presets as steps; returns the step count or -1
+int Protocol::sweep_steps(SequenceEngine::Step *steps, int max_steps, uint32_t dwell_us) {
+  int count = static_cast<int>(sweep_length());
+  if (count > max_steps) {
+    return -1;
+  }
+  for (int i = 0; i < count; i++) {
+    SequenceEngine::Step &step = steps[i];
+    step.cfg_id = sweep_order()[i];
+    step.dwell_us = dwell_us;
+    presets_.get(step.cfg_id, step.state, step.field);
   }
   return count;
 }
 
-bool Protocol::parse_pad_token(const String &token, Pad &pad) {
-  if (token.length() != 1) {
+bool Protocol::parse_pad_token(const char *token, Pad &pad) {
+  if (token[0] == '\0' || token[1] != '\0') {
     return false;
   }
   return parse_pad_char(token[0], pad);
 }
 
-bool Protocol::parse_uint32(const String &token, uint32_t &value) {
-  char buf[16];
-  size_t len = token.length();
-  if (len == 0 || len >= sizeof(buf)) {
+void Protocol::handle_preset(const ParsedLine &parsed, const SwitchDriver::Snapshot &snap) {
+  PresetRequest request;
+  if (!parse_preset(parsed, request)) {
+    Serial.println("ERR");
+    return;
+  }
+  if (request.action == PresetAction::LIST) {
+    print_presets();
+    return;
+  }
+  // Core 1 is parked while flash is written, so never mid-sequence
+  if (snap.seq_active) {
+    Serial.println("ERR SEQ_ACTIVE");
+    return;
+  }
+  if (request.action == PresetAction::LOAD) {
+    if (!presets_.load()) {
+      Serial.println("ERR FLASH");
+      return;
+    }
+    Serial.print("OK PRESET LOAD ");
+    Serial.println(presets_.user_count());
+    return;
+  }
+  // Reading is fine; a write parks core 1 for tens of ms, and with it the
+  // DMA interrupt ProbeAdc counts buffers by
+  if (snap.adc_active) {
+    Serial.println("ERR ADC_ACTIVE");
+    return;
+  }
+
+  PresetStore::Result result = PresetStore::Result::OK;
+  if (request.action == PresetAction::SAVE) {
+    if (request.current) {
+      // Test mode routes every leg to the pad under test
+      if (snap.test_active) {
+        Serial.println("ERR TEST_ACTIVE");
+        return;
+      }
+      request.state = snap.state;
+    }
+    result = presets_.save(request.cfg_id, request.state, request.field);
+  } else {
+    result = presets_.remove(request.cfg_id);
+  }
+  switch (result) {
+    case PresetStore::Result::OK:
+      Serial.print(request.action == PresetAction::SAVE ? "OK PRESET SAVE " : "OK PRESET DEL ");
+      Serial.println(request.cfg_id);
+      return;
+    case PresetStore::Result::BAD_ID:
+      Serial.println("ERR PRESET_ID");
+      return;
+    case PresetStore::Result::NOT_FOUND:
+      Serial.println("ERR NO_PRESET");
+      return;
+    case PresetStore::Result::FLASH:
+      Serial.println("ERR FLASH");
+      return;
+    case PresetStore::Result::UNSAFE:
+      Serial.println("ERR ROUTE");
+      return;
+  }
+}
+
+// PRESET SAVE n [ip im vp vm] [+|-], PRESET DEL n, PRESET LOAD, PRESET LIST.
+// Ids below PresetStore::kFirstUserId are left for PresetStore to refuse.
+bool Protocol::parse_preset(const ParsedLine &parsed, PresetRequest &request) {
+  char *const *argv = parsed.argv;
+  const char *sub = argv[1];
+  request = {};
+  if (parsed.argc == 2) {
+    if (strcmp(sub, "LIST") == 0) {
+      request.action = PresetAction::LIST;
+      return true;
+    }
+    if (strcmp(sub, "LOAD") == 0) {
+      request.action = PresetAction::LOAD;
+      return true;
+    }
+    return false;
+  }
+  uint32_t cfg_id = 0;
+  if (!parse_uint32(argv[2], cfg_id) || cfg_id > 255) {
     return false;
   }
-  token.toCharArray(buf, sizeof(buf));
-  char *end = nullptr;
-  value = static_cast<uint32_t>(strtoul(buf, &end, 10));
-  return end && *end == '\0';
+  request.cfg_id = static_cast<uint8_t>(cfg_id);
+  if (strcmp(sub, "DEL") == 0) {
+    request.action = PresetAction::DEL;
+    return parsed.argc == 3;
+  }
+  if (strcmp(sub, "SAVE") != 0) {
+    return false;
+  }
+  request.action = PresetAction::SAVE;
+  int argc = parsed.argc;
+  const char *last = argv[argc - 1];
+  if (argc == 4 || argc == 8) {
+    if (strcmp(last, "+") == 0) {
+      request.field = 1;
+    } else if (strcmp(last, "-") == 0) {
+      request.field = -1;
+    } else {
+      return false;
+    }
+    argc--;
+  }
+  if (argc == 3) {
+    request.current = true;
+    return true;
+  }
+  RouterState &state = request.state;
+  return argc == 7 && parse_pad_token(argv[3], state.ip) && parse_pad_token(argv[4], state.im) &&
+         parse_pad_token(argv[5], state.vp) && parse_pad_token(argv[6], state.vm) &&
+         Max328Router::route_safe(state);
+}
+
+// One line per preset, built-in and saved, in id order
+void Protocol::print_presets() {
+  uint16_t count = 0;
+  for (uint16_t id = 1; id < 256; id++) {
+    const PresetStore::Entry &entry = presets_.entry(static_cast<uint8_t>(id));
+    if (entry.kind == PresetStore::Kind::NONE) {
+      continue;
+    }
+    Serial.print("PRESET CFG=");
+    Serial.print(id);
+    Serial.print(" USER=");
+    Serial.print(entry.kind == PresetStore::Kind::USER ? 1 : 0);
+    Serial.print(" FIELD=");
+    Serial.print(static_cast<int>(entry.field));
+    print_pads(entry.state);
+    count++;
+  }
+  Serial.print("OK PRESET LIST ");
+  Serial.println(count);
+}
+
+// READY FW=<version> PADS=<n> BOARDS=<n> MCP=<0|1>
+void Protocol::print_ready() {
+  SwitchDriver::Snapshot snap = driver_.snapshot();
+  uint8_t count = 0;
+  for (uint8_t b = 0; b < Max328Router::kMaxBoards; b++) {
+    count += (snap.boards >> b) & 1;
+  }
+  Serial.print("READY FW=");
+  Serial.print(FIRMWARE_VERSION);
+  Serial.print(" PADS=");
+  Serial.print(kPadCount);
+  Serial.print(" BOARDS=");
+  Serial.print(count);
+  Serial.print(" MCP=");
+  Serial.println(snap.boards & 1);
+}
+
+// Phase end times in us since reset (0: not reached yet) and the self-test
+void Protocol::print_boot() {
+  static const char *const kSelfTest[] = {"PENDING", "PASS", "FAIL"};
+  Serial.print("BOOT RESET=");
+  Serial.print(boot_log.watchdog_reset() ? "WATCHDOG" : "POWER");
+  for (uint8_t i = 0; i < BootLog::kPhaseCount; i++) {
+    BootLog::Phase phase = static_cast<BootLog::Phase>(i);
+    Serial.print(" ");
+    Serial.print(BootLog::name(phase));
+    Serial.print("_US=");
+    Serial.print(boot_log.at_us(phase));
+  }
+  Serial.print(" SELFTEST=");
+  Serial.print(kSelfTest[static_cast<uint8_t>(boot_log.self_test())]);
+  Serial.print(" CACHED=");
+  Serial.println(boot_log.cached() ? 1 : 0);
 }
 
 void Protocol::print_state() {
-  const RouterState &state = router_.state();
+  SwitchDriver::Snapshot snap = driver_.snapshot();
   Serial.print("STATE CFG=");
-  Serial.print(router_.cfg_id());
-  Serial.print(" IP=");
-  Serial.print(pad_to_char(state.ip));
-  Serial.print(" IM=");
-  Serial.print(pad_to_char(state.im));
-  Serial.print(" VP=");
-  Serial.print(pad_to_char(state.vp));
-  Serial.print(" VM=");
-  Serial.println(pad_to_char(state.vm));
+  Serial.print(snap.cfg_id);
+  print_pads(snap.state);
 }
 
-void Protocol::print_ok_set(const RouterState &state) {
-  Serial.print("OK SET IP=");
+void Protocol::print_board_state(const SwitchDriver::Snapshot &snap, uint8_t board) {
+  Serial.print("STATE BOARD=");
+  Serial.print(board);
+  Serial.print(" CFG=");
+  Serial.print(snap.board_cfg_id[board]);
+  print_pads(snap.board_state[board]);
+}
+
+// " IP=x IM=x VP=x VM=x" and the line end
+void Protocol::print_pads(const RouterState &state) {
+  Serial.print(" IP=");
   Serial.print(pad_to_char(state.ip));
   Serial.print(" IM=");
   Serial.print(pad_to_char(state.im));
@@ -276,25 +1660,59 @@ void Protocol::print_ok_set(const RouterState &state) {
 void Protocol::print_help() {
   Serial.println("PING -> PONG");
   Serial.println("VERSION -> firmware version");
-  Serial.println("CFG n (1-4) -> apply VDP preset");
+  Serial.print("CFG n (1-");
+  Serial.print(vdp_config_count());
+  Serial.print(", Hall ");
+  Serial.print(hall_configs()[0].cfg_id);
+  Serial.print("-");
+  Serial.print(hall_configs()[hall_config_count() - 1].cfg_id);
+  Serial.print(", saved ");
+  Serial.print(PresetStore::kFirstUserId);
+  Serial.println("-255) -> apply preset");
   Serial.println("CFGTEST -> verify current config routing");
   Serial.println("ENMASK m (0-15) -> enable mask for IP/IM/VP/VM");
-  Serial.println("SET ip im vp vm (A-D) -> apply routing");
+  Serial.print("SET ip im vp vm (A-");
+  Serial.print(pad_to_char(static_cast<Pad>(kPadCount - 1)));
+  Serial.println(") -> apply routing");
   Serial.println("STATE? -> report current state");
+  Serial.println("READY? -> capability line, as sent at boot");
+  Serial.println("BOOT? -> boot phase times (us since reset) and self-test");
+  Serial.println("BOARD n|ALL CFG/SET/ENMASK/STATE? ... -> address switch matrix n (0-7)");
+  Serial.println("BOARDS? -> list switch matrices found");
   Serial.println("TEST ON [ms] -> start test mode");
   Serial.println("TEST STEP -> advance one step");
   Serial.println("TEST OFF -> stop test mode");
   Serial.println("TEST? -> report test status");
-  Serial.println("SWTEST -> scan full MAX328 matrix");
+  Serial.println("SWTEST [SLOW] -> scan full MAX328 matrix (SLOW: one cell at a time)");
+  Serial.println("I2C CLOCK hz (100000|400000|1000000) -> MCP23017 bus clock");
+  Serial.println("I2C? -> bus clock and transaction counts");
+  Serial.println("SEQ LOAD|ADD step... -> step = n|ABCD|VDP|SWEEP[:dwell_us]");
+  Serial.println("SEQ RUN [loops] [EXT] -> run sequence (0 = until abort)");
+  Serial.println("SEQ SWEEP [dwell_us] [EXT] -> run the VdP + Hall sweep once");
+  Serial.println("SEQ CONTINUE -> resume after SEQ FIELD (field set)");
+  Serial.println("SEQ ABORT -> stop sequence");
+  Serial.println("SEQ SAVE -> keep the loaded sequence in flash (reloaded at boot)");
+  Serial.println("SEQ? -> report sequence status");
+  Serial.println("PRESET SAVE n [ip im vp vm] [+|-] -> store routing (default: current) as CFG n");
+  Serial.println("PRESET DEL n -> remove a saved preset");
+  Serial.println("PRESET LIST -> all presets, ends with OK PRESET LIST count");
+  Serial.println("PRESET LOAD -> read the saved presets from flash again");
+  Serial.println("STATS? -> timing counters, ends with STATS END");
+  Serial.println("STATS RESET -> clear the counters");
+  Serial.println("EVT ON|OFF -> stream routing events (EVT seq=...)");
+  Serial.println("EVT? -> event stream status and drop count");
+  Serial.println("ADC START [hz] [avg] [n] [DRIVE] -> sample J1-J4, stream ADC seq=... lines");
+  Serial.println("ADC STOP -> stop sampling");
+  Serial.println("ADC? -> acquisition status and overrun/drop counts");
+  Serial.println("cmd; cmd; ... -> run as one batch, replies then OK BATCH n");
+  Serial.println("BEGIN ... END -> same, one command per line");
+  Serial.println("MODE BIN -> switch to binary framed mode (COBS + CRC16)");
   Serial.println("HELP -> this message");
 }
 
 void Protocol::print_test_status() {
-  if (!test_mode_) {
-    Serial.println("TEST ACTIVE=0");
-    return;
-  }
-  uint8_t mask = test_mode_->current_enable_mask();
+  SwitchDriver::Snapshot snap = driver_.snapshot();
+  uint8_t mask = snap.test_enable_mask;
   const char *line = "MULTI";
   if (mask == Max328Router::kEnableIp) {
     line = "IP";
@@ -308,13 +1726,78 @@ void Protocol::print_test_status() {
     line = "NONE";
   }
   Serial.print("TEST ACTIVE=");
-  Serial.print(test_mode_->active() ? 1 : 0);
+  Serial.print(snap.test_active ? 1 : 0);
   Serial.print(" AUTO=");
-  Serial.print(test_mode_->auto_run() ? 1 : 0);
+  Serial.print(snap.test_auto ? 1 : 0);
   Serial.print(" INTERVAL_MS=");
-  Serial.print(test_mode_->interval_ms());
+  Serial.print(snap.test_interval_ms);
   Serial.print(" PAD=");
-  Serial.print(pad_to_char(test_mode_->current_pad()));
+  Serial.print(pad_to_char(snap.test_pad));
   Serial.print(" EN=");
   Serial.println(line);
 }
+
+void Protocol::print_seq_status() {
+  SwitchDriver::Snapshot snap = driver_.snapshot();
+  Serial.print("SEQ STEPS=");
+  Serial.print(snap.seq_steps);
+  Serial.print(" ACTIVE=");
+  Serial.print(snap.seq_active ? 1 : 0);
+  Serial.print(" STEP=");
+  Serial.print(snap.seq_active ? snap.seq_step_index + 1 : 0);
+  Serial.print(" LOOPS=");
+  Serial.print(snap.seq_loops_done);
+  Serial.print(" EXT=");
+  Serial.print(snap.seq_external ? 1 : 0);
+  Serial.print(" FIELD_WAIT=");
+  Serial.print(snap.seq_field_wait ? 1 : 0);
+  Serial.print(" TRIG_IN=");
+  Serial.print(snap.seq_triggers);
+  Serial.print(" TRIG_EARLY=");
+  Serial.print(snap.seq_early_triggers);
+  Serial.print(" TRIG_MISSED=");
+  Serial.println(snap.seq_missed_triggers);
+}
+
+// Core 0 counters, then core 1 prints its own and STATS END
+void Protocol::print_stats() {
+  sample_heap();
+  Serial.print("STATS SINCE_US=");
+  Serial.println(time_us_64() - stats_since_us_);
+  for (size_t i = 0; i < kCommandTableSize; i++) {
+    if (command_time_[i].count() == 0) {
+      continue;
+    }
+    Serial.print("STATS CMD ");
+    Serial.print(command_at(i)->name);
+    command_time_[i].print(Serial);
+  }
+  Serial.print("STATS LOOP0");
+  loop_timer_.period().print(Serial);
+  Serial.print("STATS SERIAL RX_LINES=");
+  Serial.print(rx_lines_);
+  Serial.print(" TOO_LONG=");
+  Serial.print(rx_too_long_);
+  Serial.print(" OUT_DROPPED=");
+  Serial.println(driver_.output().dropped() - out_dropped_base_);
+  Serial.print("STATS HEAP FREE=");
+  Serial.print(rp2040.getFreeHeap());
+  Serial.print(" MIN_FREE=");
+  Serial.print(heap_min_free_);
+  Serial.print(" TOTAL=");
+  Serial.println(rp2040.getTotalHeap());
+  driver_.stats_print();
+}
+
+void Protocol::reset_stats() {
+  stats_since_us_ = time_us_64();
+  for (PerfHistogram &h : command_time_) {
+    h.reset();
+  }
+  loop_timer_.reset();
+  rx_lines_ = 0;
+  rx_too_long_ = 0;
+  out_dropped_base_ = driver_.output().dropped();
+  heap_sample_us_ = stats_since_us_;
+  heap_min_free_ = rp2040.getFreeHeap();
+}
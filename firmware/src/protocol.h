@@ -2,32 +2,170 @@
 
 #include <Arduino.h>
 
+#include "binary_frame.h"
+#include "command_parser.h"
+#include "event_log.h"
 #include "max328_router.h"
+#include "perf_stats.h"
+#include "preset_store.h"
+#include "probe_adc.h"
+#include "sequence_engine.h"
+#include "switch_driver.h"
 
 #define FIRMWARE_VERSION "2.0.0"
 
-class TestMode;
-class SwitchValidator;
-
 class Protocol {
  public:
-  explicit Protocol(Max328Router &router, TestMode *test_mode = nullptr,
-                    SwitchValidator *switch_validator = nullptr);
+  // Runs on core 0; all switching goes through `driver` on core 1
+  explicit Protocol(SwitchDriver &driver);
+  // Built-in presets only; the first update() reads the preset store and
+  // hands a saved sequence to `driver`, after READY
   void begin();
   void update();
+  // The READY capability line; setup() sends it once core 1 is ready
+  void announce_ready();
 
  private:
-  Max328Router &router_;
-  TestMode *test_mode_;
-  SwitchValidator *switch_validator_;
-  String line_;
-
-  void handle_line(const String &line);
-  int split_tokens(const String &line, String *tokens, int max_tokens);
-  bool parse_pad_token(const String &token, Pad &pad);
-  bool parse_uint32(const String &token, uint32_t &value);
+  enum class Mode : uint8_t { ASCII, BINARY };
+  enum class TestAction : uint8_t { START, STOP, STEP };
+  enum class PresetAction : uint8_t { SAVE, DEL, LOAD, LIST };
+
+  // PRESET SAVE n [ip im vp vm] [+|-]; without pads the current routing
+  struct PresetRequest {
+    PresetAction action;
+    uint8_t cfg_id;
+    bool current;
+    RouterState state;
+    int8_t field;
+  };
+
+  // ADC START [rate_hz] [average] [records] [DRIVE] or ADC STOP
+  struct AdcRequest {
+    bool start;
+    uint32_t rate_hz;
+    uint32_t average;
+    uint32_t records;
+    bool drive;
+  };
+
+  // Routing target built up from CFG/SET/ENMASK
+  struct Route {
+    RouterState state;
+    uint8_t cfg_id;
+    uint8_t enable_mask;
+  };
+
+  // A batch ("a; b; c" or BEGIN ... END) is stored as text in batch_; each
+  // step is one ';'-separated segment of it.
+  struct BatchStep {
+    uint16_t offset;
+    uint16_t len;
+  };
+  static constexpr size_t kBatchSize = 512;
+  static constexpr uint8_t kMaxBatchSteps = 16;
+
+  // Serial bytes are read in bulk into rx_; lines are assembled in line_
+  // and tokenized there in place, so parsing never allocates.
+  static constexpr size_t kRxSize = 256;
+  static constexpr size_t kMaxLine = 120;
+  static_assert(ParsedLine::kMaxTokens >= SequenceEngine::kMaxSteps + 2,
+                "SEQ LOAD must fit a full sequence");
+  // Free heap is sampled this often for the STATS? low-water mark
+  static constexpr uint32_t kHeapSampleUs = 10000;
+
+  SwitchDriver &driver_;
+  bool boot_pending_;  // preset store not read yet
+  PresetStore presets_;
+  // What core 1 was last told to load, for SEQ SAVE
+  SequenceEngine::Step seq_steps_[SequenceEngine::kMaxSteps];
+  uint8_t seq_count_;
+  Mode mode_;
+  uint8_t rx_[kRxSize];
+  uint16_t rx_head_;
+  uint16_t rx_tail_;
+  char line_[kMaxLine + 1];
+  size_t line_len_;
+  bool line_overflow_;  // the current line has passed kMaxLine
+  // TEST ON/STEP reply, printed once core 1 has applied the step
+  const char *test_reply_;
+  // Last SETTLED reported (SwitchDriver::Snapshot::settled_count)
+  uint32_t settled_count_;
+  // EVT ON: EventLog records are sent as they arrive; otherwise discarded
+  bool streaming_;
+  uint32_t events_dropped_;  // EventLog::dropped() as last reported
+  uint32_t adc_dropped_;     // ProbeAdc::dropped() as last reported
+  bool collecting_;  // between BEGIN and END
+  bool batch_overflow_;
+  bool batch_active_;
+  char batch_[kBatchSize + 1];
+  size_t batch_len_;
+  BatchStep batch_steps_[kMaxBatchSteps];
+  uint8_t batch_count_;
+  uint8_t batch_next_;
+  // Binary mode: COBS bytes received since the last 0x00
+  uint8_t frame_[kBinMaxEncoded];
+  size_t frame_len_;
+  bool frame_overflow_;
+  // STATS? counters (core 0); core 1 keeps its own in SwitchDriver
+  uint64_t stats_since_us_;
+  PerfHistogram command_time_[kCommandTableSize];  // by command_index()
+  LoopTimer loop_timer_;
+  uint32_t rx_lines_;
+  uint32_t rx_too_long_;
+  uint32_t out_dropped_base_;  // OutputRing::dropped() at the last reset
+  uint64_t heap_sample_us_;
+  int heap_min_free_;
+
+  void finish_boot();
+  void fill_rx();
+  void flush_test_reply();
+  void forward_output();
+  void forward_events();
+  void print_event(const EventLog::Event &event);
+  void forward_adc();
+  void print_adc_record(const ProbeAdc::Record &record);
+  void report_settled();
+  void sample_heap();
+  void print_stats();
+  void reset_stats();
+  void handle_line(char *line, size_t len);
+  void execute(const ParsedLine &parsed);
+  bool parse_route(const ParsedLine &parsed, Route &route);
+  // board: the BOARD target token for an addressed command
+  void print_route_reply(CommandId id, const Route &route, const char *board = nullptr);
+  bool parse_board_command(const ParsedLine &parsed, uint8_t &boards, ParsedLine &sub);
+  Route board_route(const SwitchDriver::Snapshot &snap, uint8_t board);
+  bool parse_i2c_clock(const ParsedLine &parsed, uint32_t &hz);
+  bool parse_test(const ParsedLine &parsed, TestAction &action, uint32_t &interval_ms);
+  void collect_line(char *line, size_t len);
+  void start_batch();
+  bool batch_command_ok(const ParsedLine &parsed);
+  void load_batch_step(uint8_t index, ParsedLine &parsed);
+  void run_batch();
+  bool is_route_command(const ParsedLine &parsed);
+  void handle_frame_byte(uint8_t c);
+  void handle_frame(const uint8_t *packet, size_t len);
+  void send_frame(uint8_t id, uint8_t op, BinStatus status, const uint8_t *payload = nullptr,
+                  size_t len = 0);
+  void handle_seq(const ParsedLine &parsed, const SwitchDriver::Snapshot &snap);
+  int parse_seq_steps(const ParsedLine &parsed, SequenceEngine::Step *steps);
+  bool parse_seq_run(const ParsedLine &parsed, uint32_t &loops, bool &external);
+  void load_sequence(const SequenceEngine::Step *steps, int step_count, bool append);
+  void restore_sequence();
+  int parse_seq_token(const char *token, SequenceEngine::Step *steps, int max_steps);
+  int sweep_steps(SequenceEngine::Step *steps, int max_steps, uint32_t dwell_us);
+  bool parse_pad_token(const char *token, Pad &pad);
+  void handle_preset(const ParsedLine &parsed, const SwitchDriver::Snapshot &snap);
+  bool parse_preset(const ParsedLine &parsed, PresetRequest &request);
+  void print_presets();
+  bool parse_adc(const ParsedLine &parsed, AdcRequest &request);
+  void print_adc_status(const SwitchDriver::Snapshot &snap);
+  void print_ready();
+  void print_boot();
   void print_state();
-  void print_ok_set(const RouterState &state);
+  void print_board_state(const SwitchDriver::Snapshot &snap, uint8_t board);
+  void print_pads(const RouterState &state);
   void print_help();
   void print_test_status();
+  void print_seq_status();
 };
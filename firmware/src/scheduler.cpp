@@ -0,0 +1,106 @@
+#include "scheduler.h"
+
+#include <hardware/sync.h>
+#include <pico/time.h>
+
+uint64_t deadline_from_micros(uint32_t deadline_us) {
+  uint64_t now = time_us_64();
+  int32_t remaining = static_cast<int32_t>(deadline_us - static_cast<uint32_t>(now));
+  return remaining > 0 ? now + static_cast<uint32_t>(remaining) : now;
+}
+
+Scheduler::Scheduler() : tasks_{}, count_(0), every_pass_mask_(0), woken_{} {}
+
+uint8_t Scheduler::add(TaskFn fn, void *context, bool every_pass) {
+  if (count_ >= kMaxTasks) {
+    return kMaxTasks;
+  }
+  tasks_[count_] = {fn, context, every_pass, 0};
+  if (every_pass) {
+    every_pass_mask_ |= 1u << count_;
+  }
+  return count_++;
+}
+
+void Scheduler::reset() {
+  for (uint8_t i = 0; i < count_; i++) {
+    tasks_[i].deadline_us = 0;
+  }
+}
+
+void Scheduler::wake(uint8_t task) {
+  woken_[task].store(1, std::memory_order_release);
+  __sev();
+}
+
+void Scheduler::wake_all() {
+  for (uint8_t i = 0; i < count_; i++) {
+    woken_[i].store(1, std::memory_order_release);
+  }
+  __sev();
+}
+
+// A wake() between the load and the clear is folded into this one; the task
+// has not run yet, so it still sees what the wake was for.
+uint32_t Scheduler::take_woken() {
+  uint32_t woken = 0;
+  for (uint8_t i = 0; i < count_; i++) {
+    if (woken_[i].load(std::memory_order_acquire) != 0) {
+      woken_[i].store(0, std::memory_order_relaxed);
+      woken |= 1u << i;
+    }
+  }
+  return woken;
+}
+
+uint64_t Scheduler::run_once() {
+  uint32_t pending = every_pass_mask_ | take_woken();
+  uint32_t ran = 0;
+  for (;;) {
+    uint64_t now = time_us_64();
+    uint8_t next = count_;
+    for (uint8_t i = 0; i < count_; i++) {
+      if (!(ran & (1u << i)) && ((pending & (1u << i)) || tasks_[i].deadline_us <= now)) {
+        next = i;
+        break;
+      }
+    }
+    if (next == count_) {
+      break;
+    }
+    ran |= 1u << next;
+    pending &= ~(1u << next);
+    Task &task = tasks_[next];
+    task.deadline_us = task.fn(task.context, now);
+    pending |= take_woken();
+  }
+  // Woken again after it ran in this pass: run it on the next one
+  for (uint8_t i = 0; i < count_; i++) {
+    if (pending & (1u << i)) {
+      woken_[i].store(1, std::memory_order_relaxed);
+    }
+  }
+
+  uint64_t deadline = kNoDeadline;
+  for (uint8_t i = 0; i < count_; i++) {
+    if (tasks_[i].deadline_us < deadline) {
+      deadline = tasks_[i].deadline_us;
+    }
+  }
+  return deadline;
+}
+
+void Scheduler::idle(uint64_t deadline_us) {
+  for (uint8_t i = 0; i < count_; i++) {
+    if (woken_[i].load(std::memory_order_acquire) != 0) {
+      return;
+    }
+  }
+  uint64_t limit = time_us_64() + kMaxSleepUs;
+  if (deadline_us > limit) {
+    deadline_us = limit;
+  }
+  best_effort_wfe_or_timeout(from_us_since_boot(deadline_us));
+}
+
+void Scheduler::run() { idle(run_once()); }
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+// Deadline of a task that has nothing timed pending; it runs again when
+// woken (or on every pass, if added with every_pass).
+constexpr uint64_t kNoDeadline = UINT64_MAX;
+
+// micros() is the low word of time_us_64(); widen a micros() deadline no
+// more than 2^31 us away. Past deadlines come back as now.
+uint64_t deadline_from_micros(uint32_t deadline_us);
+
+// Cooperative run-to-completion scheduler, one per core. Each task returns
+// the time_us_64() at which it next needs to run. Priority is the order the
+// tasks were added in, first = highest. A pass runs every task that is due
+// or woken, highest priority first; a task woken while the pass is under way
+// goes ahead of lower-priority ones still waiting. With nothing
+// due the core sleeps in WFE until the earliest deadline, an interrupt (USB,
+// trigger input) or an SEV from the other core.
+class Scheduler {
+ public:
+  static constexpr uint8_t kMaxTasks = 8;
+  // Longest sleep, in case a wake-up event is missed
+  static constexpr uint32_t kMaxSleepUs = 1000;
+
+  using TaskFn = uint64_t (*)(void *context, uint64_t now_us);
+
+  Scheduler();
+  // Add the next task, below those already added. every_pass tasks run after
+  // every wake-up, for work signalled by an interrupt (USB RX, GPIO) rather
+  // than a deadline. Returns the index for wake(), or kMaxTasks if full.
+  uint8_t add(TaskFn fn, void *context, bool every_pass = false);
+  // Make every task due now (after boot, or when the clock was reset)
+  void reset();
+  // Run `task` on the next pass. Safe from either core and from interrupts:
+  // each task has its own flag, set with a plain store, since the M0+ has no
+  // atomic read-modify-write. A wake is only a hint to run; the data behind
+  // it is published by the queue or snapshot the task reads.
+  void wake(uint8_t task);
+  void wake_all();
+  // Run every due task once; returns the earliest deadline left
+  uint64_t run_once();
+  // Sleep until `deadline_us`, a wake() or an interrupt
+  void idle(uint64_t deadline_us);
+  // run_once() then idle()
+  void run();
+
+ private:
+  struct Task {
+    TaskFn fn;
+    void *context;
+    bool every_pass;
+    uint64_t deadline_us;
+  };
+
+  Task tasks_[kMaxTasks];
+  uint8_t count_;
+  uint32_t every_pass_mask_;
+  std::atomic<uint8_t> woken_[kMaxTasks];
+
+  // Tasks woken since the last call, as a mask; clears their flags
+  uint32_t take_woken();
+};
@@ -0,0 +1,270 @@
+#include "sequence_engine.h"
+
+#include <pico/time.h>
+
+#include "scheduler.h"
+
+SequenceEngine *SequenceEngine::instance_ = nullptr;
+
+SequenceEngine::SequenceEngine(Max328Router &router, Print &out)
+    : router_(router),
+      out_(out),
+      step_count_(0),
+      step_index_(0),
+      loops_(1),
+      loops_done_(0),
+      external_(false),
+      phase_(Phase::IDLE),
+      run_start_us_(0),
+      step_start_us_(0),
+      field_(0),
+      dwell_end_us_(0),
+      alarm_id_(0),
+      alarm_stage_(0),
+      dwell_done_(false),
+      trigger_in_(false),
+      trigger_window_(TRIGGER_CLOSED),
+      trigger_in_us_(0),
+      triggers_(0),
+      early_triggers_(0),
+      missed_triggers_(0),
+      latency_pending_(false) {}
+
+void SequenceEngine::begin() {
+  instance_ = this;
+  pinMode(kTriggerOutPin, OUTPUT);
+  digitalWrite(kTriggerOutPin, LOW);
+  pinMode(kTriggerInPin, INPUT_PULLDOWN);
+  attachInterrupt(digitalPinToInterrupt(kTriggerInPin), trigger_in_isr, RISING);
+}
+
+void SequenceEngine::clear() { step_count_ = 0; }
+
+bool SequenceEngine::add_step(const Step &step) {
+  if (step_count_ >= kMaxSteps) {
+    return false;
+  }
+  steps_[step_count_++] = step;
+  return true;
+}
+
+bool SequenceEngine::run(uint32_t loops, bool external_trigger) {
+  if (step_count_ == 0 || phase_ != Phase::IDLE) {
+    return false;
+  }
+  loops_ = loops;
+  loops_done_ = 0;
+  external_ = external_trigger;
+  step_index_ = 0;
+  field_ = 0;
+  triggers_ = 0;
+  early_triggers_ = 0;
+  missed_triggers_ = 0;
+  latency_pending_ = false;
+  trigger_window_ = external_ ? TRIGGER_EARLY : TRIGGER_CLOSED;
+  run_start_us_ = micros();
+  start_step();
+  return true;
+}
+
+void SequenceEngine::abort() {
+  if (phase_ == Phase::IDLE) {
+    return;
+  }
+  trigger_window_ = TRIGGER_CLOSED;
+  cancel_alarm_if_armed();
+  digitalWrite(kTriggerOutPin, LOW);
+  phase_ = Phase::IDLE;
+}
+
+bool SequenceEngine::continue_run() {
+  if (phase_ != Phase::FIELD_WAIT) {
+    return false;
+  }
+  route_step();
+  return true;
+}
+
+void SequenceEngine::update() {
+  switch (phase_) {
+    case Phase::IDLE:
+    case Phase::FIELD_WAIT:
+      return;
+
+    case Phase::ROUTING: {
+      if (router_.busy()) {
+        return;
+      }
+      // Settled: fire the DMM trigger and time the dwell from its edge
+      trigger_in_ = false;
+      if (external_) {
+        trigger_window_ = TRIGGER_OPEN;
+      }
+      dwell_done_ = false;
+      alarm_stage_ = 0;
+      digitalWrite(kTriggerOutPin, HIGH);
+      uint32_t trigger_us = micros();
+      alarm_id_ = add_alarm_in_us(kTriggerPulseUs, alarm_callback, this, true);
+      phase_ = Phase::DWELL;
+
+      const Step &step = steps_[step_index_];
+      dwell_end_us_ =
+          trigger_us + (step.dwell_us > kTriggerPulseUs ? step.dwell_us : kTriggerPulseUs);
+      out_.print("SEQ STEP n=");
+      out_.print(step_index_ + 1);
+      out_.print(" cfg=");
+      out_.print(step.cfg_id);
+      out_.print(" t_us=");
+      out_.print(trigger_us - run_start_us_);
+      out_.print(" settle_us=");
+      out_.print(trigger_us - step_start_us_);
+      if (step.field != 0) {
+        out_.print(" field=");
+        out_.print(static_cast<int>(step.field));
+      }
+      out_.println();
+      return;
+    }
+
+    case Phase::DWELL:
+      if (external_ ? !trigger_in_ : !dwell_done_) {
+        return;
+      }
+      latency_pending_ = external_;
+      finish_step();
+      return;
+  }
+}
+
+uint64_t SequenceEngine::next_deadline_us() const {
+  switch (phase_) {
+    case Phase::ROUTING:
+      return router_.busy() ? router_.next_deadline_us() : 0;
+    case Phase::DWELL:
+      if (external_) {
+        return trigger_in_ ? 0 : kNoDeadline;
+      }
+      // The alarm fires on core 0, so core 1 wakes on the deadline instead
+      return dwell_done_ ? 0 : deadline_from_micros(dwell_end_us_);
+    default:
+      return kNoDeadline;
+  }
+}
+
+bool SequenceEngine::active() const { return phase_ != Phase::IDLE; }
+
+bool SequenceEngine::external_trigger() const { return external_; }
+
+uint8_t SequenceEngine::step_count() const { return step_count_; }
+
+uint8_t SequenceEngine::step_index() const { return step_index_; }
+
+uint32_t SequenceEngine::loops_done() const { return loops_done_; }
+
+bool SequenceEngine::waiting_for_field() const { return phase_ == Phase::FIELD_WAIT; }
+
+uint32_t SequenceEngine::triggers() const { return triggers_; }
+
+uint32_t SequenceEngine::early_triggers() const { return early_triggers_; }
+
+uint32_t SequenceEngine::missed_triggers() const { return missed_triggers_; }
+
+const PerfHistogram &SequenceEngine::trigger_latency() const { return trigger_latency_; }
+
+void SequenceEngine::reset_trigger_latency() { trigger_latency_.reset(); }
+
+int64_t SequenceEngine::alarm_callback(int32_t, void *user_data) {
+  SequenceEngine *self = static_cast<SequenceEngine *>(user_data);
+  if (self->alarm_stage_ == 0) {
+    // End of the trigger pulse
+    digitalWrite(kTriggerOutPin, LOW);
+    self->alarm_stage_ = 1;
+    uint32_t dwell_us = self->steps_[self->step_index_].dwell_us;
+    if (!self->external_ && dwell_us > kTriggerPulseUs) {
+      // Re-arm relative to the previous deadline, i.e. the trigger edge
+      return static_cast<int64_t>(dwell_us - kTriggerPulseUs);
+    }
+  }
+  if (!self->external_) {
+    self->dwell_done_ = true;
+  }
+  return 0;
+}
+
+void SequenceEngine::trigger_in_isr() {
+  SequenceEngine *self = instance_;
+  if (!self || self->trigger_window_ == TRIGGER_CLOSED) {
+    return;
+  }
+  self->triggers_ = self->triggers_ + 1;
+  if (self->trigger_window_ == TRIGGER_EARLY) {
+    self->early_triggers_ = self->early_triggers_ + 1;
+    return;
+  }
+  if (self->trigger_in_) {
+    self->missed_triggers_ = self->missed_triggers_ + 1;
+    return;
+  }
+  self->trigger_in_us_ = micros();
+  self->trigger_in_ = true;
+}
+
+void SequenceEngine::start_step() {
+  const Step &step = steps_[step_index_];
+  if (step.field != field_) {
+    // The board cannot move the magnet; hold until the host has
+    field_ = step.field;
+    phase_ = Phase::FIELD_WAIT;
+    // Held for the host: the wait is not trigger latency
+    latency_pending_ = false;
+    out_.print("SEQ FIELD n=");
+    out_.print(step_index_ + 1);
+    out_.print(" field=");
+    out_.println(static_cast<int>(step.field));
+    return;
+  }
+  route_step();
+}
+
+void SequenceEngine::route_step() {
+  const Step &step = steps_[step_index_];
+  step_start_us_ = micros();
+  router_.apply_state(step.state, step.cfg_id);
+  if (latency_pending_) {
+    latency_pending_ = false;
+    trigger_latency_.record(router_.transition_us() - trigger_in_us_);
+  }
+  phase_ = Phase::ROUTING;
+}
+
+void SequenceEngine::finish_step() {
+  if (external_) {
+    // Edges before the next settled pulse are early
+    trigger_window_ = TRIGGER_EARLY;
+  }
+  // An external edge can arrive before the trigger pulse has ended
+  cancel_alarm_if_armed();
+  digitalWrite(kTriggerOutPin, LOW);
+
+  step_index_++;
+  if (step_index_ >= step_count_) {
+    step_index_ = 0;
+    loops_done_++;
+    if (loops_ != 0 && loops_done_ >= loops_) {
+      trigger_window_ = TRIGGER_CLOSED;
+      latency_pending_ = false;
+      phase_ = Phase::IDLE;
+      out_.print("SEQ DONE loops=");
+      out_.println(loops_done_);
+      return;
+    }
+  }
+  start_step();
+}
+
+void SequenceEngine::cancel_alarm_if_armed() {
+  if (alarm_id_ > 0) {
+    cancel_alarm(alarm_id_);
+    alarm_id_ = 0;
+  }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "max328_router.h"
+#include "perf_stats.h"
+
+// Runs an uploaded list of routing steps on the board. Each step is routed,
+// then the "settled" trigger is pulsed for the DMM and the step is held for
+// its dwell time (timed by a hardware alarm), or until a rising edge on the
+// trigger input when running in external mode. A step whose field marker
+// differs from the one before it waits for continue_run() first, so the host
+// can reverse the magnet between the Hall halves of a sweep.
+//
+// In external mode the trigger input interrupt runs on core 1 (attached in
+// begin(), called from setup1()), so an edge wakes core 1 from WFE and the
+// sequence task routes the next step in the same scheduler pass, once the
+// task running when the edge came has returned (at most a ProbeAdc chunk
+// while a run is active). The time from the edge to the start of that
+// step's first I2C write is recorded.
+class SequenceEngine {
+ public:
+  static constexpr uint8_t kMaxSteps = 32;
+  static constexpr uint8_t kTriggerOutPin = 24;  // D24 -> DMM external trigger in
+  static constexpr uint8_t kTriggerInPin = 25;   // D25 <- DMM trigger out
+  static constexpr uint32_t kTriggerPulseUs = 10;
+
+  struct Step {
+    RouterState state;
+    uint8_t cfg_id;  // 0 for explicit routing
+    uint32_t dwell_us;
+    int8_t field;  // Hall field direction, +1 or -1; 0 for no field
+  };
+
+  // `out` receives the SEQ STEP / SEQ FIELD / SEQ DONE lines
+  explicit SequenceEngine(Max328Router &router, Print &out = Serial);
+
+  void begin();
+  void clear();
+  bool add_step(const Step &step);
+  // loops = number of passes through the list, 0 = until abort()
+  bool run(uint32_t loops, bool external_trigger);
+  void abort();
+  // Route the step held by SEQ FIELD; false if the run is not waiting
+  bool continue_run();
+  void update();
+  // time_us_64() at which update() next has work, or kNoDeadline while
+  // waiting for the host or the trigger input (its interrupt wakes the core)
+  uint64_t next_deadline_us() const;
+
+  bool active() const;
+  bool external_trigger() const;
+  uint8_t step_count() const;
+  uint8_t step_index() const;
+  uint32_t loops_done() const;
+  bool waiting_for_field() const;
+
+  // Trigger-in edges during the current (or last) external run. Early edges
+  // came before the step's settled pulse and were ignored; missed edges came
+  // while the previous one was still pending, so a step was lost.
+  uint32_t triggers() const;
+  uint32_t early_triggers() const;
+  uint32_t missed_triggers() const;
+  // Trigger-in edge to the first I2C write of the step it starts
+  const PerfHistogram &trigger_latency() const;
+  void reset_trigger_latency();
+
+ private:
+  enum class Phase : uint8_t { IDLE, FIELD_WAIT, ROUTING, DWELL };
+  // How trigger_in_isr() treats an edge
+  enum TriggerWindow : uint8_t { TRIGGER_CLOSED, TRIGGER_EARLY, TRIGGER_OPEN };
+
+  Max328Router &router_;
+  Print &out_;
+  Step steps_[kMaxSteps];
+  uint8_t step_count_;
+  uint8_t step_index_;
+  uint32_t loops_;
+  uint32_t loops_done_;
+  bool external_;
+  Phase phase_;
+  uint32_t run_start_us_;
+  uint32_t step_start_us_;  // routing of the current step began
+  int8_t field_;            // field marker of the last routed step
+  uint32_t dwell_end_us_;   // internal trigger: alarm sets dwell_done_ here
+  int32_t alarm_id_;
+  volatile uint8_t alarm_stage_;
+  volatile bool dwell_done_;
+  volatile bool trigger_in_;
+  volatile uint8_t trigger_window_;
+  volatile uint32_t trigger_in_us_;  // micros() of the pending edge
+  volatile uint32_t triggers_;
+  volatile uint32_t early_triggers_;
+  volatile uint32_t missed_triggers_;
+  bool latency_pending_;  // the next route_step() was started by an edge
+  PerfHistogram trigger_latency_;
+
+  static SequenceEngine *instance_;
+  // Runs in the timer IRQ of the default alarm pool, which is on core 0 even
+  // though the engine runs on core 1; it only touches the trigger pin and the
+  // volatile flags above.
+  static int64_t alarm_callback(int32_t id, void *user_data);
+  static void trigger_in_isr();
+
+  void start_step();
+  void route_step();
+  void finish_step();
+  void cancel_alarm_if_armed();
+};
@@ -1,12 +1,17 @@
 #include "status_led.h"
-#include <Adafruit_NeoPixel.h>
+#include <hardware/sync.h>
+#include <pico/time.h>
 
-static Adafruit_NeoPixel pixel(1, StatusLed::kNeoPixelPin, NEO_GRB + NEO_KHZ800);
+#include "scheduler.h"
+#include "ws2812_pio.h"
+
+static Ws2812Pio pixel;
 
 StatusLed status_led;
 
 StatusLed::StatusLed()
-    : current_state_(LedState::OFF),
+    : requested_state_(LedState::OFF),
+      current_state_(LedState::OFF),
       last_update_(0),
       pulse_value_(0),
       pulse_rising_(true) {}
@@ -15,45 +20,52 @@ void StatusLed::begin() {
   pinMode(kNeoPixelPower, OUTPUT);
   digitalWrite(kNeoPixelPower, HIGH);  // Enable NeoPixel power
 
-  pixel.begin();
-  pixel.setBrightness(kBrightness);
-  pixel.clear();
+  pixel.begin(kNeoPixelPin);
+  pixel.set_brightness(kBrightness);
+  pixel.set_color(0, 0, 0);
   pixel.show();
 
-  set_state(LedState::READY);
+  requested_state_ = LedState::READY;
+  show_state(LedState::READY);
 }
 
 void StatusLed::set_state(LedState state) {
+  requested_state_ = state;
+  // Wake core 0 if it is sleeping; its LED task runs on every pass
+  __sev();
+}
+
+void StatusLed::show_state(LedState state) {
   current_state_ = state;
 
   switch (state) {
     case LedState::OFF:
-      pixel.setPixelColor(0, 0, 0, 0);
+      pixel.set_color(0, 0, 0);
       break;
     case LedState::READY:
-      pixel.setPixelColor(0, 0, 50, 0);  // Dim green
+      pixel.set_color(0, 50, 0);  // Dim green
       break;
     case LedState::BUSY:
-      pixel.setPixelColor(0, 0, 0, 50);  // Blue
+      pixel.set_color(0, 0, 50);  // Blue
       break;
     case LedState::ERROR:
     case LedState::SWTEST_FAIL:
-      pixel.setPixelColor(0, 100, 0, 0);  // Red
+      pixel.set_color(100, 0, 0);  // Red
       break;
     case LedState::SUCCESS:
     case LedState::SWTEST_PASS:
-      pixel.setPixelColor(0, 0, 100, 0);  // Bright green
+      pixel.set_color(0, 100, 0);  // Bright green
       break;
     case LedState::WARNING:
     case LedState::SWTEST_PARTIAL:
-      pixel.setPixelColor(0, 100, 50, 0);  // Yellow/orange
+      pixel.set_color(100, 50, 0);  // Yellow/orange
       break;
   }
   pixel.show();
 }
 
 void StatusLed::set_color(uint8_t r, uint8_t g, uint8_t b) {
-  pixel.setPixelColor(0, r, g, b);
+  pixel.set_color(r, g, b);
   pixel.show();
 }
 
@@ -62,12 +74,20 @@ void StatusLed::off() {
 }
 
 void StatusLed::update() {
+  // A color held back while the previous frame latched
+  if (pixel.pending()) {
+    pixel.show();
+  }
+  LedState requested = requested_state_;
+  if (requested != current_state_) {
+    show_state(requested);
+  }
   if (current_state_ != LedState::BUSY) {
     return;
   }
 
   uint32_t now = millis();
-  if (now - last_update_ < 20) {
+  if (now - last_update_ < kPulseStepMs) {
     return;
   }
   last_update_ = now;
@@ -84,6 +104,17 @@ void StatusLed::update() {
     }
   }
 
-  pixel.setPixelColor(0, 0, 0, pulse_value_);
+  pixel.set_color(0, 0, pulse_value_);
   pixel.show();
 }
+
+uint64_t StatusLed::next_deadline_us() const {
+  uint64_t deadline = pixel.pending() ? pixel.next_show_us() : kNoDeadline;
+  if (current_state_ != LedState::BUSY) {
+    return deadline;
+  }
+  uint64_t now = time_us_64();
+  int32_t remaining_ms = static_cast<int32_t>(last_update_ + kPulseStepMs - millis());
+  uint64_t pulse = remaining_ms > 0 ? now + static_cast<uint64_t>(remaining_ms) * 1000 : now;
+  return pulse < deadline ? pulse : deadline;
+}
@@ -19,20 +19,27 @@ class StatusLed {
   static constexpr uint8_t kNeoPixelPin = 16;
   static constexpr uint8_t kNeoPixelPower = 17;
   static constexpr uint8_t kBrightness = 30;  // 0-255, keep low to avoid glare
+  static constexpr uint32_t kPulseStepMs = 20;
 
   StatusLed();
   void begin();
+  // Safe from either core: records the state, update() shows it
   void set_state(LedState state);
-  void set_color(uint8_t r, uint8_t g, uint8_t b);
+  void set_color(uint8_t r, uint8_t g, uint8_t b);  // core 0 only
   void off();
   void pulse();  // Call in loop for pulsing effect when busy
-  void update(); // Call in loop for animations
+  void update(); // Call in loop (core 0) to show state changes and animate
+  // time_us_64() of the next pulse step, or kNoDeadline if not animating
+  uint64_t next_deadline_us() const;
 
  private:
+  volatile LedState requested_state_;
   LedState current_state_;
   uint32_t last_update_;
   uint8_t pulse_value_;
   bool pulse_rising_;
+
+  void show_state(LedState state);
 };
 
 extern StatusLed status_led;
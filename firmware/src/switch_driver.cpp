@@ -0,0 +1,554 @@
+#include "switch_driver.h"
+
+#include <hardware/sync.h>
+#include <string.h>
+
+#include "boot_log.h"
+#include "status_led.h"
+#include "vdp_sequences.h"
+
+SwitchDriver::SwitchDriver(Max328Router &router, TestMode &test_mode,
+                           SwitchValidator &switch_validator, SequenceEngine &sequence,
+                           ProbeAdc &adc, OutputRing &out, EventLog &events)
+    : router_(router),
+      test_mode_(test_mode),
+      switch_validator_(switch_validator),
+      sequence_(sequence),
+      adc_(adc),
+      out_(out),
+      events_(events),
+      posted_(0),
+      taken_(0),
+      ready_(false),
+      snapshot_seq_(0),
+      snapshot_{},
+      scanning_(false),
+      op_txn_start_(0),
+      settle_pending_(false),
+      settle_cfg_id_(0),
+      settle_tag_(0),
+      settle_start_us_(0),
+      settled_count_(0),
+      settled_cfg_id_(0),
+      settled_tag_(0),
+      settled_t_us_(0),
+      boot_pending_(false),
+      self_test_pending_(false) {
+  // Highest priority first
+  command_task_ = scheduler_.add([](void *self, uint64_t) {
+    return static_cast<SwitchDriver *>(self)->run_commands();
+  }, this);
+  router_task_ = scheduler_.add([](void *self, uint64_t) {
+    Max328Router &router = static_cast<SwitchDriver *>(self)->router_;
+    router.update();
+    return router.next_deadline_us();
+  }, this);
+  // Every pass: the trigger input interrupt wakes core 1 without a deadline
+  scheduler_.add([](void *self, uint64_t) {
+    SwitchDriver *driver = static_cast<SwitchDriver *>(self);
+    driver->sequence_.update();
+    driver->wake_router_if_busy();
+    return driver->sequence_.next_deadline_us();
+  }, this, true);
+  scheduler_.add([](void *self, uint64_t) {
+    SwitchDriver *driver = static_cast<SwitchDriver *>(self);
+    driver->test_mode_.update();
+    driver->wake_router_if_busy();
+    return driver->test_mode_.next_deadline_us();
+  }, this);
+  // Every pass: the DMA interrupt for a filled buffer wakes core 1. One
+  // chunk per run, so a woken sequence step goes ahead of the rest.
+  scheduler_.add([](void *self, uint64_t) {
+    ProbeAdc &adc = static_cast<SwitchDriver *>(self)->adc_;
+    adc.update();
+    return adc.next_deadline_us();
+  }, this, true);
+}
+
+// Ready as soon as CFG 1 is written; its settle and the self-test finish in
+// update(), after core 0 has sent READY.
+void SwitchDriver::begin() {
+  uint8_t cached_boards = 0;
+  bool cached = boot_log.load_cache(cached_boards);
+  router_.begin(cached ? cached_boards : 0xFF);
+  boot_log.mark(BootLog::Phase::MCP);
+  test_mode_.begin();
+  switch_validator_.begin();
+  sequence_.begin();
+  adc_.begin();
+
+  RouterState default_state;
+  if (router_.boards() != 0 && get_vdp_config(1, default_state)) {
+    router_.apply_state(default_state, 1);
+  }
+  boot_log.mark(BootLog::Phase::ROUTE);
+  boot_pending_ = true;
+  if (cached && router_.boards() == cached_boards) {
+    boot_log.set_self_test(true, cached_boards, true);
+    boot_log.mark(BootLog::Phase::SELFTEST);
+    self_test_pending_ = false;
+  } else {
+    self_test_pending_ = true;
+  }
+
+  scheduler_.reset();
+  publish();
+  ready_.store(true, std::memory_order_release);
+}
+
+void SwitchDriver::update() {
+  loop_timer_.tick();
+  uint64_t deadline = scheduler_.run_once();
+  finish_settle();
+  if (boot_pending_ && !router_.busy()) {
+    finish_boot();
+  }
+  publish();
+  scheduler_.idle(deadline);
+}
+
+bool SwitchDriver::ready() const { return ready_.load(std::memory_order_acquire); }
+
+bool SwitchDriver::apply_state(const RouterState &state, uint8_t cfg_id, uint32_t start_us,
+                               uint8_t tag) {
+  Command cmd = {};
+  cmd.op = Op::APPLY_STATE;
+  cmd.state = state;
+  cmd.cfg_id = cfg_id;
+  cmd.tag = tag;
+  cmd.value = start_us;
+  return post(cmd);
+}
+
+bool SwitchDriver::apply_route(const RouterState &state, uint8_t cfg_id, uint8_t enable_mask,
+                               uint32_t start_us, uint8_t tag) {
+  Command cmd = {};
+  cmd.op = Op::APPLY_ROUTE;
+  cmd.state = state;
+  cmd.cfg_id = cfg_id;
+  cmd.mask = enable_mask;
+  cmd.tag = tag;
+  cmd.value = start_us;
+  return post(cmd);
+}
+
+bool SwitchDriver::stage_route(uint8_t board, const RouterState &state, uint8_t cfg_id,
+                               uint8_t enable_mask) {
+  Command cmd = {};
+  cmd.op = Op::STAGE_ROUTE;
+  cmd.board = board;
+  cmd.state = state;
+  cmd.cfg_id = cfg_id;
+  cmd.mask = enable_mask;
+  return post(cmd);
+}
+
+bool SwitchDriver::commit_routes(uint8_t cfg_id, uint32_t start_us, uint8_t tag) {
+  Command cmd = {};
+  cmd.op = Op::COMMIT_ROUTES;
+  cmd.cfg_id = cfg_id;
+  cmd.tag = tag;
+  cmd.value = start_us;
+  return post(cmd);
+}
+
+bool SwitchDriver::set_enable_mask(uint8_t mask) {
+  Command cmd = {};
+  cmd.op = Op::SET_ENABLE_MASK;
+  cmd.mask = mask;
+  return post(cmd);
+}
+
+bool SwitchDriver::set_i2c_clock(uint32_t hz) {
+  Command cmd = {};
+  cmd.op = Op::SET_I2C_CLOCK;
+  cmd.value = hz;
+  return post(cmd);
+}
+
+bool SwitchDriver::swtest(bool slow) {
+  Command cmd = {};
+  cmd.op = Op::SWTEST;
+  cmd.value = slow ? 1 : 0;
+  return post(cmd);
+}
+
+bool SwitchDriver::cfgtest() {
+  Command cmd = {};
+  cmd.op = Op::CFGTEST;
+  return post(cmd);
+}
+
+bool SwitchDriver::test_start(uint32_t interval_ms) {
+  Command cmd = {};
+  cmd.op = Op::TEST_START;
+  cmd.value = interval_ms;
+  return post(cmd);
+}
+
+bool SwitchDriver::test_step() {
+  Command cmd = {};
+  cmd.op = Op::TEST_STEP;
+  return post(cmd);
+}
+
+bool SwitchDriver::test_stop() {
+  Command cmd = {};
+  cmd.op = Op::TEST_STOP;
+  return post(cmd);
+}
+
+bool SwitchDriver::seq_clear() {
+  Command cmd = {};
+  cmd.op = Op::SEQ_CLEAR;
+  return post(cmd);
+}
+
+bool SwitchDriver::seq_add(const SequenceEngine::Step &step) {
+  Command cmd = {};
+  cmd.op = Op::SEQ_ADD;
+  cmd.state = step.state;
+  cmd.cfg_id = step.cfg_id;
+  cmd.value = step.dwell_us;
+  cmd.field = step.field;
+  return post(cmd);
+}
+
+bool SwitchDriver::seq_run(uint32_t loops, bool external_trigger) {
+  Command cmd = {};
+  cmd.op = Op::SEQ_RUN;
+  cmd.value = loops;
+  cmd.external = external_trigger;
+  return post(cmd);
+}
+
+bool SwitchDriver::seq_continue() {
+  Command cmd = {};
+  cmd.op = Op::SEQ_CONTINUE;
+  return post(cmd);
+}
+
+bool SwitchDriver::seq_abort() {
+  Command cmd = {};
+  cmd.op = Op::SEQ_ABORT;
+  return post(cmd);
+}
+
+bool SwitchDriver::stats_print() {
+  Command cmd = {};
+  cmd.op = Op::STATS_PRINT;
+  return post(cmd);
+}
+
+bool SwitchDriver::stats_reset() {
+  Command cmd = {};
+  cmd.op = Op::STATS_RESET;
+  return post(cmd);
+}
+
+bool SwitchDriver::adc_start(uint32_t rate_hz, uint32_t average, uint32_t records, bool drive) {
+  Command cmd = {};
+  cmd.op = Op::ADC_START;
+  cmd.value = rate_hz;
+  cmd.average = average;
+  cmd.count = records;
+  cmd.external = drive;
+  return post(cmd);
+}
+
+bool SwitchDriver::adc_stop() {
+  Command cmd = {};
+  cmd.op = Op::ADC_STOP;
+  return post(cmd);
+}
+
+bool SwitchDriver::caught_up() const {
+  return taken_.load(std::memory_order_acquire) == posted_;
+}
+
+SwitchDriver::Snapshot SwitchDriver::snapshot() const {
+  for (;;) {
+    uint32_t seq = snapshot_seq_.load(std::memory_order_acquire);
+    if (seq & 1) {
+      continue;
+    }
+    Snapshot copy = snapshot_;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (snapshot_seq_.load(std::memory_order_relaxed) == seq) {
+      return copy;
+    }
+  }
+}
+
+OutputRing &SwitchDriver::output() { return out_; }
+
+EventLog &SwitchDriver::events() { return events_; }
+
+ProbeAdc &SwitchDriver::adc() { return adc_; }
+
+bool SwitchDriver::post(const Command &cmd) {
+  if (!commands_.push(cmd)) {
+    return false;
+  }
+  posted_++;
+  scheduler_.wake(command_task_);
+  return true;
+}
+
+uint64_t SwitchDriver::run_commands() {
+  Command cmd;
+  bool any = false;
+  while (commands_.pop(cmd)) {
+    execute(cmd);
+    any = true;
+  }
+  if (any) {
+    // A command can start or stop the work of any other task
+    scheduler_.wake_all();
+  }
+  return kNoDeadline;
+}
+
+void SwitchDriver::execute(const Command &cmd) {
+  op_txn_start_ = router_.transactions();
+  switch (cmd.op) {
+    case Op::STAGE_ROUTE:
+      router_.stage(cmd.board, cmd.state, cmd.cfg_id, cmd.mask);
+      break;
+    case Op::APPLY_STATE:
+    case Op::APPLY_ROUTE:
+    case Op::COMMIT_ROUTES:
+      settle_start_us_ = cmd.value;
+      settle_cfg_id_ = cmd.cfg_id;
+      settle_tag_ = cmd.tag;
+      settle_pending_ = true;
+      if (cmd.op == Op::COMMIT_ROUTES) {
+        router_.commit();
+      } else if (cmd.op == Op::APPLY_ROUTE) {
+        router_.apply_state(cmd.state, cmd.cfg_id, cmd.mask);
+      } else {
+        router_.apply_state(cmd.state, cmd.cfg_id);
+      }
+      break;
+    case Op::SET_ENABLE_MASK:
+      router_.set_enable_mask(cmd.mask);
+      break;
+    case Op::SET_I2C_CLOCK:
+      router_.port().set_clock(cmd.value);
+      break;
+    case Op::SWTEST:
+      // Let core 0 go on serving queries while the scan runs
+      scanning_ = true;
+      take();
+      run_swtest(cmd.value != 0);
+      scanning_ = false;
+      publish();
+      return;
+    case Op::CFGTEST:
+      scanning_ = true;
+      take();
+      run_cfgtest();
+      scanning_ = false;
+      publish();
+      return;
+    case Op::TEST_START:
+      test_mode_.start(cmd.value);
+      break;
+    case Op::TEST_STEP:
+      test_mode_.step_once();
+      break;
+    case Op::TEST_STOP:
+      test_mode_.stop();
+      break;
+    case Op::SEQ_CLEAR:
+      sequence_.clear();
+      break;
+    case Op::SEQ_ADD:
+      sequence_.add_step({cmd.state, cmd.cfg_id, cmd.value, cmd.field});
+      break;
+    case Op::SEQ_RUN:
+      sequence_.run(cmd.value, cmd.external);
+      break;
+    case Op::SEQ_CONTINUE:
+      sequence_.continue_run();
+      break;
+    case Op::SEQ_ABORT:
+      sequence_.abort();
+      break;
+    case Op::STATS_PRINT:
+      print_stats();
+      break;
+    case Op::STATS_RESET:
+      reset_stats();
+      break;
+    case Op::ADC_START:
+      adc_.start(cmd.value, cmd.average, cmd.count, cmd.external);
+      break;
+    case Op::ADC_STOP:
+      adc_.stop();
+      break;
+  }
+  take();
+}
+
+void SwitchDriver::wake_router_if_busy() {
+  if (router_.busy()) {
+    scheduler_.wake(router_task_);
+  }
+}
+
+// Publish the effect of a command, then count it as picked up
+void SwitchDriver::take() {
+  publish();
+  taken_.store(taken_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  __sev();
+}
+
+void SwitchDriver::publish() {
+  // Zeroed so padding compares equal below
+  Snapshot next;
+  memset(&next, 0, sizeof(next));
+  next.state = router_.state();
+  next.cfg_id = router_.cfg_id();
+  next.enable_mask = router_.enable_mask();
+  next.boards = router_.boards();
+  for (uint8_t b = 0; b < Max328Router::kMaxBoards; b++) {
+    next.board_state[b] = router_.state(b);
+    next.board_cfg_id[b] = router_.cfg_id(b);
+    next.board_enable_mask[b] = router_.enable_mask(b);
+  }
+  next.routing = router_.busy();
+  next.scanning = scanning_;
+  next.i2c_clock_hz = router_.port().clock();
+  next.i2c_txn = router_.transactions();
+  next.i2c_txn_op = next.i2c_txn - op_txn_start_;
+  next.settled_count = settled_count_;
+  next.settled_cfg_id = settled_cfg_id_;
+  next.settled_tag = settled_tag_;
+  next.settled_t_us = settled_t_us_;
+  next.test_active = test_mode_.active();
+  next.test_auto = test_mode_.auto_run();
+  next.test_pad = test_mode_.current_pad();
+  next.test_enable_mask = test_mode_.current_enable_mask();
+  next.test_interval_ms = test_mode_.interval_ms();
+  next.seq_active = sequence_.active();
+  next.seq_external = sequence_.external_trigger();
+  next.seq_field_wait = sequence_.waiting_for_field();
+  next.seq_steps = sequence_.step_count();
+  next.seq_step_index = sequence_.step_index();
+  next.seq_loops_done = sequence_.loops_done();
+  next.seq_triggers = sequence_.triggers();
+  next.seq_early_triggers = sequence_.early_triggers();
+  next.seq_missed_triggers = sequence_.missed_triggers();
+  next.adc_active = adc_.active();
+  next.adc_drive = adc_.drive();
+  next.adc_rate_hz = adc_.rate_hz();
+  next.adc_average = adc_.average();
+  next.adc_records = adc_.records();
+  next.adc_overruns = adc_.overruns();
+  if (memcmp(&next, &snapshot_, sizeof(next)) == 0) {
+    return;
+  }
+
+  uint32_t seq = snapshot_seq_.load(std::memory_order_relaxed);
+  snapshot_seq_.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  snapshot_ = next;
+  snapshot_seq_.store(seq + 2, std::memory_order_release);
+  // Core 0 may be asleep waiting for this
+  __sev();
+}
+
+// First time the router is idle after begin(): CFG 1 (or whatever replaced
+// it) has settled, so the outputs can be read back
+void SwitchDriver::finish_boot() {
+  boot_pending_ = false;
+  boot_log.mark(BootLog::Phase::SETTLED);
+  if (self_test_pending_) {
+    self_test_pending_ = false;
+    boot_log.set_self_test(router_.verify(), router_.boards(), false);
+    boot_log.mark(BootLog::Phase::SELFTEST);
+  }
+}
+
+void SwitchDriver::finish_settle() {
+  if (!settle_pending_ || router_.busy()) {
+    return;
+  }
+  settle_pending_ = false;
+  // Core 0 reports it, as text or as a binary event
+  settled_cfg_id_ = settle_cfg_id_;
+  settled_tag_ = settle_tag_;
+  settled_t_us_ = router_.settled_us() - settle_start_us_;
+  settled_count_++;
+}
+
+void SwitchDriver::run_swtest(bool slow) {
+  status_led.set_state(LedState::BUSY);
+  router_.wait_settled();
+  finish_settle();
+  publish();
+  SwitchValidator::ScanResult result =
+      slow ? switch_validator_.scan_slow() : switch_validator_.scan();
+  switch_validator_.print_result(result);
+  out_.println("OK SWTEST");
+  bool full = result.connection_count ==
+              SwitchValidator::kNumChips * SwitchValidator::kNumOutputs;
+  events_.record(EventLog::Type::SWTEST, 0, full ? 1 : 0, 0, result.connection_count);
+
+  // Set LED based on connection count
+  if (result.connection_count == 0) {
+    status_led.set_state(LedState::SWTEST_FAIL);  // Red - no connections
+  } else if (full) {
+    status_led.set_state(LedState::SWTEST_PASS);  // Green - expected full matrix
+  } else {
+    status_led.set_state(LedState::SWTEST_PARTIAL);  // Yellow - partial
+  }
+}
+
+void SwitchDriver::run_cfgtest() {
+  status_led.set_state(LedState::BUSY);
+  router_.wait_settled();
+  finish_settle();
+  publish();
+
+  // Get current router state and verify the routing
+  const RouterState &state = router_.state();
+  bool pass = switch_validator_.verify_config(
+      static_cast<uint8_t>(state.ip),
+      static_cast<uint8_t>(state.im),
+      static_cast<uint8_t>(state.vp),
+      static_cast<uint8_t>(state.vm));
+
+  events_.record(EventLog::Type::CFGTEST, 0, pass ? 1 : 0, router_.cfg_id());
+  if (pass) {
+    out_.println("OK CFGTEST PASS");
+    status_led.set_state(LedState::SWTEST_PASS);
+  } else {
+    out_.println("ERR CFGTEST FAIL");
+    status_led.set_state(LedState::SWTEST_FAIL);
+  }
+}
+
+void SwitchDriver::print_stats() {
+  out_.print("STATS LOOP1");
+  loop_timer_.period().print(out_);
+  for (uint8_t b = 0; b < Max328Router::kMaxBoards; b++) {
+    if (router_.present(b)) {
+      out_.print("STATS I2C BOARD=");
+      out_.print(b);
+      router_.port(b).transaction_time().print(out_);
+    }
+  }
+  out_.print("STATS TRIG");
+  sequence_.trigger_latency().print(out_);
+  out_.println("STATS END");
+}
+
+void SwitchDriver::reset_stats() {
+  loop_timer_.reset();
+  for (uint8_t b = 0; b < Max328Router::kMaxBoards; b++) {
+    router_.port(b).reset_transaction_time();
+  }
+  sequence_.reset_trigger_latency();
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "event_log.h"
+#include "max328_router.h"
+#include "output_ring.h"
+#include "perf_stats.h"
+#include "probe_adc.h"
+#include "scheduler.h"
+#include "sequence_engine.h"
+#include "spsc_queue.h"
+#include "switch_validator.h"
+#include "test_mode.h"
+
+// Core 1 half of the firmware. It owns the MCP23017 and everything that
+// drives it (router, switch validator, test mode, sequence engine), and the
+// probe ADC. Core 0
+// posts commands through a lock-free queue and answers status queries from a
+// snapshot this class publishes, so USB traffic never waits on I2C, break or
+// settle intervals, and a long SWTEST does not stall the command parser.
+//
+// Core 1 work runs as scheduler tasks, by priority: commands, router
+// break/settle, sequence steps, test mode stepping, probe ADC buffers. Each
+// reports its next deadline; in between, core 1 sleeps until a deadline, a
+// posted command, the trigger input or a filled ADC buffer.
+class SwitchDriver {
+ public:
+  enum class Op : uint8_t {
+    APPLY_STATE,
+    APPLY_ROUTE,
+    STAGE_ROUTE,
+    COMMIT_ROUTES,
+    SET_ENABLE_MASK,
+    SET_I2C_CLOCK,
+    SWTEST,
+    CFGTEST,
+    TEST_START,
+    TEST_STEP,
+    TEST_STOP,
+    SEQ_CLEAR,
+    SEQ_ADD,
+    SEQ_RUN,
+    SEQ_CONTINUE,
+    SEQ_ABORT,
+    STATS_PRINT,
+    STATS_RESET,
+    ADC_START,
+    ADC_STOP,
+  };
+
+  struct Command {
+    Op op;
+    uint8_t cfg_id;     // APPLY_STATE/ROUTE, STAGE_ROUTE, COMMIT_ROUTES, SEQ_ADD
+    uint8_t tag;        // APPLY_STATE/ROUTE, COMMIT_ROUTES: binary request id,
+                        // echoed when settled
+    uint8_t mask;       // APPLY_ROUTE, STAGE_ROUTE, SET_ENABLE_MASK
+    uint8_t board;      // STAGE_ROUTE
+    int8_t field;       // SEQ_ADD
+    bool external;      // SEQ_RUN; ADC_START: drive the routed pads
+    RouterState state;  // APPLY_STATE/ROUTE, STAGE_ROUTE, SEQ_ADD
+    uint32_t value;     // micros() at receipt, interval_ms, dwell_us, loops, Hz or
+                        // SWTEST slow flag
+    uint32_t average;   // ADC_START: rounds per record
+    uint32_t count;     // ADC_START: records, 0 = until ADC_STOP
+  };
+
+  // State as of the last command core 1 picked up
+  struct Snapshot {
+    RouterState state;
+    uint8_t cfg_id;
+    uint8_t enable_mask;
+    // Per switch matrix; index 0 repeats state, cfg_id and enable_mask
+    uint8_t boards;  // bit n set if board n is present
+    RouterState board_state[Max328Router::kMaxBoards];
+    uint8_t board_cfg_id[Max328Router::kMaxBoards];
+    uint8_t board_enable_mask[Max328Router::kMaxBoards];
+    bool routing;   // break or settle in progress
+    bool scanning;  // SWTEST or CFGTEST still running (and printing)
+    uint32_t i2c_clock_hz;
+    uint32_t i2c_txn;     // MCP23017 transactions since boot, all boards
+    uint32_t i2c_txn_op;  // since the last command was picked up
+    // Bumped each time a CFG/SET finishes settling
+    uint32_t settled_count;
+    uint8_t settled_cfg_id;
+    uint8_t settled_tag;
+    uint32_t settled_t_us;  // from receipt of the command
+    bool test_active;
+    bool test_auto;
+    Pad test_pad;
+    uint8_t test_enable_mask;
+    uint32_t test_interval_ms;
+    bool seq_active;
+    bool seq_external;
+    bool seq_field_wait;  // held at SEQ FIELD until SEQ CONTINUE
+    uint8_t seq_steps;
+    uint8_t seq_step_index;
+    uint32_t seq_loops_done;
+    uint32_t seq_triggers;  // trigger-in edges of the current/last EXT run
+    uint32_t seq_early_triggers;
+    uint32_t seq_missed_triggers;
+    bool adc_active;
+    bool adc_drive;
+    uint32_t adc_rate_hz;
+    uint32_t adc_average;
+    uint32_t adc_records;   // of the current/last acquisition
+    uint32_t adc_overruns;  // since boot
+  };
+
+  // Deep enough for SEQ LOAD of a full sequence plus its SEQ_CLEAR
+  static constexpr size_t kQueueSize = 64;
+  static_assert(kQueueSize > SequenceEngine::kMaxSteps + 1, "queue too small for SEQ LOAD");
+
+  // `events` is the log `router` records into; SWTEST and CFGTEST results
+  // go there too
+  SwitchDriver(Max328Router &router, TestMode &test_mode, SwitchValidator &switch_validator,
+               SequenceEngine &sequence, ProbeAdc &adc, OutputRing &out, EventLog &events);
+
+  // Core 1: setup1() and loop1(). update() runs one scheduler pass, then
+  // sleeps until the next task is due. begin() does not wait for CFG 1 to
+  // settle; update() finishes it and the boot self-test (BootLog).
+  void begin();
+  void update();
+
+  // Core 0. The posting calls return false if the queue is full.
+  bool ready() const;
+  bool apply_state(const RouterState &state, uint8_t cfg_id, uint32_t start_us,
+                   uint8_t tag = 0);
+  // State and enable mask in one break/make/settle cycle (command batches)
+  bool apply_route(const RouterState &state, uint8_t cfg_id, uint8_t enable_mask,
+                   uint32_t start_us, uint8_t tag = 0);
+  // Route of one board, held until commit_routes() moves every staged board
+  // in one break/make/settle cycle. cfg_id is the one SETTLED reports.
+  bool stage_route(uint8_t board, const RouterState &state, uint8_t cfg_id,
+                   uint8_t enable_mask);
+  bool commit_routes(uint8_t cfg_id, uint32_t start_us, uint8_t tag = 0);
+  bool set_enable_mask(uint8_t mask);
+  bool set_i2c_clock(uint32_t hz);
+  // slow: one cell at a time with fixed delays (SwitchValidator::scan_slow)
+  bool swtest(bool slow = false);
+  bool cfgtest();
+  bool test_start(uint32_t interval_ms);
+  bool test_step();
+  bool test_stop();
+  bool seq_clear();
+  bool seq_add(const SequenceEngine::Step &step);
+  bool seq_run(uint32_t loops, bool external_trigger);
+  bool seq_continue();
+  bool seq_abort();
+  // Core 1 prints its half of STATS? (loop1 period, I2C transaction times,
+  // trigger latency) and the closing STATS END
+  bool stats_print();
+  bool stats_reset();
+  // ProbeAdc::start(); core 0 checks ProbeAdc::settings_ok() first
+  bool adc_start(uint32_t rate_hz, uint32_t average, uint32_t records, bool drive);
+  bool adc_stop();
+  // True once core 1 has picked up every posted command
+  bool caught_up() const;
+  Snapshot snapshot() const;
+  OutputRing &output();
+  EventLog &events();
+  ProbeAdc &adc();
+
+ private:
+  Max328Router &router_;
+  TestMode &test_mode_;
+  SwitchValidator &switch_validator_;
+  SequenceEngine &sequence_;
+  ProbeAdc &adc_;
+  OutputRing &out_;
+  EventLog &events_;
+
+  SpscQueue<Command, kQueueSize> commands_;
+  uint32_t posted_;               // core 0 only
+  std::atomic<uint32_t> taken_;   // written by core 1
+  std::atomic<bool> ready_;
+
+  // Seqlock: odd while core 1 is rewriting snapshot_
+  std::atomic<uint32_t> snapshot_seq_;
+  Snapshot snapshot_;
+
+  bool scanning_;
+  uint32_t op_txn_start_;
+  LoopTimer loop_timer_;
+
+  Scheduler scheduler_;
+  uint8_t command_task_;
+  uint8_t router_task_;
+
+  // CFG/SET picked up but not yet settled (core 1 only)
+  bool settle_pending_;
+  uint8_t settle_cfg_id_;
+  uint8_t settle_tag_;
+  uint32_t settle_start_us_;
+  uint32_t settled_count_;
+  uint8_t settled_cfg_id_;
+  uint8_t settled_tag_;
+  uint32_t settled_t_us_;
+  // CFG 1 from begin() not settled yet / expander readback still to do
+  bool boot_pending_;
+  bool self_test_pending_;
+
+  bool post(const Command &cmd);
+  // Scheduler tasks; each returns its next deadline
+  uint64_t run_commands();
+  // Sequence and test mode start transitions after the router task has run
+  void wake_router_if_busy();
+  void execute(const Command &cmd);
+  void take();
+  void publish();
+  void finish_settle();
+  void finish_boot();
+  void run_swtest(bool slow);
+  void run_cfgtest();
+  void print_stats();
+  void reset_stats();
+};
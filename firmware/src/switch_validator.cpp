@@ -1,10 +1,29 @@
 #include "switch_validator.h"
 
-constexpr uint8_t SwitchValidator::kOutputPins[];
+#include <hardware/gpio.h>
+
 constexpr uint8_t SwitchValidator::kInputPins[];
 constexpr Max328Router::ChipPins SwitchValidator::kChipPins[];
 
-SwitchValidator::SwitchValidator(Adafruit_MCP23X17 &mcp) : mcp_(mcp) {}
+namespace {
+
+constexpr uint32_t pin_mask(const uint8_t *pins, uint8_t count) {
+  uint32_t mask = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    mask |= 1u << pins[i];
+  }
+  return mask;
+}
+
+static_assert((SwitchValidator::kOutputMask & SwitchValidator::kInputMask) == 0,
+              "pad drive pins overlap the probe inputs");
+static_assert(pin_mask(SwitchValidator::kInputPins, SwitchValidator::kNumInputs) ==
+                  SwitchValidator::kInputMask,
+              "kInputMask out of sync with kInputPins");
+
+}  // namespace
+
+SwitchValidator::SwitchValidator(McpPort &port, Print &out) : port_(port), out_(out) {}
 
 void SwitchValidator::begin() {
   // Configure output pins (directly drive J5 pads)
@@ -27,23 +46,68 @@ void SwitchValidator::set_all_outputs_low() {
   }
 }
 
+// Each helper is at most one I2C write (none if the pins already match)
 void SwitchValidator::set_all_enables(bool enabled) {
-  for (uint8_t i = 0; i < kNumChips; i++) {
-    mcp_.digitalWrite(kChipPins[i].en, enabled ? HIGH : LOW);
-  }
+  port_.write(enabled ? Max328Router::kEnablePins : 0, Max328Router::kEnablePins);
 }
 
 void SwitchValidator::set_chip_address(const Max328Router::ChipPins &pins, uint8_t addr) {
-  mcp_.digitalWrite(pins.a0, (addr & 0x01) ? HIGH : LOW);
-  mcp_.digitalWrite(pins.a1, (addr & 0x02) ? HIGH : LOW);
-  mcp_.digitalWrite(pins.a2, (addr & 0x04) ? HIGH : LOW);
+  uint16_t mask = (1 << pins.a0) | (1 << pins.a1) | (1 << pins.a2);
+  uint16_t value = ((addr & 0x01) ? (1 << pins.a0) : 0) | ((addr & 0x02) ? (1 << pins.a1) : 0) |
+                   ((addr & 0x04) ? (1 << pins.a2) : 0);
+  port_.write(value, mask);
 }
 
 void SwitchValidator::set_chip_enable(const Max328Router::ChipPins &pins, bool enabled) {
-  mcp_.digitalWrite(pins.en, enabled ? HIGH : LOW);
+  port_.write(enabled ? (1 << pins.en) : 0, 1 << pins.en);
+}
+
+// Sample the probe inputs until they have held one value for kStableUs
+uint32_t SwitchValidator::read_inputs_stable() {
+  uint32_t start = micros();
+  uint32_t stable_since = start;
+  uint32_t value = gpio_get_all() & kInputMask;
+  while (true) {
+    uint32_t now = micros();
+    if (now - stable_since >= kStableUs || now - start >= kSettleTimeoutUs) {
+      return value;
+    }
+    uint32_t sample = gpio_get_all() & kInputMask;
+    if (sample != value) {
+      value = sample;
+      stable_since = now;
+    }
+  }
 }
 
 SwitchValidator::ScanResult SwitchValidator::scan() {
+  uint32_t start = micros();
+  ScanResult result = {};
+
+  for (uint8_t pad = 0; pad < kNumOutputs; pad++) {
+    // Pads low before the muxes move, then every chip on this pad
+    gpio_clr_mask(kOutputMask);
+    Pad p = static_cast<Pad>(pad);
+    port_.write(Max328Router::port_value({p, p, p, p}, Max328Router::kEnableAll));
+
+    gpio_set_mask(1u << kOutputPins[pad]);
+    uint32_t inputs = read_inputs_stable();
+    for (uint8_t chip = 0; chip < kNumChips; chip++) {
+      if (inputs & (1u << kInputPins[chip])) {
+        result.connections[chip][pad] = true;
+        result.connection_count++;
+      }
+    }
+  }
+
+  gpio_clr_mask(kOutputMask);
+  set_all_enables(false);
+  result.scan_us = micros() - start;
+  return result;
+}
+
+SwitchValidator::ScanResult SwitchValidator::scan_slow() {
+  uint32_t start = micros();
   ScanResult result;
   result.connection_count = 0;
 
@@ -92,63 +156,63 @@ SwitchValidator::ScanResult SwitchValidator::scan() {
   set_all_outputs_low();
   set_all_enables(false);
 
+  result.scan_us = micros() - start;
   return result;
 }
 
 void SwitchValidator::print_result(const ScanResult& result) {
-  Serial.println("SWTEST RESULT (MAX328 Switch Matrix):");
-  Serial.println("        PAD_A PAD_B PAD_C PAD_D");
-  Serial.println("        (S1)  (S2)  (S3)  (S4)");
+  out_.println("SWTEST RESULT (MAX328 Switch Matrix):");
+  out_.print("       ");
+  for (uint8_t pad = 0; pad < kNumOutputs; pad++) {
+    out_.print(" PAD_");
+    out_.print(pad_to_char(static_cast<Pad>(pad)));
+  }
+  out_.println();
+  out_.print("       ");
+  for (uint8_t pad = 0; pad < kNumOutputs; pad++) {
+    out_.print(" (S");
+    out_.print(pad + 1);
+    out_.print(pad + 1 < kNumOutputs ? ") " : ")");
+  }
+  out_.println();
 
   const char* chip_names[] = {"U1/J1", "U2/J2", "U3/J3", "U4/J4"};
 
   for (uint8_t chip = 0; chip < kNumChips; chip++) {
-    Serial.print(chip_names[chip]);
-    Serial.print(" ");
+    out_.print(chip_names[chip]);
+    out_.print(" ");
 
     for (uint8_t pad = 0; pad < kNumOutputs; pad++) {
-      Serial.print("  ");
-      Serial.print(result.connections[chip][pad] ? "X" : ".");
-      Serial.print("   ");
+      out_.print("  ");
+      out_.print(result.connections[chip][pad] ? "X" : ".");
+      out_.print("   ");
     }
-    Serial.println();
+    out_.println();
   }
 
-  Serial.print("CONNECTIONS: ");
-  Serial.println(result.connection_count);
+  out_.print("CONNECTIONS: ");
+  out_.println(result.connection_count);
+  out_.print("SCAN_US: ");
+  out_.println(result.scan_us);
 }
 
+// All four chips are routed at once; each is then checked by driving its
+// expected pad alone and reading its probe.
 bool SwitchValidator::verify_config(uint8_t ip_pad, uint8_t im_pad, uint8_t vp_pad, uint8_t vm_pad) {
   uint8_t expected_pads[4] = {ip_pad, im_pad, vp_pad, vm_pad};
   bool results[4] = {false, false, false, false};
 
-  for (uint8_t chip = 0; chip < kNumChips; chip++) {
-    // Disable all chips
-    set_all_enables(false);
-    delayMicroseconds(100);
-
-    // Enable only this chip
-    set_chip_enable(kChipPins[chip], true);
-    delayMicroseconds(100);
-
-    // Set address to the expected pad for this chip
-    uint8_t pad = expected_pads[chip];
-    set_chip_address(kChipPins[chip], pad);
-    delayMicroseconds(100);
-
-    // Drive the expected pad HIGH
-    set_all_outputs_low();
-    digitalWrite(kOutputPins[pad], HIGH);
-    delayMicroseconds(100);
+  gpio_clr_mask(kOutputMask);
+  RouterState state = {static_cast<Pad>(ip_pad), static_cast<Pad>(im_pad),
+                       static_cast<Pad>(vp_pad), static_cast<Pad>(vm_pad)};
+  port_.write(Max328Router::port_value(state, Max328Router::kEnableAll));
 
-    // Read this chip's input
-    results[chip] = (digitalRead(kInputPins[chip]) == HIGH);
-
-    // Disable this chip
-    set_chip_enable(kChipPins[chip], false);
+  for (uint8_t chip = 0; chip < kNumChips; chip++) {
+    gpio_put_masked(kOutputMask, 1u << kOutputPins[expected_pads[chip]]);
+    results[chip] = (read_inputs_stable() & (1u << kInputPins[chip])) != 0;
   }
 
-  set_all_outputs_low();
+  gpio_clr_mask(kOutputMask);
   set_all_enables(false);
 
   print_verify_result(ip_pad, im_pad, vp_pad, vm_pad,
@@ -161,22 +225,20 @@ void SwitchValidator::print_verify_result(uint8_t ip_pad, uint8_t im_pad,
                                           uint8_t vp_pad, uint8_t vm_pad,
                                           bool ip_ok, bool im_ok,
                                           bool vp_ok, bool vm_ok) {
-  const char pad_chars[] = "ABCD";
-
-  Serial.println("CFGTEST RESULT:");
-  Serial.print("  IP (U1/J1) -> PAD_");
-  Serial.print(pad_chars[ip_pad]);
-  Serial.println(ip_ok ? " : PASS" : " : FAIL");
-
-  Serial.print("  IM (U2/J2) -> PAD_");
-  Serial.print(pad_chars[im_pad]);
-  Serial.println(im_ok ? " : PASS" : " : FAIL");
-
-  Serial.print("  VP (U3/J3) -> PAD_");
-  Serial.print(pad_chars[vp_pad]);
-  Serial.println(vp_ok ? " : PASS" : " : FAIL");
-
-  Serial.print("  VM (U4/J4) -> PAD_");
-  Serial.print(pad_chars[vm_pad]);
-  Serial.println(vm_ok ? " : PASS" : " : FAIL");
+  out_.println("CFGTEST RESULT:");
+  out_.print("  IP (U1/J1) -> PAD_");
+  out_.print(pad_to_char(static_cast<Pad>(ip_pad)));
+  out_.println(ip_ok ? " : PASS" : " : FAIL");
+
+  out_.print("  IM (U2/J2) -> PAD_");
+  out_.print(pad_to_char(static_cast<Pad>(im_pad)));
+  out_.println(im_ok ? " : PASS" : " : FAIL");
+
+  out_.print("  VP (U3/J3) -> PAD_");
+  out_.print(pad_to_char(static_cast<Pad>(vp_pad)));
+  out_.println(vp_ok ? " : PASS" : " : FAIL");
+
+  out_.print("  VM (U4/J4) -> PAD_");
+  out_.print(pad_to_char(static_cast<Pad>(vm_pad)));
+  out_.println(vm_ok ? " : PASS" : " : FAIL");
 }
@@ -1,20 +1,20 @@
 #pragma once
 
-#include <Adafruit_MCP23X17.h>
 #include <Arduino.h>
 
 #include "max328_router.h"
+#include "mcp_port.h"
 
 class SwitchValidator {
  public:
-  static constexpr uint8_t kNumOutputs = 4;  // J5 pads (S1-S4)
+  static constexpr uint8_t kNumOutputs = kPadCount;  // pads (S1-Sn)
   static constexpr uint8_t kNumInputs = 4;   // J1-J4 probes (D pins of U1-U4)
   static constexpr uint8_t kNumChips = 4;    // U1, U2, U3, U4
 
-  // Output pins - directly drive J5 pads (S1-S4 on all MAX328s)
-  // J5 pin 1 (PAD_A) = MOSI (GP19), pin 2 (PAD_B) = MISO (GP20)
-  // J5 pin 3 (PAD_C) = RX (GP1), pin 4 (PAD_D) = TX (GP0)
-  static constexpr uint8_t kOutputPins[kNumOutputs] = {19, 20, 1, 0};
+  // Output pins - directly drive the pads (S1-Sn on all MAX328s), from the
+  // board descriptor. J5 pads A-D are MOSI (GP19), MISO (GP20), RX (GP1)
+  // and TX (GP0).
+  static constexpr const uint8_t *kOutputPins = kBoard.pad_pins;
 
   // Input pins - read J1-J4 probes (D outputs of MAX328s)
   // A0-A3 on Feather RP2040 = GP26-29
@@ -28,19 +28,34 @@ class SwitchValidator {
       Max328Router::kU4Pins,
   };
 
+  // SIO masks for the pins above
+  static constexpr uint32_t kOutputMask = board_pad_mask();
+  static constexpr uint32_t kInputMask = (1u << 26) | (1u << 27) | (1u << 28) | (1u << 29);
+
+  // Fast scan: a probe reading counts once it has held for kStableUs. If the
+  // inputs are still changing after kSettleTimeoutUs (the old fixed delay),
+  // the last reading is used.
+  static constexpr uint32_t kStableUs = 5;
+  static constexpr uint32_t kSettleTimeoutUs = 100;
+
   // Result matrix: connections[chip][pad] = true if U(chip+1) connects to PAD(pad)
   struct ScanResult {
     bool connections[kNumChips][kNumOutputs];
     uint8_t connection_count;
+    uint32_t scan_us;  // duration of the scan
   };
 
-  explicit SwitchValidator(Adafruit_MCP23X17 &mcp);
+  // `out` receives the printed results
+  explicit SwitchValidator(McpPort &port, Print &out = Serial);
   void begin();
 
-  // Run a full matrix scan and return results
+  // Full matrix scan. All four chips are set to the same pad, so each MCP
+  // write and SIO input read tests a whole column of the matrix.
   ScanResult scan();
+  // Reference scan, one cell at a time with fixed 100 us delays
+  ScanResult scan_slow();
 
-  // Print scan results to Serial
+  // Print scan results
   void print_result(const ScanResult& result);
 
   // Verify a specific configuration is routed correctly
@@ -52,10 +67,12 @@ class SwitchValidator {
                            bool ip_ok, bool im_ok, bool vp_ok, bool vm_ok);
 
  private:
-  Adafruit_MCP23X17 &mcp_;
+  McpPort &port_;
+  Print &out_;
 
   void set_all_outputs_low();
   void set_all_enables(bool enabled);
   void set_chip_address(const Max328Router::ChipPins &pins, uint8_t addr);
   void set_chip_enable(const Max328Router::ChipPins &pins, bool enabled);
+  uint32_t read_inputs_stable();
 };
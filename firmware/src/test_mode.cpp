@@ -1,7 +1,12 @@
 #include "test_mode.h"
 
-TestMode::TestMode(Max328Router &router)
+#include <pico/time.h>
+
+#include "scheduler.h"
+
+TestMode::TestMode(Max328Router &router, Print &out)
     : router_(router),
+      out_(out),
       active_(false),
       auto_run_(false),
       interval_ms_(500),
@@ -43,6 +48,15 @@ void TestMode::update() {
   advance();
 }
 
+uint64_t TestMode::next_deadline_us() const {
+  if (!active_ || !auto_run_) {
+    return kNoDeadline;
+  }
+  uint64_t now = time_us_64();
+  int32_t remaining_ms = static_cast<int32_t>(last_ms_ + interval_ms_ - millis());
+  return remaining_ms > 0 ? now + static_cast<uint64_t>(remaining_ms) * 1000 : now;
+}
+
 bool TestMode::active() const { return active_; }
 
 bool TestMode::auto_run() const { return auto_run_; }
@@ -96,10 +110,10 @@ void TestMode::apply_current() {
   } else if (enable_index_ == 3) {
     en_name = "VM";
   }
-  Serial.print("TEST STEP PAD=");
-  Serial.print(pad_to_char(pad));
-  Serial.print(" EN=");
-  Serial.println(en_name);
+  out_.print("TEST STEP PAD=");
+  out_.print(pad_to_char(pad));
+  out_.print(" EN=");
+  out_.println(en_name);
 }
 
 void TestMode::advance() {
@@ -107,7 +121,7 @@ void TestMode::advance() {
   if (enable_index_ >= 4) {
     enable_index_ = 0;
     pad_index_++;
-    if (pad_index_ >= 4) {
+    if (pad_index_ >= kPadCount) {
       pad_index_ = 0;
     }
   }
@@ -6,13 +6,16 @@
 
 class TestMode {
  public:
-  explicit TestMode(Max328Router &router);
+  // `out` receives the TEST STEP lines
+  explicit TestMode(Max328Router &router, Print &out = Serial);
 
   void begin();
   void start(uint32_t interval_ms = 500);
   void step_once();
   void stop();
   void update();
+  // time_us_64() of the next auto step, or kNoDeadline
+  uint64_t next_deadline_us() const;
 
   bool active() const;
   bool auto_run() const;
@@ -22,6 +25,7 @@ class TestMode {
 
  private:
   Max328Router &router_;
+  Print &out_;
   bool active_;
   bool auto_run_;
   uint32_t interval_ms_;
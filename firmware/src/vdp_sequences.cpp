@@ -1,10 +1,15 @@
 #include "vdp_sequences.h"
 
-// Van der Pauw configurations for sample orientation:
-//   A/1------------------------------C/3
+// Sample orientation for every preset in this file: contacts 1-4 (pads A-D)
+// are numbered clockwise around the edge, so A-B, B-C, C-D and D-A are
+// edges and A-C, B-D the diagonals.
+//   A/1------------------------------B/2
 //   |                                 |
 //   |                                 |
-//   B/2------------------------------D/4
+//   D/4------------------------------C/3
+//
+// Van der Pauw configurations: current along one edge, voltage across the
+// opposite one.
 //
 // RouterState order: {ip, im, vp, vm} = {I+, I-, V+, V-}
 //
@@ -12,13 +17,24 @@
 // Config 2: I: C->B, V: D-A  (reverse polarity of 1)
 // Config 3: I: A->D, V: B-C  (perpendicular)
 // Config 4: I: D->A, V: C-B  (reverse polarity of 3)
-static const VdpConfig kConfigs[] = {
+constexpr VdpConfig kConfigs[] = {
     {1, {Pad::C, Pad::B, Pad::A, Pad::D}},  // I: B->C, V: A-D
     {2, {Pad::B, Pad::C, Pad::D, Pad::A}},  // I: C->B, V: D-A
     {3, {Pad::D, Pad::A, Pad::B, Pad::C}},  // I: A->D, V: B-C
     {4, {Pad::A, Pad::D, Pad::C, Pad::B}},  // I: D->A, V: C-B
+#if OPENPAUW_PADS == 8
+    // Second sample on E-H, same orientation (E/1, F/2, G/3, H/4)
+    {5, {Pad::G, Pad::F, Pad::E, Pad::H}},  // I: F->G, V: E-H
+    {6, {Pad::F, Pad::G, Pad::H, Pad::E}},  // I: G->F, V: H-E
+    {7, {Pad::H, Pad::E, Pad::F, Pad::G}},  // I: E->H, V: F-G
+    {8, {Pad::E, Pad::H, Pad::G, Pad::F}},  // I: H->E, V: G-F
+#endif
 };
 
+const VdpConfig *vdp_configs() { return kConfigs; }
+
+size_t vdp_config_count() { return sizeof(kConfigs) / sizeof(kConfigs[0]); }
+
 const VdpConfig *find_vdp_config(uint8_t cfg_id) {
   for (const auto &cfg : kConfigs) {
     if (cfg.cfg_id == cfg_id) {
@@ -36,3 +52,79 @@ bool get_vdp_config(uint8_t cfg_id, RouterState &out_state) {
   out_state = cfg->state;
   return true;
 }
+
+// Hall configurations: current through one diagonal (A-C or B-D above), Hall
+// voltage across the other. Each routing is measured with the field up (+)
+// and down (-).
+//
+// Config 11: I: A->C, V: B-D
+// Config 12: I: C->A, V: D-B  (reverse polarity of 11)
+// Config 13: I: B->D, V: C-A
+// Config 14: I: D->B, V: A-C  (reverse polarity of 13)
+// Config 15-18: 11-14 with the field reversed
+constexpr HallConfig kHallConfigs[] = {
+    {11, {Pad::A, Pad::C, Pad::B, Pad::D}, +1},
+    {12, {Pad::C, Pad::A, Pad::D, Pad::B}, +1},
+    {13, {Pad::B, Pad::D, Pad::C, Pad::A}, +1},
+    {14, {Pad::D, Pad::B, Pad::A, Pad::C}, +1},
+    {15, {Pad::A, Pad::C, Pad::B, Pad::D}, -1},
+    {16, {Pad::C, Pad::A, Pad::D, Pad::B}, -1},
+    {17, {Pad::B, Pad::D, Pad::C, Pad::A}, -1},
+    {18, {Pad::D, Pad::B, Pad::A, Pad::C}, -1},
+};
+
+// VdP at zero field, then Hall with the field up, then down. Within each
+// block the order was searched for the least settle time, then the fewest
+// legs moved (legs per step: 4 4 4 2 4 4 4 0 4 4 4; the 14 -> 18 step only
+// waits for the field). In table order the same set settles for 550 ms and
+// moves 43 legs; this order takes 500 ms and 38.
+constexpr uint8_t kSweepOrder[] = {1, 2, 3, 4, 13, 11, 12, 14, 18, 15, 16, 17};
+
+template <typename Config, size_t N>
+constexpr bool presets_safe(const Config (&configs)[N]) {
+  for (const Config &cfg : configs) {
+    if (!Max328Router::route_safe(cfg.state)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static_assert(presets_safe(kConfigs), "a VdP preset shorts I+/I- or ties V+/V-");
+static_assert(presets_safe(kHallConfigs), "a Hall preset shorts I+/I- or ties V+/V-");
+
+const HallConfig *hall_configs() { return kHallConfigs; }
+
+size_t hall_config_count() { return sizeof(kHallConfigs) / sizeof(kHallConfigs[0]); }
+
+const HallConfig *find_hall_config(uint8_t cfg_id) {
+  for (const auto &cfg : kHallConfigs) {
+    if (cfg.cfg_id == cfg_id) {
+      return &cfg;
+    }
+  }
+  return nullptr;
+}
+
+bool get_preset(uint8_t cfg_id, RouterState &out_state, int8_t &field) {
+  if (get_vdp_config(cfg_id, out_state)) {
+    field = 0;
+    return true;
+  }
+  const HallConfig *cfg = find_hall_config(cfg_id);
+  if (!cfg) {
+    return false;
+  }
+  out_state = cfg->state;
+  field = cfg->field;
+  return true;
+}
+
+bool get_preset(uint8_t cfg_id, RouterState &out_state) {
+  int8_t field = 0;
+  return get_preset(cfg_id, out_state, field);
+}
+
+const uint8_t *sweep_order() { return kSweepOrder; }
+
+size_t sweep_length() { return sizeof(kSweepOrder) / sizeof(kSweepOrder[0]); }
@@ -7,5 +7,27 @@ struct VdpConfig {
   RouterState state;
 };
 
+// Hall presets carry the magnet direction the step needs. The board cannot
+// set the field; a sequence stops for it (SEQ FIELD) when the marker changes.
+struct HallConfig {
+  uint8_t cfg_id;
+  RouterState state;
+  int8_t field;  // +1 or -1
+};
+
+const VdpConfig *vdp_configs();
+size_t vdp_config_count();
 const VdpConfig *find_vdp_config(uint8_t cfg_id);
 bool get_vdp_config(uint8_t cfg_id, RouterState &out_state);
+
+const HallConfig *hall_configs();
+size_t hall_config_count();
+const HallConfig *find_hall_config(uint8_t cfg_id);
+
+// Any preset, VdP or Hall. field is 0 for a VdP preset.
+bool get_preset(uint8_t cfg_id, RouterState &out_state, int8_t &field);
+bool get_preset(uint8_t cfg_id, RouterState &out_state);
+
+// The 4 VdP + 8 Hall presets as one sweep, ordered for the fewest leg moves
+const uint8_t *sweep_order();
+size_t sweep_length();
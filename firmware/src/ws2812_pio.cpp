@@ -0,0 +1,102 @@
+#include "ws2812_pio.h"
+
+#include <hardware/clocks.h>
+#include <pico/time.h>
+
+namespace {
+
+// ws2812.pio from pico-examples, assembled. Ten PIO cycles per bit:
+//   .side_set 1
+//   .wrap_target
+//   bitloop:
+//     out x, 1        side 0 [2]
+//     jmp !x do_zero  side 1 [1]
+//   do_one:
+//     jmp bitloop     side 1 [4]
+//   do_zero:
+//     nop             side 0 [4]
+//   .wrap
+constexpr uint16_t kProgramInstructions[] = {0x6221, 0x1123, 0x1400, 0xa442};
+const pio_program_t kProgram = {kProgramInstructions, 4, -1};
+constexpr uint8_t kWrapTarget = 0;
+constexpr uint8_t kWrap = 3;
+constexpr uint8_t kCyclesPerBit = 10;
+constexpr uint32_t kBitRateHz = 800000;
+
+}  // namespace
+
+Ws2812Pio::Ws2812Pio()
+    : pio_(nullptr), sm_(-1), brightness_(255), grb_(0), pending_(false), last_frame_us_(0) {}
+
+bool Ws2812Pio::begin(uint8_t pin) {
+  pending_ = false;
+  last_frame_us_ = 0;
+  if (sm_ >= 0) {
+    return true;
+  }
+  PIO candidates[] = {pio0, pio1};
+  for (PIO pio : candidates) {
+    if (!pio_can_add_program(pio, &kProgram)) {
+      continue;
+    }
+    int sm = pio_claim_unused_sm(pio, false);
+    if (sm < 0) {
+      continue;
+    }
+    uint32_t offset = pio_add_program(pio, &kProgram);
+    pio_gpio_init(pio, pin);
+    pio_sm_set_consecutive_pindirs(pio, sm, pin, 1, true);
+
+    pio_sm_config config = pio_get_default_sm_config();
+    sm_config_set_wrap(&config, offset + kWrapTarget, offset + kWrap);
+    sm_config_set_sideset(&config, 1, false, false);
+    sm_config_set_sideset_pins(&config, pin);
+    // Shift out MSB first, pulling a new word every 24 bits
+    sm_config_set_out_shift(&config, false, true, 24);
+    sm_config_set_fifo_join(&config, PIO_FIFO_JOIN_TX);
+    sm_config_set_clkdiv(&config, static_cast<float>(clock_get_hz(clk_sys)) /
+                                      (kBitRateHz * kCyclesPerBit));
+    pio_sm_init(pio, sm, offset, &config);
+    pio_sm_set_enabled(pio, sm, true);
+
+    pio_ = pio;
+    sm_ = static_cast<int8_t>(sm);
+    return true;
+  }
+  return false;
+}
+
+void Ws2812Pio::set_brightness(uint8_t brightness) { brightness_ = brightness; }
+
+void Ws2812Pio::set_color(uint8_t r, uint8_t g, uint8_t b) {
+  // Same scaling as Adafruit_NeoPixel: (c * (brightness + 1)) >> 8
+  uint16_t scale = static_cast<uint16_t>(brightness_) + 1;
+  uint32_t rs = (r * scale) >> 8;
+  uint32_t gs = (g * scale) >> 8;
+  uint32_t bs = (b * scale) >> 8;
+  grb_ = (gs << 16) | (rs << 8) | bs;
+  pending_ = true;
+}
+
+bool Ws2812Pio::show() {
+  if (sm_ < 0) {
+    pending_ = false;
+    return true;
+  }
+  pending_ = true;
+  uint64_t now = time_us_64();
+  if (now < next_show_us() || pio_sm_is_tx_fifo_full(pio_, sm_)) {
+    return false;
+  }
+  // Left-aligned: the state machine shifts out the top 24 bits
+  pio_sm_put(pio_, sm_, grb_ << 8);
+  last_frame_us_ = now;
+  pending_ = false;
+  return true;
+}
+
+bool Ws2812Pio::pending() const { return pending_; }
+
+uint64_t Ws2812Pio::next_show_us() const {
+  return last_frame_us_ == 0 ? 0 : last_frame_us_ + kFrameUs + kLatchUs;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Arduino.h>
+#include <hardware/pio.h>
+
+// One WS2812 pixel driven by a PIO state machine. show() hands the 24-bit
+// frame to the state machine's TX FIFO and returns; the PIO clocks the bits
+// out on its own, so nothing bit-bangs the pin or masks interrupts.
+class Ws2812Pio {
+ public:
+  // Low time that latches a frame (WS2812B needs 280 us); a frame pushed
+  // sooner would be passed down the (absent) chain instead of shown
+  static constexpr uint32_t kLatchUs = 300;
+  // 24 bits at 800 kHz
+  static constexpr uint32_t kFrameUs = 30;
+
+  Ws2812Pio();
+  // Claims a state machine on pio0 (pio1 if pio0 is full) the first time;
+  // false if none is free
+  bool begin(uint8_t pin);
+  // Scales every later color; 0-255 like Adafruit_NeoPixel::setBrightness
+  void set_brightness(uint8_t brightness);
+  void set_color(uint8_t r, uint8_t g, uint8_t b);
+  // Queue the color. Never waits: while the last frame is still latching the
+  // color stays pending and show() returns false; call it again at
+  // next_show_us().
+  bool show();
+  bool pending() const;
+  uint64_t next_show_us() const;
+
+ private:
+  PIO pio_;
+  int8_t sm_;
+  uint8_t brightness_;
+  uint32_t grb_;
+  bool pending_;
+  uint64_t last_frame_us_;
+};
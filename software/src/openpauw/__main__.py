@@ -45,7 +45,10 @@ def cmd_measure(args: argparse.Namespace) -> None:
             m = VdpMeasurement(board, dmm, current=args.current, settle_time=args.settle)
             m.configure_dmm(nplc=args.nplc, range_v=args.range)
 
-            voltages, result = m.run(thickness_cm=args.thickness)
+            if args.pipelined:
+                voltages, result = m.run_pipelined(passes=args.passes, thickness_cm=args.thickness)
+            else:
+                voltages, result = m.run(thickness_cm=args.thickness)
 
             for cfg_id in range(1, 5):
                 print(f"  CFG {cfg_id}: {voltages[cfg_id]:.4e} V")
@@ -54,6 +57,7 @@ def cmd_measure(args: argparse.Namespace) -> None:
             print(f"R_sheet:      {result.sheet_resistance:.4f} ohm/sq")
             if result.resistivity is not None:
                 print(f"Resistivity:  {result.resistivity:.4e} ohm-cm")
+            print(f"Points/min:   {m.points_per_minute:.1f}")
 
             if args.output:
                 m.save_csv(args.output, voltages, result)
@@ -92,6 +96,8 @@ def main() -> None:
     p_measure.add_argument("--nplc", type=float, default=10, help="NPLC for DMM")
     p_measure.add_argument("--range", type=float, default=1.0, help="Voltage range in V")
     p_measure.add_argument("--settle", type=float, default=0.3, help="Settle time in seconds between config switches (default 0.3)")
+    p_measure.add_argument("--pipelined", action="store_true", help="Step the board from the DMM trigger lines and read the DMM buffer at the end")
+    p_measure.add_argument("--passes", type=int, default=1, help="Passes over the four configs in pipelined mode, averaged (default 1)")
 
     p_interactive = sub.add_parser("interactive", help="Interactive REPL mode")
     p_interactive.add_argument("--dmm-ip", required=True, help="Keithley DMM6500 IP address")
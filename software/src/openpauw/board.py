@@ -2,7 +2,12 @@
 
 from __future__ import annotations
 
+import binascii
+import threading
 import time
+from collections import deque
+from collections.abc import Callable
+from dataclasses import dataclass
 
 import serial
 from serial.tools import list_ports
@@ -46,8 +51,496 @@ def parse_state(line: str) -> dict[str, str] | None:
     return data
 
 
+def parse_boards(line: str) -> list[int] | None:
+    """Parse a BOARDS response into the list of switch matrices found.
+
+    Returns e.g. [0, 1, 3] for "BOARDS COUNT=3 PRESENT=0,1,3" — or None on
+    parse failure.
+    """
+    if not line.startswith("BOARDS "):
+        return None
+    for part in line.split()[1:]:
+        if part.startswith("PRESENT="):
+            value = part.split("=", 1)[1]
+            return [int(b) for b in value.split(",") if b]
+    return None
+
+
+def parse_ready(line: str) -> dict[str, int | str] | None:
+    """Parse the READY line (sent at boot and in reply to READY?).
+
+    Returns dict with keys: fw, pads, boards, mcp (1 if a switch matrix was
+    found) — an empty dict for the bare "READY" of older firmware, or
+    None if line is not READY.
+    """
+    if line == "READY":
+        return {}
+    if not line.startswith("READY "):
+        return None
+    data: dict[str, int | str] = {}
+    for part in line.split()[1:]:
+        if "=" not in part:
+            return None
+        key, value = part.split("=", 1)
+        if key == "FW":
+            data["fw"] = value
+            continue
+        try:
+            data[key.lower()] = int(value)
+        except ValueError:
+            return None
+    if not {"fw", "pads", "mcp"} <= data.keys():
+        return None
+    return data
+
+
+def parse_boot(line: str) -> dict[str, int | str] | None:
+    """Parse a BOOT? response into a dict.
+
+    Returns dict with keys: reset (POWER or WATCHDOG), usb_us, led_us,
+    mcp_us, route_us, ready_us, presets_us, settled_us, selftest_us (us
+    since reset; 0 for a phase not reached yet), selftest (PENDING, PASS
+    or FAIL) and cached (1 if the self-test came from before a watchdog
+    reset) — or None on parse failure.
+    """
+    if not line.startswith("BOOT RESET="):
+        return None
+    data: dict[str, int | str] = {}
+    for part in line.split()[1:]:
+        if "=" not in part:
+            return None
+        key, value = part.split("=", 1)
+        key = key.lower()
+        if key in ("reset", "selftest"):
+            data[key] = value
+            continue
+        try:
+            data[key] = int(value)
+        except ValueError:
+            return None
+    if not {"reset", "ready_us", "selftest"} <= data.keys():
+        return None
+    return data
+
+
+def parse_settled(line: str) -> dict[str, int] | None:
+    """Parse a SETTLED event into a dict.
+
+    Returns dict with keys: cfg, t_us — or None on parse failure.
+    """
+    if not line.startswith("SETTLED "):
+        return None
+    data: dict[str, int] = {}
+    for part in line.split()[1:]:
+        if "=" in part:
+            key, value = part.split("=", 1)
+            try:
+                data[key.lower()] = int(value)
+            except ValueError:
+                return None
+    if "cfg" not in data or "t_us" not in data:
+        return None
+    return data
+
+
+def parse_seq_step(line: str) -> dict[str, int] | None:
+    """Parse a SEQ STEP event into a dict.
+
+    Returns dict with keys: n, cfg, t_us, settle_us, plus field (+1/-1) for
+    a Hall step — or None on parse failure.
+    """
+    if not line.startswith("SEQ STEP "):
+        return None
+    data: dict[str, int] = {}
+    for part in line.split()[2:]:
+        if "=" in part:
+            key, value = part.split("=", 1)
+            try:
+                data[key.lower()] = int(value)
+            except ValueError:
+                return None
+    if not {"n", "cfg", "t_us"} <= data.keys():
+        return None
+    return data
+
+
+def parse_seq_field(line: str) -> dict[str, int] | None:
+    """Parse a SEQ FIELD event (sequence held for a field change).
+
+    Returns dict with keys: n (the step waiting), field (+1, -1 or 0 for
+    none) — or None on parse failure.
+    """
+    if not line.startswith("SEQ FIELD "):
+        return None
+    data: dict[str, int] = {}
+    for part in line.split()[2:]:
+        if "=" in part:
+            key, value = part.split("=", 1)
+            try:
+                data[key.lower()] = int(value)
+            except ValueError:
+                return None
+    if not {"n", "field"} <= data.keys():
+        return None
+    return data
+
+
+def parse_seq_status(line: str) -> dict[str, int] | None:
+    """Parse a SEQ? response into a dict.
+
+    Returns dict with keys: steps, active, step, loops, ext, field_wait,
+    trig_in, trig_early, trig_missed — or None on parse failure.
+    """
+    if not line.startswith("SEQ STEPS="):
+        return None
+    data: dict[str, int] = {}
+    for part in line.split()[1:]:
+        if "=" in part:
+            key, value = part.split("=", 1)
+            try:
+                data[key.lower()] = int(value)
+            except ValueError:
+                return None
+    if not {"steps", "active"} <= data.keys():
+        return None
+    return data
+
+
+def parse_preset(line: str) -> dict[str, int | str] | None:
+    """Parse one PRESET LIST line into a dict.
+
+    Returns dict with keys: cfg, user (1 for a saved preset), field (+1/-1
+    for Hall, else 0) and pads ("ABCD" in I+ I- V+ V- order) — or None on
+    parse failure.
+    """
+    if not line.startswith("PRESET CFG="):
+        return None
+    data: dict[str, str] = {}
+    for part in line.split()[1:]:
+        if "=" in part:
+            key, value = part.split("=", 1)
+            data[key] = value
+    try:
+        preset: dict[str, int | str] = {
+            "cfg": int(data["CFG"]),
+            "user": int(data["USER"]),
+            "field": int(data["FIELD"]),
+            "pads": data["IP"] + data["IM"] + data["VP"] + data["VM"],
+        }
+    except (KeyError, ValueError):
+        return None
+    return preset
+
+
+def parse_event(line: str) -> dict[str, int | str] | None:
+    """Parse an "EVT seq=..." event-log record (streamed after EVT ON).
+
+    Returns dict with keys: seq, t_us, type (route, enmask, settled, swtest,
+    cfgtest) and that type's fields, e.g. board, cfg, pads ("ABCD"), en,
+    settle_us, pass, connections — or None on parse failure.
+    """
+    if not line.startswith("EVT seq="):
+        return None
+    data: dict[str, int | str] = {}
+    for part in line.split()[1:]:
+        if "=" not in part:
+            return None
+        key, value = part.split("=", 1)
+        if key in ("type", "pads"):
+            data[key] = value
+            continue
+        try:
+            data[key] = int(value)
+        except ValueError:
+            return None
+    if not {"seq", "t_us", "type"} <= data.keys():
+        return None
+    return data
+
+
+def parse_adc(line: str) -> dict[str, object] | None:
+    """Parse an "ADC seq=..." probe ADC record (streamed after ADC START).
+
+    Returns dict with keys: seq, t_us, n (conversions per probe), mv and pp
+    (mean and peak-to-peak of each probe in mV, I+ I- V+ V- order) — or
+    None on parse failure.
+    """
+    if not line.startswith("ADC seq="):
+        return None
+    record: dict[str, object] = {}
+    try:
+        for part in line.split()[1:]:
+            key, value = part.split("=", 1)
+            if key in ("mv", "pp"):
+                record[key] = [int(v) for v in value.split(",")]
+            else:
+                record[key] = int(value)
+    except ValueError:
+        return None
+    if not {"seq", "t_us", "n", "mv", "pp"} <= record.keys():
+        return None
+    return record
+
+
+def parse_adc_status(line: str) -> dict[str, int] | None:
+    """Parse "ADC ACTIVE=0 RATE=500000 AVG=1250 ..." into a dict with
+    lowercase keys: active, rate, avg, drive, records, overruns, dropped."""
+    if not line.startswith("ADC ACTIVE="):
+        return None
+    status: dict[str, int] = {}
+    try:
+        for part in line.split()[1:]:
+            key, value = part.split("=", 1)
+            status[key.lower()] = int(value)
+    except ValueError:
+        return None
+    return status
+
+
+# Lines the firmware emits on its own, outside any command response
+EVENT_PREFIXES = (
+    "SETTLED ",
+    "SEQ STEP ",
+    "SEQ FIELD ",
+    "SEQ DONE",
+    "TEST STEP PAD=",
+    "EVT seq=",
+    "EVT DROPPED ",
+    "ADC seq=",
+    "ADC DROPPED ",
+)
+
+# Most commands the firmware accepts in one BEGIN ... END block
+BATCH_MAX_COMMANDS = 16
+
+
+def format_batch(commands: list[str]) -> bytes:
+    """Encode commands as one BEGIN ... END block for OpenPauwBoard.batch()."""
+    if len(commands) > BATCH_MAX_COMMANDS:
+        raise ValueError(f"At most {BATCH_MAX_COMMANDS} commands per batch")
+    for cmd in commands:
+        if "\n" in cmd or "\r" in cmd:
+            raise ValueError(f"Batch command spans lines: {cmd!r}")
+    return ("\n".join(["BEGIN", *commands, "END"]) + "\n").encode("ascii")
+
+
+# Binary mode ("MODE BIN"): COBS frames delimited by 0x00, each holding
+# id, op, [status,] payload, CRC-16/CCITT-FALSE (little-endian).
+OP_PING = 0x01
+OP_VERSION = 0x02
+OP_STATE = 0x03
+OP_MODE_ASCII = 0x04
+OP_EVT_STREAM = 0x05
+OP_CFG = 0x10
+OP_SET = 0x11
+OP_ENMASK = 0x12
+EVT_SETTLED = 0x80
+EVT_TEXT = 0x81
+EVT_LOG = 0x82
+EVT_ADC = 0x83
+
+EVENT_TYPES = {1: "route", 2: "enmask", 3: "settled", 4: "swtest", 5: "cfgtest"}
+
+BIN_STATUS = {
+    0: "OK",
+    1: "BAD_CRC",
+    2: "BAD_FRAME",
+    3: "BAD_OP",
+    4: "BAD_ARG",
+    5: "SEQ_ACTIVE",
+    6: "NO_BOARD",
+}
+
+PADS = "ABCDEFGH"
+
+
+@dataclass
+class BinaryFrame:
+    """A decoded response or event frame."""
+
+    id: int
+    op: int
+    status: int
+    payload: bytes
+
+
+def crc16(data: bytes) -> int:
+    """CRC-16/CCITT-FALSE as used by the binary protocol."""
+    return binascii.crc_hqx(data, 0xFFFF)
+
+
+def cobs_encode(data: bytes) -> bytes:
+    """COBS-encode data (without the 0x00 delimiter)."""
+    out = bytearray()
+    block = bytearray()
+    full = False  # the last byte completed a 254-byte block
+    for byte in data:
+        full = False
+        if byte == 0:
+            out.append(len(block) + 1)
+            out += block
+            block.clear()
+            continue
+        block.append(byte)
+        if len(block) == 254:
+            out.append(0xFF)
+            out += block
+            block.clear()
+            full = True
+    if not full:
+        out.append(len(block) + 1)
+        out += block
+    return bytes(out)
+
+
+def cobs_decode(data: bytes) -> bytes:
+    """Decode one COBS frame (without the delimiter). Raises ValueError."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            raise ValueError("invalid COBS frame")
+        block = data[i:i + code - 1]
+        if 0 in block:
+            raise ValueError("invalid COBS frame")
+        out += block
+        i += code - 1
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_request(req_id: int, op: int, payload: bytes = b"") -> bytes:
+    """Build a delimited binary request frame."""
+    packet = bytes([req_id, op]) + payload
+    packet += crc16(packet).to_bytes(2, "little")
+    return cobs_encode(packet) + b"\x00"
+
+
+def decode_frame(data: bytes) -> BinaryFrame:
+    """Decode a response/event frame (without the delimiter).
+
+    Raises ValueError on bad framing or CRC.
+    """
+    packet = cobs_decode(data)
+    if len(packet) < 5:
+        raise ValueError("frame too short")
+    if crc16(packet[:-2]) != int.from_bytes(packet[-2:], "little"):
+        raise ValueError("bad CRC")
+    return BinaryFrame(packet[0], packet[1], packet[2], packet[3:-2])
+
+
+def unpack_state(payload: bytes) -> dict[str, object] | None:
+    """Unpack a binary STATE payload.
+
+    Returns dict with keys: cfg, ip, im, vp, vm, enmask, routing,
+    seq_active, test_active — or None if the payload has the wrong size.
+    """
+    if len(payload) != 7:
+        return None
+    cfg, ip, im, vp, vm, enmask, flags = payload
+    if max(ip, im, vp, vm) >= len(PADS):
+        return None
+    return {
+        "cfg": cfg,
+        "ip": PADS[ip],
+        "im": PADS[im],
+        "vp": PADS[vp],
+        "vm": PADS[vm],
+        "enmask": enmask,
+        "routing": bool(flags & 0x01),
+        "seq_active": bool(flags & 0x02),
+        "test_active": bool(flags & 0x04),
+    }
+
+
+def unpack_event_log(payload: bytes) -> tuple[int, list[dict[str, int | str]]] | None:
+    """Unpack an EVT_LOG payload: the firmware's total of dropped records,
+    then one 16-byte record each (seq, t_us, value, type, board, a, b).
+
+    Records come back with the keys parse_event() gives the text form. None
+    if the payload size is wrong.
+    """
+    if len(payload) < 4 or (len(payload) - 4) % 16:
+        return None
+    dropped = int.from_bytes(payload[:4], "little")
+    events: list[dict[str, int | str]] = []
+    for i in range(4, len(payload), 16):
+        rec = payload[i:i + 16]
+        seq, t_us, value = (int.from_bytes(rec[j:j + 4], "little") for j in (0, 4, 8))
+        kind, board, a, b = rec[12:16]
+        event: dict[str, int | str] = {
+            "seq": seq,
+            "t_us": t_us,
+            "type": EVENT_TYPES.get(kind, str(kind)),
+        }
+        if kind == 1:
+            pads = "".join(PADS[(value >> (4 * leg)) & 0x0F] for leg in range(4))
+            event.update(board=board, cfg=a, pads=pads, en=b)
+        elif kind == 2:
+            event.update(board=board, en=a)
+        elif kind == 3:
+            event.update(cfg=a, settle_us=value)
+        elif kind == 4:
+            event.update({"pass": a, "connections": value})
+        elif kind == 5:
+            event.update({"cfg": b, "pass": a})
+        events.append(event)
+    return dropped, events
+
+
+def unpack_settled(payload: bytes) -> dict[str, int] | None:
+    """Unpack an EVT_SETTLED payload into cfg, t_us."""
+    if len(payload) != 5:
+        return None
+    return {"cfg": payload[0], "t_us": int.from_bytes(payload[1:], "little")}
+
+
+# Probe ADC reference: 12-bit codes span 0-3300 mV
+ADC_FULL_SCALE_MV = 3300
+
+
+def _code_mv(code: int) -> int:
+    return (code * ADC_FULL_SCALE_MV + 2048) // 4096
+
+
+def unpack_adc(payload: bytes) -> tuple[int, list[dict[str, object]]] | None:
+    """Unpack an EVT_ADC payload: the firmware's total of dropped records,
+    then one 36-byte record each (seq, t_us, rounds, then mean x16, min and
+    max codes of the four probes).
+
+    Records come back with the keys parse_adc() gives the text form. None
+    if the payload size is wrong.
+    """
+    if len(payload) < 4 or (len(payload) - 4) % 36:
+        return None
+    dropped = int.from_bytes(payload[:4], "little")
+    records: list[dict[str, object]] = []
+    for i in range(4, len(payload), 36):
+        rec = payload[i:i + 36]
+        seq, t_us, rounds = (int.from_bytes(rec[j:j + 4], "little") for j in (0, 4, 8))
+        words = [int.from_bytes(rec[j:j + 2], "little") for j in range(12, 36, 2)]
+        mean, low, high = words[0:4], words[4:8], words[8:12]
+        records.append({
+            "seq": seq,
+            "t_us": t_us,
+            "n": rounds,
+            "mv": [(m * ADC_FULL_SCALE_MV + 32768) // 65536 for m in mean],
+            "pp": [_code_mv(h) - _code_mv(lo) for lo, h in zip(low, high)],
+        })
+    return dropped, records
+
+
 class OpenPauwBoard:
-    """Interface to the OpenPauw RP2040 hardware over serial."""
+    """Interface to the OpenPauw RP2040 hardware over serial.
+
+    A background thread reads the port in bulk and sorts what arrives:
+    command responses into a line queue, SETTLED/SEQ/TEST STEP events
+    into their own slots, and binary frames by request id. Commands
+    return as soon as their last response line is in.
+    """
 
     def __init__(
         self,
@@ -59,31 +552,62 @@ class OpenPauwBoard:
         self.baud = baud
         self.timeout = timeout
         self._ser: serial.Serial | None = None
+        self._reader: threading.Thread | None = None
+        # Guards everything below; the reader notifies on each new arrival
+        self._cond = threading.Condition()
+        # One command exchange at a time
+        self._lock = threading.RLock()
+        self._lines: deque[str] = deque()
+        self._capabilities: dict[str, int | str] = {}
+        self._settled: dict[str, int] | None = None
+        self._events: deque[str] = deque()
+        # Probe ADC records come at up to 1 kHz, apart from the other events
+        self._adc: deque[str] = deque()
+        self._binary = False
+        self._next_id = 1
+        self._replies: dict[int, BinaryFrame] = {}
+        self._bin_events: deque[BinaryFrame] = deque()
 
     def connect(self) -> None:
-        """Open the serial connection and wait for READY."""
+        """Open the serial connection and ask the board for READY.
+
+        A running board answers READY? at once and one still booting as
+        soon as it is up, so a reconnect does not wait out the boot.
+        Raises TimeoutError if the board does not answer.
+        """
         port = self.port or find_default_port()
         if not port:
             raise ConnectionError(
                 "No serial port found. Use --port to specify one."
             )
         self.port = port
-        self._ser = serial.Serial(port, self.baud, timeout=0.1, write_timeout=1)
-        self._ser.reset_input_buffer()
+        ser = serial.Serial(port, self.baud, timeout=0.1, write_timeout=1)
+        ser.reset_input_buffer()
+        self._start(ser)
+
+        resp = self.send("READY?")
+        # Older firmware has no READY? and answers ERR
+        if not resp.startswith(("READY", "ERR")):
+            self.disconnect()
+            raise TimeoutError(f"No READY from board: {resp!r}")
 
-        # Wait for READY
-        end = time.time() + self.timeout
-        while time.time() < end:
-            line = self._read_line(0.1)
-            if line == "READY":
-                return
-        # Continue even if READY not seen (board may already be past boot)
+    @property
+    def capabilities(self) -> dict[str, int | str]:
+        """The board's last READY line as parse_ready() returns it: fw,
+        pads, boards and mcp; empty for older firmware or before connect()."""
+        with self._cond:
+            return dict(self._capabilities)
 
     def disconnect(self) -> None:
         """Close the serial connection."""
-        if self._ser is not None:
-            self._ser.close()
-            self._ser = None
+        ser, self._ser = self._ser, None
+        if ser is None:
+            return
+        reader, self._reader = self._reader, None
+        if reader is not None:
+            # Its read() returns within the port timeout and sees _ser gone
+            reader.join(1.0)
+        ser.close()
 
     def __enter__(self) -> OpenPauwBoard:
         self.connect()
@@ -97,44 +621,206 @@ class OpenPauwBoard:
             raise ConnectionError("Not connected. Call connect() first.")
         return self._ser
 
-    def _read_line(self, timeout_s: float) -> str:
-        """Read a single line from serial."""
-        ser = self._check()
-        end = time.time() + timeout_s
+    # Background reader
+
+    def _start(self, ser: serial.Serial) -> None:
+        self._ser = ser
+        self._reader = threading.Thread(
+            target=self._read_loop, args=(ser,), name="openpauw-reader", daemon=True
+        )
+        self._reader.start()
+
+    def _read_loop(self, ser: serial.Serial) -> None:
         buf = b""
-        while time.time() < end:
-            chunk = ser.read(1)
+        while self._ser is ser:
+            try:
+                chunk = ser.read(ser.in_waiting or 1)
+            except (serial.SerialException, OSError, TypeError):
+                # Port closed or unplugged
+                break
             if not chunk:
                 continue
-            if chunk == b"\n":
-                line = buf.decode("ascii", errors="ignore").strip()
-                if line:
-                    return line
-                buf = b""
-                continue
-            if chunk != b"\r":
-                buf += chunk
-        return ""
+            buf += chunk
+            with self._cond:
+                buf = self._dispatch(buf)
+                self._cond.notify_all()
 
-    def send(self, cmd: str) -> str:
-        """Send a command and return the response line."""
-        ser = self._check()
-        ser.write((cmd + "\n").encode("ascii"))
-        ser.flush()
-        return self._read_line(self.timeout)
+    def _dispatch(self, buf: bytes) -> bytes:
+        """Route every complete line or frame in buf; return the rest.
+
+        The mode is rechecked per unit because OK MODE BIN and the reply
+        to OP_MODE_ASCII switch the framing mid-stream.
+        """
+        while True:
+            sep = b"\x00" if self._binary else b"\n"
+            unit, found, rest = buf.partition(sep)
+            if not found:
+                return buf
+            buf = rest
+            if self._binary:
+                self._handle_frame(unit)
+            else:
+                self._handle_line(unit.decode("ascii", errors="ignore").strip())
+
+    def _handle_line(self, line: str) -> None:
+        if not line:
+            return
+        ready = parse_ready(line)
+        if ready is not None:
+            # Sent at boot and in reply to READY?; queued as a response too
+            self._capabilities = ready
+            self._lines.append(line)
+        elif line.startswith(EVENT_PREFIXES):
+            settled = parse_settled(line)
+            if settled is not None:
+                self._settled = settled
+            elif line.startswith("ADC "):
+                self._adc.append(line)
+            else:
+                self._events.append(line)
+        else:
+            if line.startswith(("OK CFG", "OK SET", "OK BOARD")):
+                # Its SETTLED comes after it; one still stored is older
+                self._settled = None
+            if line == "OK MODE BIN":
+                self._binary = True
+                self._replies.clear()
+                self._bin_events.clear()
+            self._lines.append(line)
 
-    def send_lines(self, cmd: str, timeout: float = 0.5) -> list[str]:
-        """Send a command and return multiple response lines."""
+    def _handle_frame(self, data: bytes) -> None:
+        if not data:
+            return
+        try:
+            frame = decode_frame(data)
+        except ValueError:
+            return
+        if frame.op >= EVT_SETTLED:
+            self._bin_events.append(frame)
+            return
+        if frame.op == OP_MODE_ASCII and frame.status == 0:
+            self._binary = False
+        self._replies[frame.id] = frame
+
+    def _wait(self, ready: Callable[[], bool], timeout_s: float) -> bool:
+        """Wait until ready() holds; the caller holds self._cond."""
+        return self._cond.wait_for(ready, max(timeout_s, 0.0))
+
+    # Line mode
+
+    def _write_command(self, cmd: str) -> None:
         ser = self._check()
+        with self._cond:
+            # Anything still queued belongs to an earlier, timed-out command
+            self._lines.clear()
         ser.write((cmd + "\n").encode("ascii"))
         ser.flush()
+
+    def _read_response(self, timeout_s: float) -> str:
+        """Return the next response line, or "" on timeout."""
+        with self._cond:
+            if not self._wait(lambda: bool(self._lines), timeout_s):
+                return ""
+            return self._lines.popleft()
+
+    def _read_until(
+        self, done: Callable[[str], bool], timeout_s: float
+    ) -> tuple[list[str], bool]:
+        """Collect response lines up to and including the first for which
+        done() is true. Returns the lines and whether that line came."""
+        end = time.monotonic() + timeout_s
         lines: list[str] = []
-        end = time.time() + timeout
-        while time.time() < end:
-            line = self._read_line(0.05)
-            if line:
-                lines.append(line)
-        return lines
+        while True:
+            line = self._read_response(end - time.monotonic())
+            if not line:
+                return lines, False
+            lines.append(line)
+            if done(line):
+                return lines, True
+
+    def send(self, cmd: str) -> str:
+        """Send a command and return the response line."""
+        with self._lock:
+            self._write_command(cmd)
+            return self._read_response(self.timeout)
+
+    def wait_settled(
+        self, timeout: float | None = None, cfg: int | None = None
+    ) -> dict[str, int]:
+        """Wait for the SETTLED event of the last CFG/SET.
+
+        With cfg, only a SETTLED for that preset (0 for SET) counts.
+        Returns dict with keys: cfg, t_us. Raises TimeoutError if the board
+        does not report settling in time.
+        """
+        with self._cond:
+            if not self._wait(
+                lambda: self._settled is not None
+                and (cfg is None or self._settled["cfg"] == cfg),
+                self.timeout if timeout is None else timeout,
+            ):
+                raise TimeoutError("No SETTLED event from board")
+            settled, self._settled = self._settled, None
+        return settled
+
+    def next_event(self, timeout: float | None = None) -> str:
+        """Return the next SEQ STEP/FIELD/DONE, TEST STEP or EVT event, or ""
+        on timeout."""
+        with self._cond:
+            if not self._wait(
+                lambda: bool(self._events),
+                self.timeout if timeout is None else timeout,
+            ):
+                return ""
+            return self._events.popleft()
+
+    def _command_until(
+        self, cmd: str, done: Callable[[str], bool]
+    ) -> tuple[list[str], bool]:
+        with self._lock:
+            self._write_command(cmd)
+            return self._read_until(done, self.timeout)
+
+    def send_lines(
+        self,
+        cmd: str,
+        timeout: float = 0.5,
+        done: Callable[[str], bool] | None = None,
+    ) -> list[str]:
+        """Send a command and return multiple response lines.
+
+        With done, returns as soon as the line for which done() is true has
+        arrived (included), or at the timeout. Without it, collects for the
+        whole timeout.
+        """
+        with self._lock:
+            self._write_command(cmd)
+            lines, _ = self._read_until(done or (lambda line: False), timeout)
+            return lines
+
+    def batch(self, commands: list[str], timeout: float | None = None) -> list[str]:
+        """Run commands as one batch and return their response lines.
+
+        The board checks every command before running any, merges runs of
+        CFG/SET/ENMASK into one switch transition (one SETTLED) and replies
+        with each command's response followed by OK BATCH n. Raises
+        RuntimeError if the batch is rejected.
+        """
+        ser = self._check()
+        with self._lock:
+            with self._cond:
+                self._lines.clear()
+            ser.write(format_batch(commands))
+            ser.flush()
+            lines, complete = self._read_until(
+                lambda line: line.startswith(("OK BATCH", "ERR BATCH")),
+                self.timeout if timeout is None else timeout,
+            )
+        if not complete:
+            raise TimeoutError("No OK BATCH from board")
+        if lines[-1].startswith("ERR BATCH"):
+            raise RuntimeError(f"Batch rejected: {lines[-1]}")
+        return lines[:-1]
 
     def ping(self) -> bool:
         """Send PING and return True if PONG received."""
@@ -144,14 +830,218 @@ class OpenPauwBoard:
         """Return the firmware version string."""
         return self.send("VERSION")
 
-    def set_config(self, cfg_id: int) -> None:
-        """Switch to a VDP configuration (1-4).
+    def set_config(
+        self, cfg_id: int, wait: bool = True, board: int | str | None = None
+    ) -> None:
+        """Switch to a preset: VdP 1-4 (1-8 on an 8-pad board), Hall 11-18,
+        or one saved with save_preset() (20-255).
+
+        The board acknowledges immediately and reports SETTLED once the
+        switches have settled. With wait=False the caller can prepare the
+        DMM in the meantime and call wait_settled() itself. board selects
+        one switch matrix (0-7) or "ALL" of them; by default matrix 0.
 
         Raises RuntimeError on ERR response.
         """
-        resp = self.send(f"CFG {cfg_id}")
+        cmd = f"CFG {cfg_id}" if board is None else f"BOARD {board} CFG {cfg_id}"
+        resp = self.send(cmd)
         if resp == "ERR" or not resp.startswith("OK"):
-            raise RuntimeError(f"CFG {cfg_id} failed: {resp}")
+            raise RuntimeError(f"{cmd} failed: {resp}")
+        if wait:
+            self.wait_settled(cfg=cfg_id)
+
+    def load_sequence(self, steps: list[tuple[int | str, int]]) -> int:
+        """Upload a routing sequence and return the number of stored steps.
+
+        Each step is (target, dwell_us). The target is a preset id (VdP 1-4,
+        Hall 11-18, saved 20-255) or four pad letters in I+ I- V+ V- order,
+        e.g. "ADCB".
+        """
+        tokens = [f"{target}:{dwell_us}" for target, dwell_us in steps]
+        count = 0
+        # Split across SEQ LOAD/ADD lines to stay under the firmware line limit
+        for i in range(0, len(tokens), 8):
+            verb = "LOAD" if i == 0 else "ADD"
+            resp = self.send(f"SEQ {verb} " + " ".join(tokens[i:i + 8]))
+            if not resp.startswith("OK SEQ"):
+                raise RuntimeError(f"SEQ {verb} failed: {resp}")
+            count = int(resp.split()[-1])
+        return count
+
+    def run_sequence(self, loops: int = 1, external: bool = False) -> None:
+        """Start the loaded sequence (loops=0 runs until aborted).
+
+        With external=True each step waits for a rising edge on the
+        trigger input instead of its dwell time.
+        """
+        self._events.clear()
+        cmd = f"SEQ RUN {loops}" + (" EXT" if external else "")
+        resp = self.send(cmd)
+        if resp != "OK SEQ RUN":
+            raise RuntimeError(f"{cmd} failed: {resp}")
+
+    def run_sweep(self, dwell_us: int = 0, external: bool = False) -> int:
+        """Run the 4 VdP + 8 Hall sweep once; returns the step count.
+
+        The board replies SEQ STEP per step (with settle_us) and stops with
+        SEQ FIELD before each field change; set the magnet, then call
+        continue_sequence().
+        """
+        self._events.clear()
+        cmd = f"SEQ SWEEP {dwell_us}" + (" EXT" if external else "")
+        resp = self.send(cmd)
+        if not resp.startswith("OK SEQ SWEEP"):
+            raise RuntimeError(f"{cmd} failed: {resp}")
+        return int(resp.split()[-1])
+
+    def continue_sequence(self) -> None:
+        """Resume a sequence held by SEQ FIELD."""
+        resp = self.send("SEQ CONTINUE")
+        if resp != "OK SEQ CONTINUE":
+            raise RuntimeError(f"SEQ CONTINUE failed: {resp}")
+
+    def abort_sequence(self) -> None:
+        """Stop a running sequence."""
+        resp = self.send("SEQ ABORT")
+        if resp != "OK SEQ ABORT":
+            raise RuntimeError(f"SEQ ABORT failed: {resp}")
+
+    def seq_status(self) -> dict[str, int]:
+        """Query sequence status, including the trigger-in counters of the
+        current or last EXT run (trig_in, trig_early, trig_missed)."""
+        resp = self.send("SEQ?")
+        status = parse_seq_status(resp)
+        if status is None:
+            raise RuntimeError(f"Failed to parse SEQ?: {resp}")
+        return status
+
+    def save_sequence(self) -> int:
+        """Keep the loaded sequence in the board's flash; returns its step
+        count. The board loads it again at power-up, so SEQ RUN works
+        without a new upload. Saving an empty sequence clears it."""
+        resp = self.send("SEQ SAVE")
+        if not resp.startswith("OK SEQ SAVE"):
+            raise RuntimeError(f"SEQ SAVE failed: {resp}")
+        return int(resp.split()[-1])
+
+    def presets(self) -> list[dict[str, int | str]]:
+        """Return every preset the board knows, built-in and saved, as
+        parse_preset() dicts in id order."""
+        lines, complete = self._command_until(
+            "PRESET LIST", lambda line: line.startswith(("OK PRESET LIST", "ERR"))
+        )
+        if not complete or not lines[-1].startswith("OK"):
+            raise RuntimeError("PRESET LIST failed")
+        presets = [parse_preset(line) for line in lines[:-1]]
+        return [p for p in presets if p is not None]
+
+    def save_preset(self, cfg_id: int, pads: str | None = None, field: int = 0) -> None:
+        """Store a routing in the board's flash as preset cfg_id (20-255).
+
+        pads is four letters in I+ I- V+ V- order, e.g. "ADCB"; by default
+        the current routing is saved. field (+1/-1) marks a Hall step so a
+        sequence stops for the magnet. Saving over an id replaces it.
+        """
+        cmd = f"PRESET SAVE {cfg_id}"
+        if pads is not None:
+            if len(pads) != 4:
+                raise ValueError(f"Need four pads (I+ I- V+ V-), got {pads!r}")
+            cmd += " " + " ".join(pads)
+        if field:
+            cmd += " +" if field > 0 else " -"
+        resp = self.send(cmd)
+        if resp != f"OK PRESET SAVE {cfg_id}":
+            raise RuntimeError(f"{cmd} failed: {resp}")
+
+    def delete_preset(self, cfg_id: int) -> None:
+        """Remove a saved preset from the board's flash."""
+        resp = self.send(f"PRESET DEL {cfg_id}")
+        if resp != f"OK PRESET DEL {cfg_id}":
+            raise RuntimeError(f"PRESET DEL {cfg_id} failed: {resp}")
+
+    def stream_events(self, on: bool = True) -> None:
+        """Turn the board's event-log stream on or off.
+
+        While on, every route write, enable-mask write, settle and
+        SWTEST/CFGTEST result arrives as an "EVT seq=..." line; read them
+        with next_event() and parse_event(). A jump in seq means records
+        were dropped, and an "EVT DROPPED total=n" line says how many.
+        """
+        cmd = "EVT ON" if on else "EVT OFF"
+        resp = self.send(cmd)
+        if resp != f"OK {cmd}":
+            raise RuntimeError(f"{cmd} failed: {resp}")
+
+    def start_adc(
+        self,
+        rate_hz: int = 500000,
+        average: int = 1250,
+        records: int = 0,
+        drive: bool = False,
+    ) -> None:
+        """Start sampling the four probes (J1-J4) on the board's ADC.
+
+        rate_hz is conversions per second over all four probes (1000 to
+        500000), and every `average` rounds become one record, at most
+        1000 records/s. records=0 samples until stop_adc(). With
+        drive=True the routed pads are driven high while sampling (test
+        harness on J5), so each leg reads the divider of its switch
+        against the probe pulldown. Read the records with next_adc().
+        """
+        self._adc.clear()
+        cmd = f"ADC START {rate_hz} {average} {records}" + (" DRIVE" if drive else "")
+        resp = self.send(cmd)
+        if resp != f"OK ADC START {rate_hz} {average}":
+            raise RuntimeError(f"{cmd} failed: {resp}")
+
+    def stop_adc(self) -> None:
+        """Stop the probe ADC and release the pads."""
+        resp = self.send("ADC STOP")
+        if resp != "OK ADC STOP":
+            raise RuntimeError(f"ADC STOP failed: {resp}")
+
+    def adc_status(self) -> dict[str, int]:
+        """Query the probe ADC (ADC?): active, rate, avg, drive, records,
+        overruns (buffers lost on the board) and dropped (records lost to
+        the stream)."""
+        resp = self.send("ADC?")
+        status = parse_adc_status(resp)
+        if status is None:
+            raise RuntimeError(f"Failed to parse ADC status: {resp}")
+        return status
+
+    def next_adc(self, timeout: float | None = None) -> dict[str, object] | None:
+        """Return the next probe ADC record as parse_adc() gives it, or
+        None on timeout. "ADC DROPPED" notices are skipped."""
+        end = time.monotonic() + (self.timeout if timeout is None else timeout)
+        with self._cond:
+            while self._wait(lambda: bool(self._adc), end - time.monotonic()):
+                record = parse_adc(self._adc.popleft())
+                if record is not None:
+                    return record
+        return None
+
+    def acquire_adc(
+        self,
+        records: int,
+        rate_hz: int = 500000,
+        average: int = 1250,
+        drive: bool = False,
+    ) -> list[dict[str, object]]:
+        """Take `records` probe ADC records and return them (see start_adc()).
+
+        Raises TimeoutError if the board stops sending before all arrive.
+        """
+        self.start_adc(rate_hz, average, records, drive)
+        # Each record takes 4 * average / rate_hz seconds
+        wait = self.timeout + 4 * average / rate_hz
+        result: list[dict[str, object]] = []
+        while len(result) < records:
+            record = self.next_adc(wait)
+            if record is None:
+                raise TimeoutError(f"Got {len(result)} of {records} ADC records")
+            result.append(record)
+        return result
 
     def get_state(self) -> dict[str, str]:
         """Query board state. Returns dict with cfg, ip, im, vp, vm."""
@@ -161,12 +1051,110 @@ class OpenPauwBoard:
             raise RuntimeError(f"Failed to parse state: {resp}")
         return state
 
+    def boards(self) -> list[int]:
+        """Return the switch matrices (MCP23017 at 0x20 + n) found at boot."""
+        resp = self.send("BOARDS?")
+        boards = parse_boards(resp)
+        if boards is None:
+            raise RuntimeError(f"Failed to parse boards: {resp}")
+        return boards
+
+    def boot_info(self) -> dict[str, int | str]:
+        """Return the boot phase timings and self-test result (BOOT?)."""
+        resp = self.send("BOOT?")
+        info = parse_boot(resp)
+        if info is None:
+            raise RuntimeError(f"Failed to parse boot info: {resp}")
+        return info
+
     def swtest(self) -> str:
         """Run the switch test and return full output."""
-        lines = self.send_lines("SWTEST", timeout=2.0)
+        lines = self.send_lines(
+            "SWTEST", timeout=2.0, done=lambda line: line.startswith(("OK SWTEST", "ERR"))
+        )
         return "\n".join(lines)
 
     def cfgtest(self) -> bool:
         """Run CFGTEST and return True if all configs pass."""
-        lines = self.send_lines("CFGTEST", timeout=5.0)
-        return any("PASS" in line for line in lines)
+        lines = self.send_lines(
+            "CFGTEST", timeout=5.0, done=lambda line: line.startswith(("OK CFGTEST", "ERR"))
+        )
+        # Per-switch lines say PASS too; only the final line covers all four
+        return bool(lines) and lines[-1] == "OK CFGTEST PASS"
+
+    def stats(self) -> list[str]:
+        """Return the board's STATS? lines (timing counters), up to STATS END."""
+        lines, complete = self._command_until("STATS?", lambda line: line == "STATS END")
+        if not complete:
+            raise TimeoutError("No STATS END from board")
+        return lines[:-1]
+
+    def reset_stats(self) -> None:
+        """Clear the board's timing counters."""
+        resp = self.send("STATS RESET")
+        if resp != "OK STATS RESET":
+            raise RuntimeError(f"STATS RESET failed: {resp}")
+
+    # Binary mode
+
+    def enter_binary(self) -> None:
+        """Switch the board to binary framed mode."""
+        # The reader switches to frames itself once it sees OK MODE BIN
+        resp = self.send("MODE BIN")
+        if resp != "OK MODE BIN":
+            raise RuntimeError(f"MODE BIN failed: {resp}")
+
+    def exit_binary(self) -> None:
+        """Return the board to line mode."""
+        self.bin_request(OP_MODE_ASCII)
+
+    def bin_submit(self, op: int, payload: bytes = b"") -> int:
+        """Send a binary request without waiting; returns its request id.
+
+        Any number of requests may be outstanding; collect each reply with
+        bin_result().
+        """
+        ser = self._check()
+        req_id = self._next_id
+        self._next_id = self._next_id % 255 + 1
+        ser.write(encode_request(req_id, op, payload))
+        return req_id
+
+    def bin_result(self, req_id: int, timeout: float | None = None) -> BinaryFrame:
+        """Wait for the reply to request req_id.
+
+        Events arriving meanwhile are kept for bin_event(). Raises
+        RuntimeError if the board rejected the request.
+        """
+        with self._cond:
+            if not self._wait(
+                lambda: req_id in self._replies,
+                self.timeout if timeout is None else timeout,
+            ):
+                raise TimeoutError(f"No reply to binary request {req_id}")
+            frame = self._replies.pop(req_id)
+        if frame.status != 0:
+            status = BIN_STATUS.get(frame.status, str(frame.status))
+            raise RuntimeError(f"Binary op 0x{frame.op:02X} failed: {status}")
+        return frame
+
+    def bin_request(self, op: int, payload: bytes = b"") -> BinaryFrame:
+        """Send a binary request and wait for its reply."""
+        return self.bin_result(self.bin_submit(op, payload))
+
+    def bin_event(self, timeout: float | None = None) -> BinaryFrame | None:
+        """Return the next EVT_SETTLED/EVT_TEXT frame, or None on timeout."""
+        with self._cond:
+            if not self._wait(
+                lambda: bool(self._bin_events),
+                self.timeout if timeout is None else timeout,
+            ):
+                return None
+            return self._bin_events.popleft()
+
+    def bin_get_state(self) -> dict[str, object]:
+        """Query board state in binary mode (see unpack_state)."""
+        state = unpack_state(self.bin_request(OP_STATE).payload)
+        if state is None:
+            raise RuntimeError("Malformed binary STATE reply")
+        return state
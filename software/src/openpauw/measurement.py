@@ -12,10 +12,39 @@ from pykeithley_dmm6500 import VdpResult
 from pykeithley_dmm6500 import sheet_resistance_from_configs
 
 from openpauw.board import OpenPauwBoard
+from openpauw.board import parse_seq_step
+
+VDP_CONFIGS = (1, 2, 3, 4)
+DMM_BUFFER = "defbuffer1"
+
+
+def parse_reading_buffer(text: str) -> list[float]:
+    """Parse a TRAC:DATA? reply (comma-separated readings) into floats."""
+    return [float(value) for value in text.strip().split(",") if value.strip()]
+
+
+def split_by_config(
+    readings: list[float], configs: tuple[int, ...] = VDP_CONFIGS
+) -> dict[int, list[float]]:
+    """Deal readings taken in sequence order (cfg 1, 2, 3, 4, 1, ...) out
+    to their configurations."""
+    return {cfg_id: readings[i::len(configs)] for i, cfg_id in enumerate(configs)}
+
+
+def points_per_minute(points: int, elapsed_s: float) -> float:
+    """Acquisition rate, for comparing the serial and pipelined modes."""
+    return points * 60.0 / elapsed_s if elapsed_s > 0 else 0.0
 
 
 class VdpMeasurement:
-    """Orchestrates a full Van der Pauw measurement sequence."""
+    """Orchestrates a full Van der Pauw measurement sequence.
+
+    measure_all() is the serial loop: set a configuration, wait, read the
+    DMM, four times over USB. measure_pipelined() hands the stepping to the
+    hardware instead. It needs two BNC links: board D24 (settled trigger out)
+    to the DMM's EXT TRIG IN, and the DMM's EXT TRIG OUT to board D25
+    (trigger in). Both record the achieved rate in points_per_minute.
+    """
 
     def __init__(
         self,
@@ -28,6 +57,7 @@ class VdpMeasurement:
         self.dmm = dmm
         self.current = current
         self.settle_time = settle_time
+        self.points_per_minute: float | None = None
 
     def configure_dmm(self, nplc: float = 10, range_v: float = 1.0) -> None:
         """Configure the DMM for Van der Pauw voltage sensing."""
@@ -44,11 +74,85 @@ class VdpMeasurement:
 
     def measure_all(self) -> dict[int, float]:
         """Measure all four VDP configurations."""
+        start = time.monotonic()
         voltages: dict[int, float] = {}
-        for cfg_id in range(1, 5):
+        for cfg_id in VDP_CONFIGS:
             voltages[cfg_id] = self.measure_config(cfg_id)
+        self.points_per_minute = points_per_minute(len(voltages), time.monotonic() - start)
         return voltages
 
+    def arm_external_trigger(self, count: int) -> None:
+        """Load a DMM trigger model that takes `count` readings, each on a
+        rising edge at EXT TRIG IN, into the reading buffer, and pulses EXT
+        TRIG OUT after each one. Starts it waiting for the first edge."""
+        for command in (
+            "TRIG:EXT:IN:EDGE RIS",
+            "TRIG:EXT:OUT:LOG POS",
+            "TRIG:EXT:OUT:STIM NOT1",
+            'TRIG:LOAD "Empty"',
+            f'TRIG:BLOC:BUFF:CLE 1, "{DMM_BUFFER}"',
+            "TRIG:BLOC:WAIT 2, EXT",
+            f'TRIG:BLOC:MEAS 3, "{DMM_BUFFER}", 1',
+            "TRIG:BLOC:NOT 4, 1",
+            f"TRIG:BLOC:BRAN:COUN 5, {count}, 2",
+            "INIT",
+        ):
+            self.dmm.write(command)
+
+    def read_buffer(self, count: int) -> list[float]:
+        """Fetch the first `count` readings from the DMM's reading buffer in
+        one transfer, once the trigger model has finished."""
+        self.dmm.query("*OPC?")
+        return parse_reading_buffer(
+            self.dmm.query(f'TRAC:DATA? 1, {count}, "{DMM_BUFFER}", READ')
+        )
+
+    def measure_pipelined(
+        self, passes: int = 1, timeout: float | None = None
+    ) -> dict[int, list[float]]:
+        """Measure all four configurations `passes` times without a host
+        round trip per point.
+
+        The DMM is armed first, then the board runs the VdP list in EXT
+        mode. Each settled pulse from the board triggers a reading, and the
+        DMM's reading-complete pulse makes the board route the next
+        configuration at once. The readings are fetched in bulk at the end.
+        Returns the readings per configuration, in pass order.
+        """
+        total = passes * len(VDP_CONFIGS)
+        self.board.load_sequence([(cfg_id, 0) for cfg_id in VDP_CONFIGS])
+        self.arm_external_trigger(total)
+        start = time.monotonic()
+        self.board.run_sequence(loops=passes, external=True)
+
+        # No reading may take longer than settle_time plus the board timeout
+        end = start + (timeout if timeout is not None else total * (self.settle_time + 1.0))
+        steps = 0
+        while True:
+            event = self.board.next_event(max(end - time.monotonic(), 0.0))
+            if not event:
+                self.board.abort_sequence()
+                raise TimeoutError(
+                    f"Pipelined run stalled after {steps} of {total} points; "
+                    "check the trigger cables"
+                )
+            if parse_seq_step(event) is not None:
+                steps += 1
+            elif event.startswith("SEQ DONE"):
+                break
+        self.points_per_minute = points_per_minute(total, time.monotonic() - start)
+
+        status = self.board.seq_status()
+        if status.get("trig_missed", 0) or status.get("trig_early", 0):
+            raise RuntimeError(
+                f"Trigger-in edges out of step (early={status.get('trig_early')}, "
+                f"missed={status.get('trig_missed')}): readings do not match configurations"
+            )
+        readings = self.read_buffer(total)
+        if len(readings) != total:
+            raise RuntimeError(f"DMM returned {len(readings)} readings, expected {total}")
+        return split_by_config(readings)
+
     def compute(
         self,
         voltages: dict[int, float],
@@ -72,6 +176,16 @@ class VdpMeasurement:
         result = self.compute(voltages, thickness_cm)
         return voltages, result
 
+    def run_pipelined(
+        self, passes: int = 1, thickness_cm: float | None = None
+    ) -> tuple[dict[int, float], VdpResult]:
+        """Pipelined counterpart of run(): each configuration's voltage is
+        the mean over `passes` readings."""
+        readings = self.measure_pipelined(passes)
+        voltages = {cfg_id: sum(values) / len(values) for cfg_id, values in readings.items()}
+        result = self.compute(voltages, thickness_cm)
+        return voltages, result
+
     def save_csv(
         self,
         filepath: str,
@@ -1,6 +1,38 @@
 """Tests for openpauw.board (no hardware required)."""
 
-from openpauw.board import parse_state
+import threading
+import time
+
+import pytest
+
+from openpauw.board import (
+    BATCH_MAX_COMMANDS,
+    OP_CFG,
+    OpenPauwBoard,
+    cobs_decode,
+    cobs_encode,
+    crc16,
+    decode_frame,
+    encode_request,
+    format_batch,
+    parse_adc,
+    parse_adc_status,
+    parse_boards,
+    parse_boot,
+    parse_event,
+    parse_preset,
+    parse_ready,
+    parse_seq_field,
+    parse_seq_status,
+    parse_seq_step,
+    parse_settled,
+    parse_state,
+    unpack_adc,
+    unpack_event_log,
+    unpack_settled,
+    unpack_state,
+)
+from openpauw.measurement import parse_reading_buffer, points_per_minute, split_by_config
 
 
 class TestParseState:
@@ -30,3 +62,367 @@ class TestParseState:
 
     def test_empty(self):
         assert parse_state("") is None
+
+
+class TestParseBoards:
+    def test_boards(self):
+        assert parse_boards("BOARDS COUNT=3 PRESENT=0,1,3") == [0, 1, 3]
+
+    def test_board_state_line(self):
+        result = parse_state("STATE BOARD=2 CFG=3 IP=D IM=A VP=B VM=C")
+        assert result is not None
+        assert result["board"] == "2"
+        assert result["cfg"] == "3"
+
+    def test_invalid(self):
+        assert parse_boards("STATE CFG=1") is None
+        assert parse_boards("BOARDS COUNT=0") is None
+
+
+class TestParseSettled:
+    def test_valid_settled(self):
+        result = parse_settled("SETTLED cfg=2 t_us=51768")
+        assert result == {"cfg": 2, "t_us": 51768}
+
+    def test_set_reports_cfg_zero(self):
+        result = parse_settled("SETTLED cfg=0 t_us=21768")
+        assert result is not None
+        assert result["cfg"] == 0
+
+    def test_not_settled_line(self):
+        assert parse_settled("OK CFG 2") is None
+
+    def test_missing_time(self):
+        assert parse_settled("SETTLED cfg=1") is None
+
+    def test_bad_number(self):
+        assert parse_settled("SETTLED cfg=1 t_us=x") is None
+
+
+class TestParseSeqStep:
+    def test_valid_step(self):
+        result = parse_seq_step("SEQ STEP n=2 cfg=2 t_us=104536")
+        assert result == {"n": 2, "cfg": 2, "t_us": 104536}
+
+    def test_done_is_not_step(self):
+        assert parse_seq_step("SEQ DONE loops=1") is None
+
+    def test_missing_field(self):
+        assert parse_seq_step("SEQ STEP n=1 cfg=1") is None
+
+    def test_hall_step(self):
+        result = parse_seq_step("SEQ STEP n=9 cfg=18 t_us=503117 settle_us=20 field=-1")
+        assert result == {"n": 9, "cfg": 18, "t_us": 503117, "settle_us": 20, "field": -1}
+
+
+class TestParseSeqField:
+    def test_reverse(self):
+        assert parse_seq_field("SEQ FIELD n=9 field=-1") == {"n": 9, "field": -1}
+
+    def test_step_is_not_field(self):
+        assert parse_seq_field("SEQ STEP n=9 cfg=18 t_us=1 settle_us=1") is None
+
+
+class TestParseSeqStatus:
+    def test_trigger_counters(self):
+        line = (
+            "SEQ STEPS=4 ACTIVE=1 STEP=3 LOOPS=0 EXT=1 FIELD_WAIT=0 "
+            "TRIG_IN=6 TRIG_EARLY=1 TRIG_MISSED=1"
+        )
+        result = parse_seq_status(line)
+        assert result["ext"] == 1
+        assert (result["trig_in"], result["trig_early"], result["trig_missed"]) == (6, 1, 1)
+
+    def test_step_event_is_not_status(self):
+        assert parse_seq_status("SEQ STEP n=1 cfg=1 t_us=1 settle_us=1") is None
+
+
+class TestParseEvent:
+    def test_route_event(self):
+        line = "EVT seq=142 t_us=2693962 type=route board=0 cfg=3 pads=DABC en=15"
+        assert parse_event(line) == {
+            "seq": 142,
+            "t_us": 2693962,
+            "type": "route",
+            "board": 0,
+            "cfg": 3,
+            "pads": "DABC",
+            "en": 15,
+        }
+
+    def test_status_reply_is_not_event(self):
+        assert parse_event("EVT STREAM=1 NEXT_SEQ=3 PENDING=0 DROPPED=0") is None
+
+    def test_unpack_event_log(self):
+        route = (7).to_bytes(4, "little") + (1000).to_bytes(4, "little")
+        route += (0x0123 | 0x3000).to_bytes(4, "little") + bytes([1, 0, 2, 15])
+        settled = (8).to_bytes(4, "little") + (51000).to_bytes(4, "little")
+        settled += (50012).to_bytes(4, "little") + bytes([3, 0, 2, 0])
+        dropped, events = unpack_event_log((5).to_bytes(4, "little") + route + settled)
+        assert dropped == 5
+        assert events[0]["pads"] == "DCBD" and events[0]["cfg"] == 2
+        assert events[1] == {"seq": 8, "t_us": 51000, "type": "settled", "cfg": 2, "settle_us": 50012}
+        assert unpack_event_log(bytes(5)) is None
+
+
+class TestProbeAdc:
+    def test_parse_record_and_status(self):
+        line = "ADC seq=4 t_us=56359 n=1250 mv=3141,3141,2357,3141 pp=3,3,2,3"
+        assert parse_adc(line) == {
+            "seq": 4,
+            "t_us": 56359,
+            "n": 1250,
+            "mv": [3141, 3141, 2357, 3141],
+            "pp": [3, 3, 2, 3],
+        }
+        assert parse_adc("ADC DROPPED total=3") is None
+        status = parse_adc_status(
+            "ADC ACTIVE=1 RATE=500000 AVG=1250 DRIVE=1 RECORDS=7 OVERRUNS=0 DROPPED=0"
+        )
+        assert status["active"] == 1 and status["rate"] == 500000 and status["records"] == 7
+
+    def test_unpack_adc(self):
+        # Mean 3900 x 16, min 3895, max 3905 on each probe
+        rec = (2).to_bytes(4, "little") + (26359).to_bytes(4, "little")
+        rec += (1250).to_bytes(4, "little")
+        for value in [3900 * 16] * 4 + [3895] * 4 + [3905] * 4:
+            rec += value.to_bytes(2, "little")
+        dropped, records = unpack_adc((1).to_bytes(4, "little") + rec + rec)
+        assert dropped == 1 and len(records) == 2
+        assert records[0] == {
+            "seq": 2, "t_us": 26359, "n": 1250, "mv": [3142] * 4, "pp": [8] * 4
+        }
+        assert unpack_adc(bytes(39)) is None
+
+
+class TestParsePreset:
+    def test_saved_hall_preset(self):
+        line = "PRESET CFG=40 USER=1 FIELD=-1 IP=D IM=C VP=B VM=A"
+        assert parse_preset(line) == {"cfg": 40, "user": 1, "field": -1, "pads": "DCBA"}
+
+    def test_list_terminator_is_not_preset(self):
+        assert parse_preset("OK PRESET LIST 13") is None
+
+    def test_presets_reads_to_terminator(self):
+        port = FakePort(
+            {
+                b"PRESET LIST\n": b"PRESET CFG=1 USER=0 FIELD=0 IP=C IM=B VP=A VM=D\r\n"
+                b"PRESET CFG=40 USER=1 FIELD=0 IP=D IM=C VP=B VM=A\r\n"
+                b"OK PRESET LIST 2\r\n"
+            }
+        )
+        board = OpenPauwBoard(port="fake")
+        board._start(port)
+        assert [p["cfg"] for p in board.presets()] == [1, 40]
+        board.disconnect()
+
+
+class TestParseReady:
+    def test_capability_line(self):
+        line = "READY FW=2.0.0 PADS=8 BOARDS=2 MCP=1"
+        assert parse_ready(line) == {"fw": "2.0.0", "pads": 8, "boards": 2, "mcp": 1}
+        assert parse_ready("READY") == {}
+        assert parse_ready("READY?") is None
+
+    def test_boot_after_watchdog(self):
+        line = (
+            "BOOT RESET=WATCHDOG USB_US=1 LED_US=1 MCP_US=6008 ROUTE_US=6009"
+            " READY_US=6009 PRESETS_US=6010 SETTLED_US=6009 SELFTEST_US=6009"
+            " SELFTEST=PASS CACHED=1"
+        )
+        info = parse_boot(line)
+        assert info is not None
+        assert info["reset"] == "WATCHDOG"
+        assert info["ready_us"] == 6009
+        assert info["selftest"] == "PASS"
+        assert info["cached"] == 1
+
+    def test_ready_reply_sets_capabilities(self):
+        port = FakePort({b"READY?\n": b"READY FW=2.0.0 PADS=4 BOARDS=0 MCP=0\r\n"})
+        board = OpenPauwBoard(port="fake")
+        board._start(port)
+        assert board.send("READY?").startswith("READY FW=")
+        assert board.capabilities["mcp"] == 0
+        board.disconnect()
+
+
+class TestPipelinedReadings:
+    def test_buffer_split_per_config(self):
+        readings = parse_reading_buffer("1.0e-3,-2.0e-3,3.0e-3,-4.0e-3,1.5e-3,-2.5e-3,3.5e-3,-4.5e-3\n")
+        by_cfg = split_by_config(readings)
+        assert by_cfg[1] == [1.0e-3, 1.5e-3]
+        assert by_cfg[4] == [-4.0e-3, -4.5e-3]
+
+    def test_points_per_minute(self):
+        assert points_per_minute(8, 2.0) == pytest.approx(240.0)
+        assert points_per_minute(4, 0.0) == 0.0
+
+
+def response(packet: bytes) -> bytes:
+    """Encode a firmware-side frame (without delimiter) for decode_frame."""
+    return cobs_encode(packet + crc16(packet).to_bytes(2, "little"))
+
+
+class TestFormatBatch:
+    def test_block(self):
+        data = format_batch(["ENMASK 15", "SET A D C B", "CFGTEST"])
+        assert data == b"BEGIN\nENMASK 15\nSET A D C B\nCFGTEST\nEND\n"
+
+    def test_rejects_newline(self):
+        with pytest.raises(ValueError):
+            format_batch(["CFG 1\nCFG 2"])
+
+    def test_rejects_too_many(self):
+        with pytest.raises(ValueError):
+            format_batch(["PING"] * (BATCH_MAX_COMMANDS + 1))
+
+
+class TestBinaryFrames:
+    def test_crc_check_value(self):
+        assert crc16(b"123456789") == 0x29B1
+
+    def test_cobs_known_vectors(self):
+        assert cobs_encode(b"") == b"\x01"
+        assert cobs_encode(b"\x00") == b"\x01\x01"
+        assert cobs_encode(b"\x11\x22\x00\x33") == b"\x03\x11\x22\x02\x33"
+        assert cobs_encode(bytes(range(1, 255))) == b"\xff" + bytes(range(1, 255))
+
+    def test_cobs_round_trip(self):
+        for data in (b"\x00" * 3, bytes(range(256)) * 2, b"\x00" + b"\x07" * 254):
+            encoded = cobs_encode(data)
+            assert 0 not in encoded
+            assert cobs_decode(encoded) == data
+
+    def test_request_frame(self):
+        frame = encode_request(7, OP_CFG, b"\x02")
+        assert frame.endswith(b"\x00")
+        packet = cobs_decode(frame[:-1])
+        assert packet[:3] == b"\x07\x10\x02"
+        assert int.from_bytes(packet[3:], "little") == crc16(b"\x07\x10\x02")
+
+    def test_decode_response(self):
+        frame = decode_frame(response(b"\x07\x10\x00"))
+        assert (frame.id, frame.op, frame.status, frame.payload) == (7, 0x10, 0, b"")
+
+    def test_decode_bad_crc(self):
+        data = bytearray(cobs_decode(response(b"\x07\x10\x00")))
+        data[-1] ^= 0xFF
+        with pytest.raises(ValueError):
+            decode_frame(cobs_encode(bytes(data)))
+
+    def test_unpack_state(self):
+        state = unpack_state(bytes([4, 0, 3, 2, 1, 15, 0x01]))
+        assert state is not None
+        assert state["cfg"] == 4
+        pads = (state["ip"], state["im"], state["vp"], state["vm"])
+        assert pads == ("A", "D", "C", "B")
+        assert state["enmask"] == 15
+        assert state["routing"] is True
+        assert state["seq_active"] is False
+
+    def test_unpack_state_eight_pads(self):
+        state = unpack_state(bytes([7, 7, 4, 5, 6, 15, 0x00]))
+        assert state is not None
+        pads = (state["ip"], state["im"], state["vp"], state["vm"])
+        assert pads == ("H", "E", "F", "G")
+        assert unpack_state(bytes([7, 8, 4, 5, 6, 15, 0x00])) is None
+
+    def test_unpack_state_wrong_size(self):
+        assert unpack_state(b"\x01\x00") is None
+
+    def test_unpack_settled(self):
+        payload = bytes([2]) + (51768).to_bytes(4, "little")
+        assert unpack_settled(payload) == {"cfg": 2, "t_us": 51768}
+
+
+class FakePort:
+    """Serial stand-in that answers each written command from a script."""
+
+    def __init__(self, script: dict[bytes, bytes]) -> None:
+        self.script = script
+        self.rx = bytearray()
+        self.cond = threading.Condition()
+
+    @property
+    def in_waiting(self) -> int:
+        return len(self.rx)
+
+    def read(self, n: int) -> bytes:
+        with self.cond:
+            self.cond.wait_for(lambda: self.rx, 0.02)
+            data = bytes(self.rx[:n])
+            del self.rx[:n]
+            return data
+
+    def write(self, data: bytes) -> int:
+        with self.cond:
+            self.rx += self.script.get(data, b"")
+            self.cond.notify_all()
+        return len(data)
+
+    def flush(self) -> None:
+        pass
+
+    def close(self) -> None:
+        pass
+
+
+class TestBackgroundReader:
+    def make_board(self, script: dict[bytes, bytes]) -> OpenPauwBoard:
+        board = OpenPauwBoard(port="fake")
+        board._start(FakePort(script))
+        return board
+
+    def test_swtest_returns_on_terminator(self):
+        board = self.make_board(
+            {b"SWTEST\n": b"SWTEST RESULT:\r\nCONNECTIONS=16\r\nOK SWTEST\r\n"}
+        )
+        start = time.monotonic()
+        output = board.swtest()
+        assert time.monotonic() - start < 1.0
+        assert output.splitlines()[-1] == "OK SWTEST"
+        board.disconnect()
+
+    def test_events_routed_apart_from_responses(self):
+        board = self.make_board(
+            {
+                b"CFG 2\n": b"OK CFG 2\r\nSETTLED cfg=2 t_us=51768\r\n",
+                b"TEST STEP\n": b"TEST STEP PAD=A EN=IP\r\nOK TEST STEP\r\n",
+            }
+        )
+        board.set_config(2)
+        assert board.send("TEST STEP") == "OK TEST STEP"
+        assert board.next_event(0.5) == "TEST STEP PAD=A EN=IP"
+        board.disconnect()
+
+    def test_settled_belongs_to_its_cfg(self):
+        board = self.make_board(
+            {
+                b"CFG 1\n": b"OK CFG 1\r\nSETTLED cfg=1 t_us=21768\r\n",
+                b"CFG 2\n": b"OK CFG 2\r\n",
+                b"CFG 3\n": b"OK CFG 3\r\nSETTLED cfg=2 t_us=1\r\n"
+                b"SETTLED cfg=3 t_us=51768\r\n",
+            }
+        )
+        board.set_config(1, wait=False)
+        time.sleep(0.05)
+        board.set_config(2, wait=False)
+        with pytest.raises(TimeoutError):
+            board.wait_settled(0.1)
+        board.set_config(3, wait=False)
+        assert board.wait_settled(0.5, cfg=3) == {"cfg": 3, "t_us": 51768}
+        board.disconnect()
+
+    def test_acquire_adc_keeps_records_apart(self):
+        board = self.make_board(
+            {
+                b"ADC START 500000 1250 2\n": b"OK ADC START 500000 1250\r\n"
+                b"ADC seq=0 t_us=10000 n=1250 mv=1,2,3,4 pp=0,0,0,0\r\n"
+                b"ADC DROPPED total=1\r\n"
+                b"ADC seq=2 t_us=30000 n=1250 mv=1,2,3,4 pp=0,0,0,0\r\n"
+            }
+        )
+        records = board.acquire_adc(2)
+        assert [r["seq"] for r in records] == [0, 2]
+        assert board.next_event(0.05) == ""
+        board.disconnect()